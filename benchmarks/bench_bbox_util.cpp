@@ -0,0 +1,87 @@
+// SSD post-processing primitives at SSD300 scale (8732 priors).
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "caffe/util/bbox_util.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+static const int kSSD300Priors = 8732;
+
+// Random boxes of 5..30% of the image with scores skewed towards zero, which
+// resembles per-class confidences after softmax
+static void MakeBoxes(int num, vector<float>* boxes, vector<float>* scores) {
+  boxes->resize(num * 4);
+  scores->resize(num);
+  vector<float> rnd(num * 4);
+  caffe_rng_uniform(num * 4, 0.F, 1.F, rnd.data());
+  for (int i = 0; i < num; ++i) {
+    const float w = 0.05F + 0.25F * rnd[i * 4 + 2];
+    const float h = 0.05F + 0.25F * rnd[i * 4 + 3];
+    const float x = rnd[i * 4] * (1.F - w);
+    const float y = rnd[i * 4 + 1] * (1.F - h);
+    (*boxes)[i * 4] = x;
+    (*boxes)[i * 4 + 1] = y;
+    (*boxes)[i * 4 + 2] = x + w;
+    (*boxes)[i * 4 + 3] = y + h;
+  }
+  caffe_rng_uniform(num, 0.F, 1.F, scores->data());
+  for (float& s : *scores) {
+    s = s * s * s;
+  }
+}
+
+static void BM_JaccardOverlapRaw(benchmark::State& state) {
+  vector<float> boxes, scores;
+  MakeBoxes(kSSD300Priors, &boxes, &scores);
+  float sum = 0.F;
+  for (auto _ : state) {
+    for (int i = 1; i < kSSD300Priors; ++i) {
+      sum += JaccardOverlap(&boxes[0], &boxes[i * 4]);
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * (kSSD300Priors - 1));
+}
+BENCHMARK(BM_JaccardOverlapRaw);
+
+static void BM_JaccardOverlapNormalizedBBox(benchmark::State& state) {
+  vector<float> boxes, scores;
+  MakeBoxes(kSSD300Priors, &boxes, &scores);
+  vector<NormalizedBBox> bboxes(kSSD300Priors);
+  for (int i = 0; i < kSSD300Priors; ++i) {
+    bboxes[i].set_xmin(boxes[i * 4]);
+    bboxes[i].set_ymin(boxes[i * 4 + 1]);
+    bboxes[i].set_xmax(boxes[i * 4 + 2]);
+    bboxes[i].set_ymax(boxes[i * 4 + 3]);
+  }
+  float sum = 0.F;
+  for (auto _ : state) {
+    for (int i = 1; i < kSSD300Priors; ++i) {
+      sum += JaccardOverlap(bboxes[0], bboxes[i]);
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * (kSSD300Priors - 1));
+}
+BENCHMARK(BM_JaccardOverlapNormalizedBBox);
+
+// Args: number of boxes, top_k; thresholds as in the SSD300 deploy nets
+static void BM_ApplyNMSFast(benchmark::State& state) {
+  const int num = state.range(0), top_k = state.range(1);
+  vector<float> boxes, scores;
+  MakeBoxes(num, &boxes, &scores);
+  vector<int> indices;
+  for (auto _ : state) {
+    ApplyNMSFast(boxes.data(), scores.data(), num, 0.01F, 0.45F, 1.F, top_k, &indices);
+    benchmark::DoNotOptimize(indices.data());
+  }
+  state.counters["kept"] = indices.size();
+  state.SetItemsProcessed(state.iterations() * num);
+}
+BENCHMARK(BM_ApplyNMSFast)->Args({kSSD300Priors, 400})->Args({kSSD300Priors, -1})
+    ->Args({24564, 400});  // SSD512
+
+}  // namespace caffe
@@ -0,0 +1,118 @@
+// Host side of the input pipeline: JPEG decoding, DataTransformer and the
+// BlockingQueue used between readers, transformers and prefetchers.
+#include <benchmark/benchmark.h>
+
+#include <thread>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "caffe/blob.hpp"
+#include "caffe/data_transformer.hpp"
+#include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/io.hpp"
+
+namespace caffe {
+
+// Raw 3xSxS datum holding random pixels, as stored by convert_imageset
+static void MakeRawDatum(int size, Datum* datum) {
+  cv::Mat img(size, size, CV_8UC3);
+  cv::randu(img, cv::Scalar::all(0), cv::Scalar::all(255));
+  CVMatToDatum(img, *datum);
+  datum->set_label(1);
+}
+
+// Encoded datum; a smooth gradient keeps the JPEG size close to real photos
+static void MakeJpegDatum(int size, Datum* datum) {
+  cv::Mat img(size, size, CV_8UC3);
+  for (int h = 0; h < size; ++h) {
+    for (int w = 0; w < size; ++w) {
+      img.at<cv::Vec3b>(h, w) = cv::Vec3b(h % 256, w % 256, (h + w) % 256);
+    }
+  }
+  cv::Mat noise(size, size, CV_8UC3);
+  cv::randu(noise, cv::Scalar::all(0), cv::Scalar::all(32));
+  img += noise;
+  vector<unsigned char> buf;
+  cv::imencode(".jpg", img, buf);
+  datum->set_data(string(buf.begin(), buf.end()));
+  datum->set_encoded(true);
+  datum->set_label(1);
+}
+
+// Args: source size, crop size (ImageNet 256 -> 227/224, SSD 300 -> 300)
+static void BM_TransformDatum(benchmark::State& state) {
+  const int size = state.range(0), crop = state.range(1);
+  Datum datum;
+  MakeRawDatum(size, &datum);
+  TransformationParameter param;
+  param.set_crop_size(crop);
+  param.set_mirror(true);
+  param.add_mean_value(104.F);
+  param.add_mean_value(117.F);
+  param.add_mean_value(123.F);
+  DataTransformer<float> transformer(param, TRAIN);
+  transformer.InitRand();
+  TBlob<float> blob(1, datum.channels(), crop, crop);
+  for (auto _ : state) {
+    transformer.Transform(datum, &blob);
+    benchmark::DoNotOptimize(blob.cpu_data());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TransformDatum)->Args({256, 227})->Args({256, 224})->Args({300, 300});
+
+// Arg: image size of the encoded JPEG
+static void BM_DecodeDatumToCVMat(benchmark::State& state) {
+  Datum datum;
+  MakeJpegDatum(state.range(0), &datum);
+  for (auto _ : state) {
+    cv::Mat img = DecodeDatumToCVMat(datum, true);
+    benchmark::DoNotOptimize(img.data);
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * datum.data().size());
+}
+BENCHMARK(BM_DecodeDatumToCVMat)->Arg(256)->Arg(300)->Arg(500);
+
+// Uncontended push/pop pair, the per-datum cost seen by a single reader
+static void BM_BlockingQueuePushPop(benchmark::State& state) {
+  BlockingQueue<shared_ptr<Datum>> queue;
+  shared_ptr<Datum> datum = make_shared<Datum>();
+  for (auto _ : state) {
+    queue.push(datum);
+    benchmark::DoNotOptimize(queue.pop());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BlockingQueuePushPop);
+
+// Arg: number of producer threads feeding a single consumer, the way
+// parallel DataReader solvers feed one transformer
+static void BM_BlockingQueueProducers(benchmark::State& state) {
+  const int producers = state.range(0);
+  const int per_producer = 10000;
+  shared_ptr<Datum> datum = make_shared<Datum>();
+  for (auto _ : state) {
+    BlockingQueue<shared_ptr<Datum>> queue;
+    vector<std::thread> threads;
+    for (int i = 0; i < producers; ++i) {
+      threads.emplace_back([&] {
+        for (int j = 0; j < per_producer; ++j) {
+          queue.push(datum);
+        }
+      });
+    }
+    for (int i = 0; i < producers * per_producer; ++i) {
+      benchmark::DoNotOptimize(queue.pop());
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * producers * per_producer);
+}
+BENCHMARK(BM_BlockingQueueProducers)->Arg(1)->Arg(4)->Arg(8)->UseRealTime();
+
+}  // namespace caffe
@@ -0,0 +1,14 @@
+// Entry point of the microbenchmark binary. Every bench_*.cpp registers its
+// benchmarks with BENCHMARK(); run with --benchmark_filter=<regex> to select.
+#include <benchmark/benchmark.h>
+
+#include "caffe/common.hpp"
+
+int main(int argc, char** argv) {
+  ::benchmark::Initialize(&argc, argv);
+  caffe::GlobalInit(&argc, &argv);
+  // All microbenchmarks measure host code
+  caffe::Caffe::set_mode(caffe::Caffe::CPU);
+  ::benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -0,0 +1,130 @@
+// im2col, BLAS wrappers and precision conversions on shapes taken from
+// AlexNet/CaffeNet, ResNet-50 and SSD300.
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/util/im2col.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+static void FillUniform(vector<float>* v) {
+  caffe_rng_uniform(static_cast<int>(v->size()), -1.F, 1.F, v->data());
+}
+
+// Args: channels, height, width, kernel, pad, stride
+static void BM_Im2col(benchmark::State& state) {
+  const int c = state.range(0), h = state.range(1), w = state.range(2);
+  const int k = state.range(3), pad = state.range(4), stride = state.range(5);
+  const int out_h = (h + 2 * pad - k) / stride + 1;
+  const int out_w = (w + 2 * pad - k) / stride + 1;
+  vector<float> im(c * h * w), col(c * k * k * out_h * out_w);
+  FillUniform(&im);
+  for (auto _ : state) {
+    im2col_cpu(im.data(), c, h, w, k, k, pad, pad, stride, stride, 1, 1, col.data());
+    benchmark::DoNotOptimize(col.data());
+  }
+  state.SetBytesProcessed(state.iterations() * col.size() * sizeof(float));
+}
+BENCHMARK(BM_Im2col)
+    ->Args({3, 227, 227, 11, 0, 4})    // CaffeNet conv1
+    ->Args({96, 27, 27, 5, 2, 1})      // CaffeNet conv2
+    ->Args({64, 56, 56, 3, 1, 1})      // ResNet-50 res2 3x3
+    ->Args({256, 14, 14, 3, 1, 1})     // ResNet-50 res4 3x3
+    ->Args({512, 38, 38, 3, 1, 1});    // SSD300 conv4_3 heads
+
+static void BM_Col2im(benchmark::State& state) {
+  const int c = state.range(0), h = state.range(1), w = state.range(2);
+  const int k = state.range(3), pad = state.range(4), stride = state.range(5);
+  const int out_h = (h + 2 * pad - k) / stride + 1;
+  const int out_w = (w + 2 * pad - k) / stride + 1;
+  vector<float> im(c * h * w), col(c * k * k * out_h * out_w);
+  FillUniform(&col);
+  for (auto _ : state) {
+    col2im_cpu(col.data(), c, h, w, k, k, pad, pad, stride, stride, 1, 1, im.data());
+    benchmark::DoNotOptimize(im.data());
+  }
+  state.SetBytesProcessed(state.iterations() * col.size() * sizeof(float));
+}
+BENCHMARK(BM_Col2im)
+    ->Args({96, 27, 27, 5, 2, 1})
+    ->Args({64, 56, 56, 3, 1, 1})
+    ->Args({256, 14, 14, 3, 1, 1});
+
+// Args: M, N, K of C = A * B as convolution and inner product layers use it
+static void BM_Gemm(benchmark::State& state) {
+  const int m = state.range(0), n = state.range(1), k = state.range(2);
+  vector<float> a(m * k), b(k * n), c(m * n);
+  FillUniform(&a);
+  FillUniform(&b);
+  for (auto _ : state) {
+    caffe_cpu_gemm<float>(CblasNoTrans, CblasNoTrans, m, n, k, 1.F, a.data(), b.data(),
+        0.F, c.data());
+    benchmark::DoNotOptimize(c.data());
+  }
+  state.counters["GFLOPS"] = benchmark::Counter(2. * m * n * k * state.iterations(),
+      benchmark::Counter::kIsRate, benchmark::Counter::kIs1000);
+}
+BENCHMARK(BM_Gemm)
+    ->Args({96, 3025, 363})      // CaffeNet conv1
+    ->Args({64, 3136, 576})      // ResNet-50 res2 3x3
+    ->Args({256, 196, 2304})     // ResNet-50 res4 3x3
+    ->Args({1, 4096, 9216})      // CaffeNet fc6, batch 1
+    ->Args({32, 4096, 4096})     // CaffeNet fc7, batch 32
+    ->Args({1000, 32, 2048});    // ResNet-50 fc1000, batch 32
+
+// Arg: N, sizes of typical parameter blobs updated by solvers
+static void BM_Axpby(benchmark::State& state) {
+  const int n = state.range(0);
+  vector<float> x(n), y(n);
+  FillUniform(&x);
+  FillUniform(&y);
+  for (auto _ : state) {
+    caffe_cpu_axpby<float>(n, 0.9F, x.data(), 0.1F, y.data());
+    benchmark::DoNotOptimize(y.data());
+  }
+  state.SetBytesProcessed(state.iterations() * n * 3L * sizeof(float));
+}
+BENCHMARK(BM_Axpby)->Arg(34848)->Arg(589824)->Arg(2359296)->Arg(37748736);
+
+static void BM_ConvertFloatToHalf(benchmark::State& state) {
+  const int n = state.range(0);
+  vector<float> in(n);
+  vector<float16> out(n);
+  FillUniform(&in);
+  for (auto _ : state) {
+    caffe_cpu_convert(n, in.data(), out.data());
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_ConvertFloatToHalf)->Arg(1 << 16)->Arg(1 << 22);
+
+static void BM_ConvertHalfToFloat(benchmark::State& state) {
+  const int n = state.range(0);
+  vector<float16> in(n, float16(0.5F));
+  vector<float> out(n);
+  for (auto _ : state) {
+    caffe_cpu_convert(n, in.data(), out.data());
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_ConvertHalfToFloat)->Arg(1 << 16)->Arg(1 << 22);
+
+// Tensor::convert through the Blob interface: every iteration writes FP32
+// data and reads it back as FP16, as mixed precision layers do
+static void BM_TensorConvertRoundTrip(benchmark::State& state) {
+  TBlob<float> blob(vector<int>{1, static_cast<int>(state.range(0))});
+  caffe_rng_uniform(blob.count(), -1.F, 1.F, blob.mutable_cpu_data());
+  for (auto _ : state) {
+    blob.mutable_cpu_data<float>();
+    benchmark::DoNotOptimize(blob.cpu_data<float16>());
+  }
+  state.SetItemsProcessed(state.iterations() * blob.count());
+}
+BENCHMARK(BM_TensorConvertRoundTrip)->Arg(1 << 16)->Arg(1 << 22);
+
+}  // namespace caffe
@@ -52,6 +52,7 @@ class BatchTransformer : public InternalThread {
  public:
   BatchTransformer(int target_device, size_t rank_, size_t queues_num,
       const TransformationParameter& transform_param, bool gpu_transform);
+  ~BatchTransformer() override;
 
   shared_ptr<Batch> prefetched_pop_free(size_t qid) {
     return this->prefetches_free_[qid]->pop();
@@ -97,11 +98,13 @@ class BatchTransformer : public InternalThread {
   }
 
   void resize(bool skip_to_next);
+  void RegisterMetrics(size_t rank);
 
  private:
   BBQ processed_full_;
   BBQ processed_free_;
   TBlob<Btype> tmp_;
+  vector<int> metric_callbacks_;
 };
 
 }
@@ -92,6 +92,31 @@ class Blob {
     ReshapeLike(&other);
   }
 
+  /**
+   * @brief Data and diff memory of the blob at its current shape.
+   *
+   * Net keeps one per input shape, see NetParameter::reshape_cache_size.
+   * Restoring it brings back the tensors at that shape's count, so the
+   * Reshape calls that follow allocate nothing.
+   */
+  struct MemoryState {
+    vector<int> shape;
+    int count;
+    shared_ptr<Tensor> data_tensor, diff_tensor;
+    Type data_type, diff_type;
+    int data_count, diff_count;
+    vector<shared_ptr<SyncedMemory>> data_arrays, diff_arrays;
+    const Blob* data_shared_with;
+    const Blob* diff_shared_with;
+  };
+  void SaveMemory(MemoryState* state) const;
+  void RestoreMemory(const MemoryState& state);
+  // Whether any of data and diff is the same tensor as any of other's
+  bool SharesTensorWith(const Blob& other) const {
+    return data_tensor_ == other.data_tensor_ || data_tensor_ == other.diff_tensor_ ||
+        diff_tensor_ == other.data_tensor_ || diff_tensor_ == other.diff_tensor_;
+  }
+
   Type data_type() const {
     return data_tensor_->type();
   }
@@ -495,9 +520,23 @@ class Blob {
     return diff_tensor_->is_gpu_head();
   }
 
+  // Identifies the data storage, which ShareData and Swap replace
+  const Tensor* data_tensor() const {
+    return data_tensor_.get();
+  }
+
   size_t gpu_memory_data_use(bool own_only = false) const;
   size_t gpu_memory_diff_use(bool own_only = false) const;
 
+  // Binds count() elements of external host memory of the current data type
+  // without conversion or copy. The owner is released when the memory gets
+  // rebound or reallocated (e.g. by Reshape to a different count).
+  void bind_cpu_data(void* data, const shared_ptr<void>& owner) {
+    CHECK_NOTNULL(data);
+    ensure_data_count();
+    data_tensor_->mutable_synced_mem()->set_cpu_data(data, owner);
+  }
+
   void set_gpu_data(void* data) {
     CHECK_NOTNULL(data);
     ensure_data_count();
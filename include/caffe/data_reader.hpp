@@ -29,6 +29,8 @@ class DataReader : public InternalThread {
   class CursorManager {
     db::DB* db_;
     unique_ptr<db::Cursor> cursor_;
+    // Lets the cursor jump over records of other parser threads and solvers
+    shared_ptr<db::KeyIndex> key_index_;
     DataReader* reader_;
     const size_t solver_count_, solver_rank_, batch_size_;
     const size_t parser_threads_, parser_thread_id_;
@@ -38,6 +40,10 @@ class DataReader : public InternalThread {
     bool cached_all_;
     size_t epoch_count_;
     const bool epoch_count_required_;
+    // Detected on the first record, a DB doesn't mix formats
+    enum class Format { UNKNOWN, DATUM, C2 } format_;
+    // Reused, its buffers are swapped with the ones of fetched Datums
+    C2TensorProtos c2_protos_;
 
    public:
     CursorManager(db::DB* db, DataReader* reader, size_t solver_count,
@@ -166,6 +172,8 @@ class DataReader : public InternalThread {
  protected:
   void InternalThreadEntry() override;
   void InternalThreadEntryN(size_t thread_id) override;
+  // Queue depths and time the consumers spend waiting for data
+  void RegisterMetrics(const LayerParameter& param);
 
   const size_t parser_threads_num_, transf_threads_num_;
   const size_t queues_num_, queue_depth_;
@@ -188,6 +196,7 @@ class DataReader : public InternalThread {
   const bool cache_, shuffle_;
   const bool epoch_count_required_;
   std::atomic_int cursors_cached_;
+  vector<int> metric_callbacks_;
 
   DataCache* data_cache_;
   static std::mutex db_mutex_;
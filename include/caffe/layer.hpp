@@ -274,6 +274,16 @@ class LayerBase {
    */
   virtual float Forward(const vector<Blob*>& bottom, const vector<Blob*>& top) = 0;
 
+  /**
+   * @brief Forward step of a compiled plan, see Net::Compile.
+   *
+   * Runs Forward_gpu or Forward_cpu, as chosen at compile time, without
+   * the lock, the Reshape and the loss of Forward: tops are expected to be
+   * shaped for the bottoms already.
+   */
+  virtual void ForwardPlanned(const vector<Blob*>& bottom, const vector<Blob*>& top,
+      bool gpu) = 0;
+
   /**
    * @brief Given the top blob error gradients, compute the bottom blob error
    *        gradients.
@@ -487,6 +497,9 @@ class Layer : public LayerBase {
 
   virtual float Forward(const vector<Blob*>& bottom, const vector<Blob*>& top);
 
+  void ForwardPlanned(const vector<Blob*>& bottom, const vector<Blob*>& top,
+      bool gpu) override;
+
   virtual void Backward(const vector<Blob*>& top, const vector<bool>& propagate_down,
       const vector<Blob*>& bottom);
 
@@ -609,6 +622,17 @@ inline float Layer<Ftype, Btype>::Forward(const vector<Blob*>& bottom, const vec
   return lloss;
 }
 
+template<typename Ftype, typename Btype>
+inline void
+Layer<Ftype, Btype>::ForwardPlanned(const vector<Blob*>& bottom, const vector<Blob*>& top,
+    bool gpu) {
+  if (gpu) {
+    Forward_gpu(bottom, top);
+  } else {
+    Forward_cpu(bottom, top);
+  }
+}
+
 template<typename Ftype, typename Btype>
 inline void
 Layer<Ftype, Btype>::Backward(const vector<Blob*>& top, const vector<bool>& propagate_down,
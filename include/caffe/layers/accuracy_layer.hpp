@@ -1,6 +1,8 @@
 #ifndef CAFFE_ACCURACY_LAYER_HPP_
 #define CAFFE_ACCURACY_LAYER_HPP_
 
+#include <cstdint>
+#include <unordered_map>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -25,9 +27,13 @@ class AccuracyLayer : public Layer<Ftype, Btype> {
    *     Sets the maximum rank @f$ k @f$ at which a prediction is considered
    *     correct.  For example, if @f$ k = 5 @f$, a prediction is counted
    *     correct if the correct label is among the top 5 predicted labels.
+   *   - confusion_iters (\b optional, default 0).
+   *     If positive, the confusion matrix of the top-1 predictions and
+   *     per-class precision and recall are accumulated over this many
+   *     forward passes, then logged (and written to confusion_file) and reset.
    */
   explicit AccuracyLayer(const LayerParameter& param)
-      : Layer<Ftype, Btype>(param) {}
+      : Layer<Ftype, Btype>(param), confusion_iters_(0), confusion_forwards_(0) {}
   void LayerSetUp(const vector<Blob*>& bottom, const vector<Blob*>& top) override;
   void Reshape(const vector<Blob*>& bottom, const vector<Blob*>& top) override;
 
@@ -77,6 +83,17 @@ class AccuracyLayer : public Layer<Ftype, Btype> {
   void Backward_gpu(const vector<Blob*>& top,
       const vector<bool>& propagate_down, const vector<Blob*>& bottom) override;
 
+  // Accuracy counts of a range of samples, merged after the parallel scan
+  struct Counts {
+    int valid = 0;
+    int correct = 0;
+    vector<int> labels, hits, predictions;  // per class
+    std::unordered_map<int64_t, int64_t> confusions;  // off-diagonal only
+  };
+  void Count(const Ftype* bottom_data, const Ftype* bottom_label, int num_labels,
+      int outer_begin, int outer_end, Counts* counts) const;
+  void ReportConfusion();
+
   int label_axis_, outer_num_, inner_num_;
   int top_k_;
   /// Whether to ignore instances with a certain label.
@@ -85,6 +102,10 @@ class AccuracyLayer : public Layer<Ftype, Btype> {
   int ignore_label_;
   /// Keeps counts of the number of samples per class.
   TBlob<float> nums_buffer_;
+  /// Confusion matrix state accumulated over confusion_iters_ forward passes,
+  /// keyed by label * num_labels + prediction.
+  int confusion_iters_, confusion_forwards_;
+  Counts confusion_;
 };
 
 }  // namespace caffe
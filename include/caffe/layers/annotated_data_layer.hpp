@@ -3,6 +3,7 @@
 
 #include <string>
 #include <map>
+#include <mutex>
 #include <vector>
 #include <atomic>
 
@@ -14,6 +15,7 @@
 #include "caffe/layers/data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/db.hpp"
+#include "caffe/util/sampler.hpp"
 
 namespace caffe {
 
@@ -40,11 +42,21 @@ class AnnotatedDataLayer : public DataLayer<Ftype, Btype> {
     areader_->start_reading();
   }
 
+  // Accumulates acceptance statistics of batch_samplers_ over the prefetch
+  // threads, exports them and logs them at 10^3, 10^4... sampled images.
+  void UpdateSamplerStats(const vector<SamplerStats>& batch_stats, size_t images);
+
   std::shared_ptr<DataReader<AnnotatedDatum>> sample_areader_, areader_;
   bool has_anno_type_;
   AnnotatedDatum_AnnotationType anno_type_;
   vector<BatchSampler> batch_samplers_;
   string label_map_file_;
+
+  std::mutex sampler_stats_mutex_;
+  vector<SamplerStats> sampler_stats_;
+  size_t sampled_images_;
+  size_t sampler_stats_report_at_;
+  vector<Metric*> sampler_trials_metrics_, sampler_accepted_metrics_;
 };
 
 }  // namespace caffe
@@ -24,6 +24,13 @@ namespace caffe {
  *   parameters, but they take the opposite sense as in ConvolutionLayer (so
  *   padding is removed from the output rather than added to the input, and
  *   stride results in upsampling rather than downsampling).
+ *
+ *   On the CPU, 2-D layers with few input channels per group (the usual
+ *   FCN-style upsampling, typically depthwise with fixed bilinear weights)
+ *   skip the GEMM + col2im scatter: every output channel is accumulated
+ *   directly from its input planes, in parallel over output channels and
+ *   without a column buffer. Depthwise filters that factor into a row and
+ *   a column kernel, like bilinear ones, run as two 1-D passes.
  */
 template <typename Ftype, typename Btype>
 class DeconvolutionLayer : public BaseConvolutionLayer<Ftype, Btype> {
@@ -44,6 +51,12 @@ class DeconvolutionLayer : public BaseConvolutionLayer<Ftype, Btype> {
       const vector<bool>& propagate_down, const vector<Blob*>& bottom);
   virtual inline bool reverse_dimensions() { return true; }
   virtual void compute_output_shape();
+
+ private:
+  // Whether Forward_cpu bypasses GEMM + col2im
+  bool direct_forward_cpu() const;
+  void ForwardDirect_cpu(const Ftype* bottom_data, const Ftype* weight,
+      const Ftype* bias, Ftype* top_data);
 };
 
 }  // namespace caffe
@@ -4,6 +4,7 @@
 #include <opencv2/core/core.hpp>
 #include <opencv2/opencv.hpp>
 
+#include <functional>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -89,6 +90,14 @@ class DetectNetTransformationLayer : public Layer<Dtype, Dtype> {
 
   AugmentSelection get_augmentations(cv::Size);
 
+  /**
+   * @brief Calls fn(0), ..., fn(image_count - 1) on up to
+   * DetectNetAugmentationParameter::transform_threads threads.
+   * fn must only write the outputs of its own image.
+   */
+  void for_each_image(int image_count,
+      const std::function<void(int)>& fn) const;
+
   // Image transformations
   Mat3v transform_image_cpu(const Mat3v&, const AugmentSelection&);
   Mat3v transform_hsv_cpu(const Mat3v&, const AugmentSelection&);
@@ -1,6 +1,7 @@
 #ifndef CAFFE_IMAGE_DATA_LAYER_HPP_
 #define CAFFE_IMAGE_DATA_LAYER_HPP_
 
+#include <map>
 #include <string>
 #include <utility>
 #include <vector>
@@ -11,6 +12,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/read_ahead.hpp"
 
 namespace caffe {
 
@@ -42,6 +44,9 @@ class ImageDataLayer : public BasePrefetchingDataLayer<Ftype, Btype> {
  protected:
   void ShuffleImages();
   bool load_batch(Batch* batch, int thread_id, size_t queue_id = 0UL) override;
+  bool load_bucketed_batch(Batch* batch, int thread_id);
+  void count_cached(bool loaded, size_t lines_size);
+  void next_line(int thread_id);
   void start_reading() override {}
   void InitializePrefetch() override;
 
@@ -55,16 +60,22 @@ class ImageDataLayer : public BasePrefetchingDataLayer<Ftype, Btype> {
 
   cv::Mat next_mat(const string& root_folder, const string& filename, int height, int width,
                    bool is_color, int short_side, bool& from_cache);
+  // Schedules asynchronous reads of lines [first, first + count * step) mod size
+  void read_ahead(size_t first, size_t step, size_t count);
 
   const size_t id_;  // per layer per phase
   shared_ptr<Caffe::RNG> prefetch_rng_;
   Flag layer_inititialized_flag_;
   size_t epoch_count_;
   vector<size_t> line_ids_;
+  unique_ptr<FileReadAhead> read_ahead_;
+  // Per thread: images and labels waiting for their bucket to fill up, by rounded size
+  typedef std::map<std::pair<int, int>, vector<std::pair<cv::Mat, int>>> Buckets;
+  vector<Buckets> buckets_;
+  vector<size_t> bucketed_num_;
 
   static vector<vector<std::pair<std::string, int>>> lines_;  // per id_
-  static vector<unordered_map<std::string, cv::Mat>> cache_;
-  static vector<std::mutex> cache_mutex_;
+  // First pass over the list is done, i.e. every image was offered to ImageCache
   static vector<bool> cached_;
   static vector<size_t> cached_num_, failed_num_;
   static vector<float> cache_progress_;
@@ -75,16 +86,12 @@ class ImageDataLayer : public BasePrefetchingDataLayer<Ftype, Btype> {
 template <typename Ftype, typename Btype>
 vector<vector<std::pair<std::string, int>>> ImageDataLayer<Ftype, Btype>::lines_(MAX_IDL_CACHEABLE);
 template <typename Ftype, typename Btype>
-vector<unordered_map<std::string, cv::Mat>> ImageDataLayer<Ftype, Btype>::cache_(MAX_IDL_CACHEABLE);
-template <typename Ftype, typename Btype>
 vector<bool> ImageDataLayer<Ftype, Btype>::cached_(MAX_IDL_CACHEABLE);
 template <typename Ftype, typename Btype>
 vector<size_t> ImageDataLayer<Ftype, Btype>::cached_num_(MAX_IDL_CACHEABLE);
 template <typename Ftype, typename Btype>
 vector<size_t> ImageDataLayer<Ftype, Btype>::failed_num_(MAX_IDL_CACHEABLE);
 template <typename Ftype, typename Btype>
-vector<std::mutex> ImageDataLayer<Ftype, Btype>::cache_mutex_(MAX_IDL_CACHEABLE);
-template <typename Ftype, typename Btype>
 vector<float> ImageDataLayer<Ftype, Btype>::cache_progress_(MAX_IDL_CACHEABLE);
 
 }  // namespace caffe
@@ -4,7 +4,10 @@
 #include <boost/python.hpp>
 #include <vector>
 
+#include "caffe/batch_transformer.hpp"
+#include "caffe/internal_thread.hpp"
 #include "caffe/layer.hpp"
+#include "caffe/util/blocking_queue.hpp"
 
 namespace bp = boost::python;
 
@@ -39,6 +42,34 @@ inline void PyErrFatal() {
 }
 void PyErrReportAndForward();
 
+/**
+ * @brief Runs `reshape` and `forward` of a Python data layer in a background
+ *        thread, filling a ring of batches the layer swaps into its tops.
+ */
+class PythonPrefetcher : public InternalThread {
+ public:
+  PythonPrefetcher(const bp::object& layer, size_t batches, Type dtype, size_t tops);
+  ~PythonPrefetcher() override;
+
+  shared_ptr<Batch> full_pop() {
+    return full_.pop("Waiting for Python layer data");
+  }
+  void free_push(const shared_ptr<Batch>& batch) {
+    free_.push(batch);
+  }
+
+ protected:
+  void InternalThreadEntry() override;
+
+ private:
+  bp::object layer_;
+  const size_t tops_;
+  BlockingQueue<shared_ptr<Batch>> free_;
+  BlockingQueue<shared_ptr<Batch>> full_;
+
+  DISABLE_COPY_MOVE_AND_ASSIGN(PythonPrefetcher);
+};
+
 template <typename Ftype, typename Btype>
 class PythonLayer : public Layer<Ftype, Btype> {
  public:
@@ -55,9 +86,21 @@ class PythonLayer : public Layer<Ftype, Btype> {
     } catch (...) {
       PyErrFatal();
     }
+    const size_t prefetch = this->layer_param_.python_param().prefetch();
+    if (prefetch > 0UL) {
+      CHECK(bottom.empty()) << "Prefetching Python layer " << this->name()
+                            << " can't have bottoms";
+      CHECK(top.size() == 1UL || top.size() == 2UL) << "Prefetching Python layer "
+          << this->name() << " must have one or two tops";
+      prefetcher_.reset(new PythonPrefetcher(self_, prefetch, tp<Ftype>(), top.size()));
+    }
   }
 
   void Reshape(const vector<Blob*>& bottom, const vector<Blob*>& top) override {
+    // Prefetched batches come shaped, tops are reshaped by the swap
+    if (prefetcher_ && prefetcher_->is_started()) {
+      return;
+    }
     try {
       PyGILAquire pgil;
       self_.attr("reshape")(bottom, top);
@@ -66,6 +109,10 @@ class PythonLayer : public Layer<Ftype, Btype> {
     } catch (...) {
       PyErrFatal();
     }
+    // Tops got their initial shapes for the layers below, start filling
+    if (prefetcher_) {
+      prefetcher_->StartInternalThread();
+    }
   }
 
   inline bool ShareInParallel() const override {
@@ -76,6 +123,15 @@ class PythonLayer : public Layer<Ftype, Btype> {
 
  protected:
   void Forward_cpu(const vector<Blob*>& bottom, const vector<Blob*>& top) override {
+    if (prefetcher_) {
+      shared_ptr<Batch> batch = prefetcher_->full_pop();
+      top[0]->Swap(*batch->data_);
+      if (top.size() > 1UL) {
+        top[1]->Swap(*batch->label_);
+      }
+      prefetcher_->free_push(batch);
+      return;
+    }
     try {
       PyGILAquire pgil;
       self_.attr("forward")(bottom, top);
@@ -100,6 +156,7 @@ class PythonLayer : public Layer<Ftype, Btype> {
 
  private:
   bp::object self_;
+  unique_ptr<PythonPrefetcher> prefetcher_;
 };
 
 }  // namespace caffe
@@ -17,13 +17,16 @@
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/db.hpp"
+#include "caffe/video_reader.hpp"
 
 namespace caffe {
 
 /**
  * @brief Provides data to the Net from webcam or video files.
  *
- * TODO(weiliu89): thorough documentation for Forward and proto params.
+ * Frames are decoded by VideoReader threads, without seeking, and come in
+ * clips of clip_length consecutive sampled frames, every skip_frames + 1-th
+ * frame of a source. Labels are the ones of video_list, 0 otherwise.
  */
 template <typename Ftype, typename Btype>
 class VideoDataLayer : public BasePrefetchingDataLayer<Ftype, Btype> {
@@ -41,13 +44,7 @@ class VideoDataLayer : public BasePrefetchingDataLayer<Ftype, Btype> {
   bool load_batch(Batch* batch, int thread_id, size_t queue_id) override;
   void start_reading() override {}
 
-  VideoDataParameter_VideoType video_type_;
-  cv::VideoCapture cap_;
-
-  int skip_frames_;
-
-  int total_frames_;
-  int processed_frames_;
+  unique_ptr<VideoReader> reader_;
   vector<int> top_shape_;
 };
 
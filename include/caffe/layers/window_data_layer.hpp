@@ -11,6 +11,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -35,6 +36,11 @@ class WindowDataLayer : public BasePrefetchingDataLayer<Ftype, Btype> {
  protected:
   unsigned int PrefetchRand();
   bool load_batch(Batch* batch, int thread_id, size_t queue_id = 0UL) override;
+  // Decoded image, from the image cache if enabled. Called concurrently.
+  cv::Mat LoadImage(int image_index) const;
+  // Crops, warps and mean subtracts one window into its slot of the batch
+  void WarpWindow(const cv::Mat& cv_img, const vector<float>& window, bool do_mirror,
+      const Ftype* mean, Ftype* top_data) const;
   void start_reading() override {}
 
   shared_ptr<Caffe::RNG> prefetch_rng_;
@@ -49,6 +55,8 @@ class WindowDataLayer : public BasePrefetchingDataLayer<Ftype, Btype> {
   bool cache_images_;
   vector<std::pair<std::string, Datum > > image_database_cache_;
   vector<int> data_shape_, label_shape_;
+  // Per prefetch thread, crop_threads - 1 workers kept across batches
+  vector<unique_ptr<ThreadPool>> crop_pools_;
 };
 
 }  // namespace caffe
@@ -2,6 +2,7 @@
 #define CAFFE_NET_HPP_
 
 #include <atomic>
+#include <list>
 #include <map>
 #include <set>
 #include <string>
@@ -20,6 +21,7 @@
 
 namespace caffe {
 
+class Metric;
 class Solver;
 
 /**
@@ -45,6 +47,18 @@ class Net {
       bool inner_net = false,
       int level = 0,
       const vector<string>* stages = NULL);
+
+  /// @brief Path of a frozen net written by 'caffe freeze'.
+  struct FrozenFile {
+    explicit FrozenFile(const string& path) : path(path) {}
+    string path;
+  };
+  /**
+   * @brief Loads a frozen net: a binary definition already upgraded, filtered
+   *        and split, holding its weights. Skips the text parsing, the
+   *        definition passes and the separate weights file of a cold start.
+   */
+  explicit Net(const FrozenFile& frozen_file, size_t solver_rank = 0U);
   ~Net();
 
   /// @brief Initialize a network with a NetParameter.
@@ -71,6 +85,33 @@ class Net {
   /// @brief DEPRECATED; set input blobs then use Forward() instead.
   const vector<Blob*>& Forward(const vector<Blob*> & bottom, float *loss = nullptr);
 
+  /**
+   * @brief Reshapes a TEST net for its current inputs and compiles it into a
+   *        flat forward plan.
+   *
+   * A step per layer with the blob vectors and the device (CPU, GPU or
+   * enforced CPU) resolved once. ForwardCompiled runs the steps without
+   * the per-layer lock and Reshape, the mode branching and the timing and
+   * debug bookkeeping of ForwardFromTo. Loss layers keep the regular
+   * Forward.
+   */
+  void Compile();
+  /**
+   * @brief Runs the compiled plan, recompiling first if the input shapes or
+   *        the mode changed since the last Compile.
+   *
+   * If a step's output shape depends on its input data and changes, every
+   * later step goes back to the regular Forward, with its Reshape, until
+   * the next Compile. A step whose bottom storage was replaced, e.g. by a
+   * prefetching data layer swapping in its next batch, runs the regular
+   * Forward once, so that layers aliasing their bottom (Reshape, Flatten,
+   * Split) share the new storage.
+   */
+  const vector<Blob*>& ForwardCompiled();
+  bool compiled() const {
+    return !plan_.empty();
+  }
+
   /**
    * @brief Zeroes out the diffs of all net parameters.
    *        Should be run before Backward.
@@ -127,6 +168,8 @@ class Net {
   void CopyTrainedLayersFromHDF5(const string trained_filename);
   /// @brief Writes the net to a proto.
   void ToProto(NetParameter* param, bool write_diff = false) const;
+  /// @brief Writes the net with its weights as a frozen definition, see FrozenFile.
+  void ToFrozenProto(NetParameter* param) const;
   /// @brief Writes the net to an HDF5 file.
   void ToHDF5(const string& filename, bool write_diff = false) const;
 
@@ -326,8 +369,12 @@ class Net {
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
 
+  /// @brief Brings back the blob memory kept for the current input shapes.
+  void SwitchReshapeCache();
   /// @brief Helper for displaying debug info in Forward.
   void ForwardDebugInfo(const int layer_id);
+  /// @brief Lazily creates per-layer timing series of the metrics registry.
+  void InitLayerMetrics();
   /// @brief Helper for displaying debug info in Backward.
   void BackwardDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Update.
@@ -433,6 +480,31 @@ class Net {
   NetParameter net_param_;
 
   size_t infer_count_;
+  /// A layer of the compiled forward plan
+  struct PlanStep {
+    LayerBase* layer;
+    const vector<Blob*>* bottom;
+    const vector<Blob*>* top;
+    bool gpu;
+    // Runs LayerBase::Forward: loss layers and layers after a data
+    // dependent reshape
+    bool regular;
+    vector<vector<int>> top_shapes;
+    vector<const Tensor*> bottom_tensors;
+  };
+  vector<PlanStep> plan_;
+  vector<vector<int>> plan_input_shapes_;
+  Caffe::Brew plan_mode_;
+  /// Blob memory kept for an input shape, see NetParameter::reshape_cache_size
+  struct ReshapeCacheEntry {
+    vector<vector<int>> input_shapes;
+    vector<Blob::MemoryState> blobs;
+  };
+  // Most recently used first, the front one is what blobs are shaped for
+  std::list<ReshapeCacheEntry> reshape_cache_;
+  size_t reshape_cache_size_;
+  /// Per-layer time series, see Metrics::layer_timing()
+  vector<Metric*> layer_forward_metrics_, layer_backward_metrics_;
   float wgrad_max_, global_grad_scale_coeff_, global_grad_scale_param_;
   bool global_grad_scale_adaptive_;
   /// Inner net runs on singe GPU (see recurrent layers)
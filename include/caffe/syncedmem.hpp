@@ -26,6 +26,9 @@ class SyncedMemory {
   const void* cpu_data();
   const void* gpu_data(int group = 0);
   void set_cpu_data(void* data);
+  // Uses external host memory kept alive by owner until the memory is
+  // rebound or this object is destroyed.
+  void set_cpu_data(void* data, const shared_ptr<void>& owner);
   void set_gpu_data(void* data);
   void* mutable_cpu_data(bool copy_from_gpu = true, int group = 0);
   void* mutable_gpu_data(bool copy_from_cpu = true, int group = 0);
@@ -74,6 +77,7 @@ class SyncedMemory {
   int  device_;
   bool valid_;
   shared_ptr<CudaStream> pstream_;
+  shared_ptr<void> cpu_owner_;
 
   DISABLE_COPY_MOVE_AND_ASSIGN(SyncedMemory);
 };  // class SyncedMemory
@@ -8,6 +8,8 @@
 
 namespace caffe {
 
+class Metric;
+
 template<typename T>
 class BlockingQueue {
  public:
@@ -29,10 +31,16 @@ class BlockingQueue {
   size_t size() const;
   bool nonblocking_size(size_t* size) const;
 
+  // Seconds spent blocked in pop() are added to this counter
+  void set_wait_metric(Metric* metric) {
+    wait_metric_ = metric;
+  }
+
  protected:
   std::queue<T> queue_;
   mutable boost::mutex mutex_;
   boost::condition_variable condition_;
+  Metric* wait_metric_;
 
   DISABLE_COPY_MOVE_AND_ASSIGN(BlockingQueue);
 };
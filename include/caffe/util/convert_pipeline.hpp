@@ -0,0 +1,78 @@
+#ifndef CAFFE_UTIL_CONVERT_PIPELINE_HPP_
+#define CAFFE_UTIL_CONVERT_PIPELINE_HPP_
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/db.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Pipelined writer used by the dataset converters.
+ *
+ * A pool of reader threads runs the user supplied encoder (read, decode,
+ * resize, re-encode, serialize) for items 0..N-1 in parallel while a single
+ * writer thread puts the results into the DB strictly in item order and
+ * commits every commit_interval records. At most queue_depth encoded records
+ * are held in memory at any time. When keys are produced in increasing order
+ * (the converters use zero-padded sequential prefixes) the writer uses the
+ * backend's append transaction, e.g. LMDB MDB_APPEND.
+ */
+class ConvertPipeline {
+ public:
+  // Produces the key and serialized value of item index.
+  // Returns false if the item has to be skipped. Called concurrently.
+  typedef std::function<bool(size_t index, string* key, string* value)> Encoder;
+
+  ConvertPipeline(db::DB* db, int num_threads, size_t queue_depth,
+      size_t commit_interval, bool sorted_keys);
+
+  // Runs the pipeline over num_items items, returns the number of records
+  // written to the DB.
+  size_t Run(size_t num_items, const Encoder& encoder);
+
+  static int default_threads();
+
+ private:
+  struct Slot {
+    Slot() : ready(false), ok(false) {}
+    string key;
+    string value;
+    bool ready;
+    bool ok;
+  };
+
+  void ReaderEntry(const Encoder& encoder);
+  void WriterEntry();
+  void ReportProgress(bool last);
+
+  db::DB* db_;
+  const int num_threads_;
+  const size_t queue_depth_;
+  const size_t commit_interval_;
+  const bool sorted_keys_;
+
+  size_t num_items_;
+  size_t next_item_;  // next item to be claimed by a reader
+  size_t written_;    // items consumed by the writer so far
+  size_t records_;    // records actually put into the DB
+  size_t bytes_;
+  vector<Slot> slots_;
+  std::mutex mutex_;
+  std::condition_variable slot_free_;
+  std::condition_variable slot_ready_;
+
+  std::chrono::steady_clock::time_point start_;
+
+  DISABLE_COPY_MOVE_AND_ASSIGN(ConvertPipeline);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_CONVERT_PIPELINE_HPP_
@@ -1,7 +1,9 @@
 #ifndef CAFFE_UTIL_DB_HPP
 #define CAFFE_UTIL_DB_HPP
 
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include "caffe/common.hpp"
 #include "caffe/proto/caffe.pb.h"
@@ -15,6 +17,8 @@ class Cursor {
   Cursor() { }
   virtual ~Cursor() { }
   virtual void SeekToFirst() = 0;
+  // Positions the cursor at the first record with key >= key
+  virtual void SeekToKey(const string& key) = 0;
   virtual void Next() = 0;
   virtual string key() const = 0;
   virtual string value() const = 0;
@@ -28,6 +32,8 @@ class Cursor {
   DISABLE_COPY_MOVE_AND_ASSIGN(Cursor);
 };
 
+// Records put become visible on Commit, all of them or none unless the
+// transaction comes from DB::NewAppendTransaction.
 class Transaction {
  public:
   Transaction() { }
@@ -46,6 +52,11 @@ class DB {
   virtual void Close() = 0;
   virtual Cursor* NewCursor() = 0;
   virtual Transaction* NewTransaction() = 0;
+  // Transaction for keys put in strictly increasing order. Backends may use
+  // it to skip the ordered insert (LMDB: MDB_APPEND) and to commit records
+  // before Commit to bound memory (LMDB: checkpoints): after a crash the DB
+  // may hold a prefix of the records put.
+  virtual Transaction* NewAppendTransaction() { return NewTransaction(); }
 
   DISABLE_COPY_MOVE_AND_ASSIGN(DB);
 };
@@ -53,6 +64,36 @@ class DB {
 DB* GetDB(DataParameter::DB backend);
 DB* GetDB(const string& backend);
 
+/**
+ * @brief Every stride-th key of a DB in iteration order.
+ *
+ * Lets a cursor jump to the record at any position with one SeekToKey and
+ * at most stride - 1 Next calls instead of walking there from the first
+ * record. Built with a single key scan and shared by everybody asking for
+ * the same source and stride while at least one of them holds it.
+ */
+class KeyIndex {
+ public:
+  static shared_ptr<KeyIndex> Get(DB* db, const string& source, size_t stride);
+
+  size_t records() const {
+    return records_;
+  }
+  // Positions the cursor at the record at pos % records()
+  void Seek(Cursor* cursor, size_t pos) const;
+
+  KeyIndex(DB* db, size_t stride);
+
+ private:
+  const size_t stride_;
+  size_t records_;
+  vector<string> keys_;
+
+  static std::mutex mutex_;
+
+  DISABLE_COPY_MOVE_AND_ASSIGN(KeyIndex);
+};
+
 }  // namespace db
 }  // namespace caffe
 
@@ -17,6 +17,7 @@ class LevelDBCursor : public Cursor {
     : iter_(iter) { SeekToFirst(); }
   ~LevelDBCursor() { delete iter_; }
   void SeekToFirst() override { iter_->SeekToFirst(); }
+  void SeekToKey(const string& key) override { iter_->Seek(key); }
   void Next() override { iter_->Next(); }
   string key() const override { return iter_->key().ToString(); }
   string value() const override { return iter_->value().ToString(); }
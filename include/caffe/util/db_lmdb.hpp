@@ -27,6 +27,11 @@ class LMDBCursor : public Cursor {
     mdb_txn_abort(mdb_txn_);
   }
   void SeekToFirst() override { Seek(MDB_FIRST); }
+  void SeekToKey(const string& key) override {
+    mdb_key_.mv_size = key.size();
+    mdb_key_.mv_data = const_cast<char*>(key.data());
+    Seek(MDB_SET_RANGE);
+  }
   void Next() override { Seek(MDB_NEXT); }
   string key() const override {
     return string(static_cast<const char*>(mdb_key_.mv_data), mdb_key_.mv_size);
@@ -70,18 +75,46 @@ class LMDBCursor : public Cursor {
   bool valid_;
 };
 
+// Streaming write transaction. Put goes straight into an open MDB write
+// transaction instead of being buffered until Commit. The map is grown ahead
+// of time using the footprint of records seen so far.
+// With checkpoints (append transactions only) the open transaction is
+// committed and reopened whenever the map would not fit the next record or
+// kCheckpointBytes have been written, so records become visible before
+// Commit. Otherwise the map is grown by restarting the transaction and
+// Commit stays all-or-nothing. Records put since the last checkpoint are
+// kept in memory, so that they can be replayed into a restarted transaction.
 class LMDBTransaction : public Transaction {
  public:
-  explicit LMDBTransaction(MDB_env* mdb_env)
-    : mdb_env_(mdb_env) { }
+  explicit LMDBTransaction(MDB_env* mdb_env, unsigned int put_flags = 0U,
+      bool checkpoints = false);
+  virtual ~LMDBTransaction();
   virtual void Put(const string& key, const string& value);
   virtual void Commit();
 
  private:
-  MDB_env* mdb_env_;
-  vector<string> keys, values;
+  void Begin(size_t need, bool grow);
+  void Checkpoint();
+  bool TryPut(const string& key, const string& value);
+  void Regrow(const string& key, const string& value, size_t footprint);
+  size_t Footprint(size_t key_size, size_t value_size) const;
+
+  static constexpr size_t kCheckpointBytes = 64UL << 20;
+  static constexpr size_t kGrowRecords = 1024UL;
+  static constexpr size_t kReservePages = 64UL;
 
-  void DoubleMapSize();
+  MDB_env* mdb_env_;
+  const unsigned int put_flags_;
+  const bool checkpoints_;
+  MDB_txn* mdb_txn_;
+  MDB_dbi mdb_dbi_;
+  size_t page_size_;
+  size_t free_bytes_;    // map space available when the txn began
+  size_t txn_bytes_;     // estimated map space used by the open txn
+  size_t records_;       // records put through this transaction
+  size_t record_bytes_;  // their estimated footprint
+  vector<pair<string, string>> replay_;
+  size_t replay_bytes_;
 
   DISABLE_COPY_MOVE_AND_ASSIGN(LMDBTransaction);
 };
@@ -100,6 +133,7 @@ class LMDB : public DB {
   }
   virtual LMDBCursor* NewCursor();
   virtual LMDBTransaction* NewTransaction();
+  virtual LMDBTransaction* NewAppendTransaction();
 
  private:
   MDB_env* mdb_env_;
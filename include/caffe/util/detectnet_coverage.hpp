@@ -1,8 +1,6 @@
 #ifndef DETECTNET_COVERAGE_HPP
 #define DETECTNET_COVERAGE_HPP
 
-#include <boost/ref.hpp>
-
 #include <opencv2/core/core.hpp>
 #include <opencv2/opencv.hpp>
 
@@ -49,35 +47,6 @@ struct BboxLabel_ {
   Point3v location;
 };
 
-template <typename Dtype>
-class TransformedLabel_ {
- public:
-  typedef boost::reference_wrapper<Dtype> reference_wrapper_dtype;
-
-  // foreground:
-  Dtype& foreground;
-  // top left corner:
-  Dtype& topLeft_x;
-  Dtype& topLeft_y;
-  // bottom right corner:
-  Dtype& bottomRight_x;
-  Dtype& bottomRight_y;
-  // inverse size:
-  Dtype& dimension_w;
-  Dtype& dimension_h;
-  // obj_norm:
-  Dtype& obj_norm;
-  // coverage classes:
-  vector<reference_wrapper_dtype> coverages;
-
-  TransformedLabel_(
-      const CoverageGenerator<Dtype>& coverageGenerator,
-      Dtype* transformedLabels,
-      size_t g_x,
-      size_t g_y);
-  virtual ~TransformedLabel_() {}
-};
-
 template <typename Dtype>
 class CoverageRegion_ {
  public:
@@ -93,7 +62,6 @@ class CoverageRegion_ {
 template <typename Dtype>
 class CoverageGenerator {
  public:
-  typedef boost::reference_wrapper<Dtype> reference_wrapper_dtype;
   typedef cv::Mat3b Mat3b;
   typedef cv::Point2i Point2i;
   typedef cv::Point_<Dtype> Point2v;
@@ -103,10 +71,7 @@ class CoverageGenerator {
   typedef cv::Size_<Dtype> Size2v;
   typedef cv::Vec3i Vec3i;
   typedef BboxLabel_<Dtype> BboxLabel;
-  typedef TransformedLabel_<Dtype> TransformedLabel;
   typedef CoverageRegion_<Dtype> CoverageRegion;
-  typedef typename vector<reference_wrapper_dtype>::const_iterator
-      coverage_iterator;
   typedef map<size_t, size_t> LabelMap;
 
   static const size_t TRANSFORMED_LABEL_SIZE = 8;
@@ -116,6 +81,10 @@ class CoverageGenerator {
 
   /**
    * @brief computes gridbox labels from a list of bounding boxes.
+   * Writes straight into the planar (C x H x W) label of one image. Planes
+   * of a gridbox covered by a box: 0 foreground, 1-4 top left and bottom
+   * right box corners relative to the gridbox, 5-6 inverse box width and
+   * height, 7 obj_norm, then one coverage plane per class, one-hot.
    */
   virtual void generate(
       Dtype* transformedLabels,
@@ -175,18 +144,6 @@ class CoverageGenerator {
    */
   virtual Rect imageRectToGridRect(const Rectv& area) const;
 
-  /**
-   * @brief Retrieves a gridbox label specification at the given x and y
-   * coordinates.
-   *
-   * @param x x-coord
-   * @param y y-coord
-   */
-  TransformedLabel transformedLabelAt(
-      Dtype* transformedLabels,
-      size_t x,
-      size_t y) const;
-
   Scalar bboxToColor(const Point2i& tl, const Point2i& br) const;
 
   LabelMap assignLabels(
@@ -203,8 +160,6 @@ class CoverageGenerator {
   const Dtype minObjNorm_;
   const LabelMap labels_;
   const size_t label_size_;
-
-  friend class TransformedLabel_<Dtype>;
 };
 
 
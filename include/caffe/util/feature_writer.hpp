@@ -0,0 +1,39 @@
+#ifndef CAFFE_UTIL_FEATURE_WRITER_HPP_
+#define CAFFE_UTIL_FEATURE_WRITER_HPP_
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Sink for the features of one blob, as written by extract_features.
+ *
+ * Every Write appends a whole mini-batch of num rows, dim values each,
+ * stored contiguously. Close must be called from the thread which wrote.
+ */
+class FeatureWriter {
+ public:
+  virtual ~FeatureWriter() {}
+  virtual void Write(const float* data, int num, int dim) = 0;
+  virtual void Close() = 0;
+};
+
+/**
+ * @brief Writer of the given type for a blob of the given shape.
+ *
+ * - "binary": a header of eight int64 fields in native byte order, i.e.
+ *   magic "CAFFEFEA", version, num, dim, channels, height, width, reserved,
+ *   followed by the row-major num x dim float32 matrix, also native.
+ * - "hdf5": an extendible num x dim float dataset "data".
+ * - otherwise a DB type: one Datum with float_data per row, keyed by the
+ *   zero padded row index.
+ */
+FeatureWriter* GetFeatureWriter(const string& name, const string& type,
+    const vector<int>& shape);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_FEATURE_WRITER_HPP_
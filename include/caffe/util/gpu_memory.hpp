@@ -22,6 +22,11 @@ struct GPUMemory {
     return mgr_.GetInfo(free_mem, used_mem, with_update);
   }
 
+  // Bytes handed out by the pool (live) and kept cached for reuse on device
+  static void GetPoolBytes(int device, size_t* live, size_t* cached) {
+    mgr_.GetPoolBytes(device, live, cached);
+  }
+
   template <class Any>
   static void allocate(Any** ptr, size_t size, int device, const shared_ptr<CudaStream>& pstream) {
     if (!try_allocate(reinterpret_cast<void**>(ptr), size, device, pstream)) {
@@ -120,6 +125,7 @@ struct GPUMemory {
     ~Manager();
     void lazy_init(int device);
     void GetInfo(size_t* free_mem, size_t* used_mem, bool with_update);
+    void GetPoolBytes(int device, size_t* live, size_t* cached);
     void deallocate(void* ptr, int device);
     bool try_allocate(void** ptr, size_t size, int device, const shared_ptr<CudaStream>& pstream);
     void init(const std::vector<int>&, bool);
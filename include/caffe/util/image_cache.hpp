@@ -0,0 +1,103 @@
+#ifndef CAFFE_UTIL_IMAGE_CACHE_HPP_
+#define CAFFE_UTIL_IMAGE_CACHE_HPP_
+
+#include <opencv2/core/core.hpp>
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Process wide, byte budgeted cache of decoded images.
+ *
+ * Shared by all ImageDataLayer instances and solver ranks of the process.
+ * Keys are sharded over kShards independently locked partitions, each one
+ * owning 1/kShards of the budget and evicting with the CLOCK (second chance)
+ * approximation of LRU. Images are kept either as they are (RAW) or
+ * re-encoded to PNG (lossless) or JPEG, trading decode time for capacity.
+ * Entries larger than a shard's budget are not cached at all.
+ */
+class ImageCache {
+ public:
+  static constexpr size_t kShards = 16UL;
+
+  struct Stats {
+    size_t hits;
+    size_t misses;
+    size_t insertions;
+    size_t evictions;
+    size_t rejections;  // too large for a shard
+    size_t entries;
+    size_t bytes;
+    size_t budget;
+  };
+
+  // Process wide instance, exported to Metrics.
+  static ImageCache& Get();
+  // Standalone instance, budget 0 is deferred to the first Reserve() or Insert().
+  explicit ImageCache(size_t budget_bytes);
+
+  // Grows the budget to at least budget_bytes; 0 means 1/4 of host memory.
+  void Reserve(size_t budget_bytes);
+  size_t budget() const {
+    return budget_.load();
+  }
+
+  // Returns false on miss, the decoded image otherwise.
+  bool Lookup(const string& key, cv::Mat* img);
+  // Doesn't count as a lookup, nor does it mark the entry as referenced.
+  bool Contains(const string& key) const;
+  // Stores the image (no-op if already present), evicting as needed.
+  // Returns false if the image wasn't stored.
+  bool Insert(const string& key, const cv::Mat& img,
+      ImageDataParameter_CacheFormat format = ImageDataParameter_CacheFormat_RAW,
+      int jpeg_quality = 95);
+
+  Stats stats() const;
+  void Clear();
+
+ private:
+  struct Entry {
+    string key;
+    cv::Mat data;  // image or encoded bytes
+    bool encoded;
+    size_t bytes;
+    bool referenced;
+  };
+  struct Shard {
+    mutable std::mutex mutex;
+    std::list<Entry> entries;
+    std::list<Entry>::iterator hand;
+    std::unordered_map<string, std::list<Entry>::iterator> index;
+    size_t bytes = 0UL;
+  };
+
+  void RegisterMetrics();
+  Shard& shard(const string& key) {
+    return shards_[std::hash<string>()(key) % kShards];
+  }
+  // Shard lock must be held
+  void Evict(Shard& shard, size_t shard_budget);
+
+  Shard shards_[kShards];
+  std::atomic<size_t> budget_;
+  std::atomic<size_t> hits_, misses_, insertions_, evictions_, rejections_;
+
+  DISABLE_COPY_MOVE_AND_ASSIGN(ImageCache);
+};
+
+// Cache key of an image read with the given ReadImageToCVMat arguments.
+string ImageCacheKey(const string& filename, int height, int width, bool is_color,
+    int short_side);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_IMAGE_CACHE_HPP_
@@ -256,6 +256,11 @@ cv::Mat ReadImageToCVMat(const string& filename,
     int height, int width, bool is_color,
     int short_side = 0);
 
+// Same as above for file contents read by the caller, filename is used for
+// the fallback decoder and messages only.
+cv::Mat DecodeImageToCVMat(const string& content, const string& filename,
+    int height, int width, bool is_color, int short_side = 0);
+
 cv::Mat ReadImageToCVMat(const string& filename,
     const int height, const int width);
 
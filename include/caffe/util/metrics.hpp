@@ -0,0 +1,176 @@
+#ifndef CAFFE_UTIL_METRICS_HPP_
+#define CAFFE_UTIL_METRICS_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+typedef std::vector<std::pair<string, string>> MetricLabels;
+
+/**
+ * @brief Single time series of the Metrics registry.
+ *
+ * Counters only grow (Add), gauges hold the last value (Set), summaries
+ * accumulate sum and count of observations plus an exponential moving
+ * average (Observe). Instances are owned by the registry and never deleted,
+ * so callers may cache the pointer returned by Metrics::counter() & Co.
+ */
+class Metric {
+ public:
+  enum Kind { COUNTER, GAUGE, SUMMARY };
+
+  Metric(Kind kind, const MetricLabels& labels)
+      : kind_(kind), labels_(labels), value_(0.), count_(0UL), avg_(0.) {}
+
+  void Add(double v) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    value_ += v;
+  }
+  void Set(double v) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    value_ = v;
+  }
+  void Observe(double v);
+
+  Kind kind() const {
+    return kind_;
+  }
+  const MetricLabels& labels() const {
+    return labels_;
+  }
+  // value_ is the sum of observations for summaries
+  void Read(double* value, size_t* count, double* avg) const;
+
+  // Weight of the latest observation in the moving average
+  static constexpr double kAverageWeight = 0.05;
+
+ private:
+  const Kind kind_;
+  const MetricLabels labels_;
+  mutable std::mutex mutex_;
+  double value_;
+  size_t count_;
+  double avg_;
+
+  DISABLE_COPY_MOVE_AND_ASSIGN(Metric);
+};
+
+/**
+ * @brief Process wide registry of runtime metrics.
+ *
+ * Instrumented code (solver, net, data readers, batch transformers, queues,
+ * GPU memory pool) only reports when enabled(), i.e. after Start() was
+ * called, so there is no overhead otherwise. The registry is exported in
+ * Prometheus text format by a minimal HTTP server on 127.0.0.1:port
+ * (GET /metrics, GET /metrics.json) and/or periodically dumped as JSON
+ * into a file, which is replaced atomically.
+ *
+ * Values computed on demand, e.g. queue depths, are registered as callbacks
+ * and evaluated under the registry lock during export. Callbacks must not
+ * call back into the registry; values of callbacks with equal name and
+ * labels are summed.
+ */
+class Metrics {
+ public:
+  static Metrics& Get();
+
+  // Starts the exporters; port 0 and empty json_path disable the respective one.
+  void Start(int port, const string& json_path, int json_interval_sec);
+  // Stops the exporters and disables reporting.
+  void Stop();
+
+  static bool enabled() {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+  // Per-layer timing synchronizes the stream after every layer, opt-in only.
+  static bool layer_timing() {
+    return layer_timing_.load(std::memory_order_relaxed);
+  }
+  static void set_layer_timing(bool on) {
+    layer_timing_.store(on);
+  }
+  // For unit tests and embedding applications which export on their own.
+  static void set_enabled(bool on) {
+    enabled_.store(on);
+  }
+
+  Metric* counter(const string& name, const MetricLabels& labels = MetricLabels()) {
+    return metric(name, Metric::COUNTER, labels);
+  }
+  Metric* gauge(const string& name, const MetricLabels& labels = MetricLabels()) {
+    return metric(name, Metric::GAUGE, labels);
+  }
+  Metric* summary(const string& name, const MetricLabels& labels = MetricLabels()) {
+    return metric(name, Metric::SUMMARY, labels);
+  }
+
+  // Returns the id to be passed to RemoveCallback before the captured
+  // objects are destroyed.
+  int AddCallback(const string& name, const MetricLabels& labels, std::function<double()> fn);
+  void RemoveCallback(int id);
+
+  string ExportText() const;
+  string ExportJson() const;
+
+ private:
+  struct Family {
+    Metric::Kind kind;
+    std::map<string, unique_ptr<Metric>> series;  // by formatted labels
+  };
+  struct Callback {
+    string name;
+    MetricLabels labels;
+    std::function<double()> fn;
+  };
+  // One exported sample: family, labels, kind, value, count, average
+  struct Sample {
+    string name;
+    MetricLabels labels;
+    Metric::Kind kind;
+    double value;
+    size_t count;
+    double avg;
+  };
+
+  Metrics();
+  ~Metrics();
+
+  Metric* metric(const string& name, Metric::Kind kind, const MetricLabels& labels);
+  vector<Sample> Collect() const;
+  void ServeEntry(int listen_fd);
+  void DumpEntry(string path, int interval_sec);
+  void WriteJson(const string& path) const;
+
+  mutable std::mutex mutex_;
+  std::map<string, Family> families_;
+  std::map<int, Callback> callbacks_;
+  int next_callback_id_;
+
+  std::mutex stop_mutex_;
+  std::condition_variable stop_cv_;
+  bool stopping_;
+  std::thread server_;
+  std::thread dumper_;
+
+  static std::atomic_bool enabled_;
+  static std::atomic_bool layer_timing_;
+
+  DISABLE_COPY_MOVE_AND_ASSIGN(Metrics);
+};
+
+// Formats labels as name="value" pairs for Prometheus, escaping the values.
+string FormatMetricLabels(const MetricLabels& labels);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_METRICS_HPP_
@@ -0,0 +1,76 @@
+#ifndef CAFFE_UTIL_READ_AHEAD_HPP_
+#define CAFFE_UTIL_READ_AHEAD_HPP_
+
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Asynchronous whole-file reader.
+ *
+ * Consumers Request() the files they are going to need and later Take()
+ * their contents, blocking only if the read is still in flight. Reads are
+ * issued by a pool of threads after posix_fadvise(WILLNEED), so several of
+ * them are outstanding at once, which is what hides the latency of network
+ * file systems and cold page caches. At most max_pending files are held;
+ * when full, the oldest completed read is dropped, so mispredicted requests
+ * (e.g. after a reshuffle) age out. Take() of a file which wasn't requested
+ * or was dropped returns false and the caller reads it synchronously.
+ */
+class FileReadAhead {
+ public:
+  FileReadAhead(int num_threads, size_t max_pending);
+  ~FileReadAhead();
+
+  // No-op if the file is already requested or nothing can be dropped.
+  void Request(const string& path);
+  // Returns false if the file wasn't requested or couldn't be read.
+  bool Take(const string& path, string* content);
+
+  size_t hits() const {
+    return hits_;
+  }
+  size_t misses() const {
+    return misses_;
+  }
+
+  // Reads the whole file, used by the pool and for fallbacks.
+  static bool ReadFile(const string& path, string* content);
+
+ private:
+  struct Item {
+    string path;
+    string content;
+    bool done;
+    bool ok;
+  };
+  typedef std::list<Item>::iterator ItemIt;
+
+  void ReaderEntry();
+
+  const size_t max_pending_;
+  std::mutex mutex_;
+  std::condition_variable queued_;
+  std::condition_variable done_;
+  std::list<Item> items_;  // request order
+  std::unordered_map<string, ItemIt> index_;
+  std::deque<ItemIt> queue_;  // not started yet
+  bool stopping_;
+  size_t hits_, misses_;
+  vector<std::thread> threads_;
+
+  DISABLE_COPY_MOVE_AND_ASSIGN(FileReadAhead);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_READ_AHEAD_HPP_
@@ -5,7 +5,8 @@
 
 #include "glog/logging.h"
 
-#include "caffe/caffe.hpp"
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
 
 namespace caffe {
 
@@ -21,18 +22,39 @@ bool SatisfySampleConstraint(const NormalizedBBox& sampled_bbox,
 // Sample a NormalizedBBox given the specifictions.
 void SampleBBox(const Sampler& sampler, NormalizedBBox* sampled_bbox);
 
+// Acceptance statistics of a BatchSampler: how many sampled bboxes were
+// checked against its constraint and how many satisfied it.
+struct SamplerStats {
+  size_t trials = 0UL;
+  size_t accepted = 0UL;
+
+  void Add(const SamplerStats& other) {
+    trials += other.trials;
+    accepted += other.accepted;
+  }
+  float acceptance_rate() const {
+    return trials > 0UL ? static_cast<float>(accepted) / trials : 0.f;
+  }
+};
+
 // Generate samples from NormalizedBBox using the BatchSampler.
+// Trials are drawn in blocks and checked against all object bboxes at once;
+// the result is equivalent to max_trials rounds of SampleBBox and
+// SatisfySampleConstraint. Optional stats are accumulated.
 void GenerateSamples(const NormalizedBBox& source_bbox,
                      const vector<NormalizedBBox>& object_bboxes,
                      const BatchSampler& batch_sampler,
-                     vector<NormalizedBBox>* sampled_bboxes);
+                     vector<NormalizedBBox>* sampled_bboxes,
+                     SamplerStats* stats = nullptr);
 
 // Generate samples from AnnotatedDatum using the BatchSampler.
 // All sampled bboxes which satisfy the constraints defined in BatchSampler
-// is stored in sampled_bboxes.
+// is stored in sampled_bboxes. If given, stats must have one entry per
+// batch sampler.
 void GenerateBatchSamples(const AnnotatedDatum& anno_datum,
                           const vector<BatchSampler>& batch_samplers,
-                          vector<NormalizedBBox>* sampled_bboxes);
+                          vector<NormalizedBBox>* sampled_bboxes,
+                          vector<SamplerStats>* stats = nullptr);
 
 }  // namespace caffe
 
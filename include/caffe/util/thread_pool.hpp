@@ -59,7 +59,7 @@ class ThreadPool{
     /// @brief Wait for queue to be empty
     void waitWorkComplete() {
         boost::unique_lock<boost::mutex> lock(mutex_);
-        if (!complete_)
+        while (!complete_)
             completed_.wait(lock);
     }
 
@@ -0,0 +1,98 @@
+#ifndef CAFFE_VIDEO_READER_HPP_
+#define CAFFE_VIDEO_READER_HPP_
+
+#if OPENCV_VERSION == 3
+#include <opencv2/videoio.hpp>
+#else
+#include <opencv2/opencv.hpp>
+#endif  // OPENCV_VERSION == 3
+
+#include <atomic>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/internal_thread.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
+
+namespace caffe {
+
+/**
+ * @brief clip_length consecutive sampled frames of one source.
+ */
+struct VideoClip {
+  vector<cv::Mat> frames;
+  int label = 0;
+};
+
+/**
+ * @brief Decodes video sources into clips on a pool of threads.
+ *
+ * Sources (a webcam or video files) are split into tasks: whole files or,
+ * with segments > 1, equal frame ranges of a file. Every decoding thread
+ * takes the next task and reads it sequentially with its own capture; the
+ * only seek is to the beginning of a segment. Temporal sampling keeps every
+ * stride-th frame, skipped frames are grabbed but not retrieved, i.e. not
+ * converted. Clips circulate between free and full queues like batches of
+ * DataReader, so at most queue_depth clips are decoded ahead.
+ *
+ * Sources which can't be opened or give no clip are skipped from then on.
+ * Looping over sources none of which gives a clip is a fatal error rather
+ * than a busy loop.
+ */
+class VideoReader : public InternalThread {
+ public:
+  // Empty path means the webcam VideoDataParameter::device_id
+  typedef std::pair<string, int> Source;  // path, label
+
+  VideoReader(const VideoDataParameter& param, const vector<Source>& sources,
+      size_t solver_rank);
+  virtual ~VideoReader();
+
+  // Blocks until the next clip is decoded, returns nullptr once all sources
+  // are exhausted (never when looping).
+  shared_ptr<VideoClip> pop_full();
+  void push_free(shared_ptr<VideoClip> clip) {
+    free_.push(clip);
+  }
+  // First clip without taking it, for shape inference, nullptr as pop_full()
+  shared_ptr<VideoClip> peek_full();
+
+  int clip_length() const {
+    return clip_length_;
+  }
+
+ protected:
+  void InternalThreadEntryN(size_t thread_id) override;
+
+ private:
+  struct Task {
+    size_t source;
+    int segment;
+  };
+
+  // Returns false if stopped
+  bool Decode(const Task& task, size_t thread_id);
+  void Fail(size_t source, const char* reason);
+
+  const VideoDataParameter param_;
+  const vector<Source> sources_;
+  const int stride_;
+  const int clip_length_;
+  const int segments_;
+  vector<Task> tasks_;
+  unique_ptr<std::atomic_bool[]> failed_;  // per source
+  std::atomic<size_t> failed_sources_;
+  std::atomic<size_t> next_task_;
+  std::atomic<size_t> finished_threads_;
+  BlockingQueue<shared_ptr<VideoClip>> free_;
+  BlockingQueue<shared_ptr<VideoClip>> full_;
+
+  DISABLE_COPY_MOVE_AND_ASSIGN(VideoReader);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_VIDEO_READER_HPP_
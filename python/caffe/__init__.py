@@ -1,7 +1,8 @@
 from .pycaffe import Net, SGDSolver, NesterovSolver, AdaGradSolver, RMSPropSolver, \
-    AdaDeltaSolver, AdamSolver
+    AdaDeltaSolver, AdamSolver, NetPool
 from ._caffe import set_mode_cpu, set_mode_gpu, set_device, set_devices, Layer, LayerParameter, \
-    LayerBase, get_solver, layer_type_list, create_layer
+    LayerBase, get_solver, layer_type_list, create_layer, start_metrics, stop_metrics, \
+    metrics_text
 from ._caffe import CAFFE_VERSION as __version__
 from .proto.caffe_pb2 import TRAIN, TEST
 from .classifier import Classifier
@@ -14,12 +14,18 @@
 #include <string>  // NOLINT(build/include_order)
 #include <vector>  // NOLINT(build/include_order)
 #include <fstream>  // NOLINT
+#include <algorithm>  // NOLINT(build/include_order)
+#include <condition_variable>  // NOLINT(build/include_order)
+#include <deque>  // NOLINT(build/include_order)
+#include <mutex>  // NOLINT(build/include_order)
+#include <thread>  // NOLINT(build/include_order)
 
 #include "caffe/caffe.hpp"
 #include "caffe/layers/memory_data_layer.hpp"
 #include "caffe/layers/python_layer.hpp"
 #include "caffe/sgd_solvers.hpp"
 #include "caffe/util/gpu_memory.hpp"
+#include "caffe/util/metrics.hpp"
 
 // Temporary solution for numpy < 1.7 versions: old macro, no promises.
 // You're strongly advised to upgrade to >= 1.7.
@@ -283,6 +289,490 @@ bp::object Blob_Reshape(bp::tuple args, bp::dict kwargs) {
   return bp::object();
 }
 
+// Zero-copy interop. Unlike Blob.data/Blob.diff (which convert the blob
+// to Dtype and move its head to the host), the helpers below expose the
+// memory in the blob's own type and take over caller's arrays as storage.
+int Blob_NpyType(Type type) {
+  switch (type) {
+    case DOUBLE:
+      return NPY_FLOAT64;
+    case FLOAT:
+      return NPY_FLOAT32;
+    case FLOAT16:
+      return NPY_FLOAT16;
+    case INT:
+      return NPY_INT32;
+    case UINT:
+      return NPY_UINT32;
+    default:
+      throw std::runtime_error("Blob type " + Type_Name(type) + " has no numpy equivalent");
+  }
+}
+
+// Returns an ndarray aliasing blob's host memory. Read-only views only
+// synchronize the host copy; writable views also move the head to the host.
+// Views are invalidated by reshaping the blob to a different count.
+bp::object Blob_View(bp::object pyblob, bool diff, bool writable) {
+  shared_ptr<Blob> blob = bp::extract<shared_ptr<Blob> >(pyblob);
+  const int npy_type = Blob_NpyType(diff ? blob->diff_type() : blob->data_type());
+  void* data;
+  if (writable) {
+    data = diff ? blob->current_mutable_diff_memory(false) :
+        blob->current_mutable_data_memory(false);
+  } else {
+    data = const_cast<void*>(diff ? blob->current_diff_memory(false) :
+        blob->current_data_memory(false));
+  }
+  vector<npy_intp> dims(blob->shape().begin(), blob->shape().end());
+  PyObject* arr_obj = PyArray_SimpleNewFromData(dims.size(), dims.data(), npy_type, data);
+  PyArrayObject* arr = reinterpret_cast<PyArrayObject*>(arr_obj);
+  if (!writable) {
+    PyArray_CLEARFLAGS(arr, NPY_ARRAY_WRITEABLE);
+  }
+  // SetBaseObject steals a ref, so we need to INCREF.
+  Py_INCREF(pyblob.ptr());
+  PyArray_SetBaseObject(arr, pyblob.ptr());
+  return bp::object(bp::handle<>(arr_obj));
+}
+
+bp::object Blob_DataView(bp::object pyblob, bool writable) {
+  return Blob_View(pyblob, false, writable);
+}
+
+bp::object Blob_DiffView(bp::object pyblob, bool writable) {
+  return Blob_View(pyblob, true, writable);
+}
+
+void Py_DecRefWithGIL(void* obj) {
+  // The last owner may be dropped by a worker thread, e.g. on Reshape
+  PyGILState_STATE state = PyGILState_Ensure();
+  Py_DECREF(static_cast<PyObject*>(obj));
+  PyGILState_Release(state);
+}
+
+// Makes a C contiguous array of the blob's data type the blob's host storage
+// without copying. The blob is reshaped to the array's shape when needed and
+// holds a reference to the array for as long as it uses its memory.
+void Blob_BindData(Blob* blob, bp::object obj) {
+  if (!PyArray_Check(obj.ptr())) {
+    throw std::runtime_error("bind_data expects a numpy array");
+  }
+  PyArrayObject* arr = reinterpret_cast<PyArrayObject*>(obj.ptr());
+  if (!PyArray_ISCARRAY(arr)) {
+    throw std::runtime_error("bound array must be C contiguous, aligned and writeable");
+  }
+  if (PyArray_TYPE(arr) != Blob_NpyType(blob->data_type())) {
+    throw std::runtime_error("bound array must be of blob's data type "
+        + Type_Name(blob->data_type()));
+  }
+  vector<int> shape(PyArray_DIMS(arr), PyArray_DIMS(arr) + PyArray_NDIM(arr));
+  if (shape != blob->shape()) {
+    blob->Reshape(shape);
+  }
+  Py_INCREF(obj.ptr());
+  shared_ptr<void> owner(obj.ptr(), &Py_DecRefWithGIL);
+  blob->bind_cpu_data(PyArray_DATA(arr), owner);
+}
+
+// Makes host memory the blob's current data, e.g. after a bound array was
+// written: a forward pass in GPU mode copies it to the device again.
+void Blob_TouchCpuData(Blob* blob) {
+  blob->current_mutable_data_memory(false);
+}
+
+// Minimal subset of the DLPack ABI (dmlc/dlpack, include/dlpack/dlpack.h).
+namespace dlpack {
+enum DeviceType { kDLCPU = 1, kDLCUDA = 2 };
+enum DataTypeCode { kDLInt = 0, kDLUInt = 1, kDLFloat = 2 };
+
+struct DLDevice {
+  int32_t device_type;
+  int32_t device_id;
+};
+
+struct DLDataType {
+  uint8_t code;
+  uint8_t bits;
+  uint16_t lanes;
+};
+
+struct DLTensor {
+  void* data;
+  DLDevice device;
+  int32_t ndim;
+  DLDataType dtype;
+  int64_t* shape;
+  int64_t* strides;
+  uint64_t byte_offset;
+};
+
+struct DLManagedTensor {
+  DLTensor dl_tensor;
+  void* manager_ctx;
+  void (*deleter)(DLManagedTensor* self);
+};
+}  // namespace dlpack
+
+struct DLPackExport {
+  dlpack::DLManagedTensor tensor;
+  vector<int64_t> shape;
+  PyObject* blob;  // keeps the exported memory alive
+};
+
+void DLPackExport_Delete(dlpack::DLManagedTensor* tensor) {
+  DLPackExport* ctx = static_cast<DLPackExport*>(tensor->manager_ctx);
+  Py_DecRefWithGIL(ctx->blob);
+  delete ctx;
+}
+
+void DLPackCapsule_Destruct(PyObject* capsule) {
+  // Consumers rename the capsule to "used_dltensor" and take over the tensor
+  if (PyCapsule_IsValid(capsule, "dltensor")) {
+    dlpack::DLManagedTensor* tensor = static_cast<dlpack::DLManagedTensor*>(
+        PyCapsule_GetPointer(capsule, "dltensor"));
+    tensor->deleter(tensor);
+  }
+}
+
+bp::tuple Blob_DLPackDevice(Blob* blob) {
+  return blob->is_data_on_gpu() ?
+      bp::make_tuple(static_cast<int>(dlpack::kDLCUDA), Caffe::current_device()) :
+      bp::make_tuple(static_cast<int>(dlpack::kDLCPU), 0);
+}
+
+// Exports blob data on its current device (host or GPU) in its own type.
+// The head is pinned to that device so that consumer writes are seen by
+// Caffe.
+bp::object Blob_DLPack(bp::object pyblob, bp::object /* stream */) {
+  shared_ptr<Blob> blob = bp::extract<shared_ptr<Blob> >(pyblob);
+  const bool use_gpu = blob->is_data_on_gpu();
+  const Type type = blob->data_type();
+  dlpack::DLDataType dtype;
+  dtype.code = is_type<int>(type) ? dlpack::kDLInt :
+      is_type<unsigned int>(type) ? dlpack::kDLUInt : dlpack::kDLFloat;
+  dtype.bits = static_cast<uint8_t>(tsize(type) * 8);
+  dtype.lanes = 1;
+  Blob_NpyType(type);  // rejects types without an array equivalent
+
+  DLPackExport* ctx = new DLPackExport;
+  ctx->shape.assign(blob->shape().begin(), blob->shape().end());
+  ctx->blob = pyblob.ptr();
+  Py_INCREF(ctx->blob);
+  dlpack::DLTensor& t = ctx->tensor.dl_tensor;
+  t.data = blob->current_mutable_data_memory(use_gpu);
+  if (use_gpu) {
+    // Producer's work has to be complete before any consumer stream uses it
+    CUDA_CHECK(cudaStreamSynchronize(Caffe::thread_stream()));
+  }
+  t.device.device_type = use_gpu ? dlpack::kDLCUDA : dlpack::kDLCPU;
+  t.device.device_id = use_gpu ? Caffe::current_device() : 0;
+  t.ndim = static_cast<int32_t>(ctx->shape.size());
+  t.dtype = dtype;
+  t.shape = ctx->shape.data();
+  t.strides = nullptr;  // compact row-major
+  t.byte_offset = 0UL;
+  ctx->tensor.manager_ctx = ctx;
+  ctx->tensor.deleter = &DLPackExport_Delete;
+  return bp::object(bp::handle<>(
+      PyCapsule_New(&ctx->tensor, "dltensor", &DLPackCapsule_Destruct)));
+}
+
+// Input or output array of a NetPool request.
+struct PoolArray {
+  string name;
+  vector<int> shape;
+  Type type;
+  const void* data;         // inputs: aliased array memory
+  shared_ptr<void> owner;   // inputs: keeps the array alive
+  vector<char> bytes;       // outputs: copy of the blob
+};
+
+// Result handle returned by NetPool.forward_async, a subset of the
+// concurrent.futures.Future interface.
+class NetFuture {
+ public:
+  NetFuture() : done_(false) {}
+
+  bool done() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return done_;
+  }
+
+  // Waits for completion, timeout < 0 waits forever. To be called without GIL.
+  bool Wait(double timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (timeout < 0.) {
+      cv_.wait(lock, [&] { return done_; });
+      return true;
+    }
+    return cv_.wait_for(lock, std::chrono::duration<double>(timeout), [&] { return done_; });
+  }
+
+  void Finish() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      done_ = true;
+    }
+    cv_.notify_all();
+  }
+
+  vector<PoolArray> inputs;
+  vector<PoolArray> outputs;
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool done_;
+
+  DISABLE_COPY_MOVE_AND_ASSIGN(NetFuture);
+};
+
+bp::dict NetFuture_Result(shared_ptr<NetFuture> future, bp::object timeout) {
+  const double seconds = timeout.is_none() ? -1. : bp::extract<double>(timeout)();
+  bool ready;
+  {
+    PyGILRelease gil;
+    ready = future->Wait(seconds);
+  }
+  if (!ready) {
+    throw std::runtime_error("NetFuture.result timed out");
+  }
+  bp::dict result;
+  for (const PoolArray& out : future->outputs) {
+    vector<npy_intp> dims(out.shape.begin(), out.shape.end());
+    PyObject* arr_obj = PyArray_SimpleNew(dims.size(), dims.data(), Blob_NpyType(out.type));
+    std::memcpy(PyArray_DATA(reinterpret_cast<PyArrayObject*>(arr_obj)),
+        out.bytes.data(), out.bytes.size());
+    result[out.name] = bp::object(bp::handle<>(arr_obj));
+  }
+  return result;
+}
+
+// Pool of net replicas served by worker threads, so that several requests
+// run concurrently from one Python process. Every worker owns a replica and
+// initializes Caffe's thread local state (mode, device) for it. Replicas on
+// the same device share trained layers of the first one placed there.
+// Requests are executed entirely without the GIL.
+class NetPool {
+ public:
+  NetPool(const string& param_file, Phase phase, int replicas, const string& weights,
+      int level, const vector<string>& stages, const vector<int>& devices)
+      : param_file_(param_file),
+        weights_(weights),
+        phase_(phase),
+        level_(level),
+        stages_(stages),
+        mode_(Caffe::mode()),
+        devices_(devices),
+        nets_(std::max(replicas, 1)),
+        started_(0),
+        stop_(false) {
+    if (mode_ == Caffe::GPU && devices_.empty()) {
+      devices_.push_back(Caffe::current_device());
+    }
+    for (size_t i = 0; i < nets_.size(); ++i) {
+      workers_.emplace_back(&NetPool::WorkerEntry, this, i);
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    ready_cv_.wait(lock, [&] { return started_ == nets_.size(); });
+    const Net& net = *nets_[0];
+    for (int i = 0; i < net.num_inputs(); ++i) {
+      input_names_.push_back(net.blob_names()[net.input_blob_indices()[i]]);
+      input_types_.push_back(net.input_blobs()[i]->data_type());
+    }
+    for (int i = 0; i < net.num_outputs(); ++i) {
+      output_names_.push_back(net.blob_names()[net.output_blob_indices()[i]]);
+    }
+  }
+
+  ~NetPool() {
+    // Workers may need the GIL to run Python layers or release arrays
+    PyGILRelease gil;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (std::thread& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  // Queues a forward pass over the given {input name: array} batch.
+  // Arrays are converted to the input blob types only when they differ.
+  shared_ptr<NetFuture> Submit(const bp::dict& inputs) {
+    shared_ptr<NetFuture> future = boost::make_shared<NetFuture>();
+    bp::list items = inputs.items();
+    for (int i = 0; i < bp::len(items); ++i) {
+      const string name = bp::extract<string>(items[i][0]);
+      auto it = std::find(input_names_.begin(), input_names_.end(), name);
+      if (it == input_names_.end()) {
+        throw std::runtime_error(name + " is not an input blob");
+      }
+      PoolArray in;
+      in.name = name;
+      in.type = input_types_[it - input_names_.begin()];
+      bp::object obj = items[i][1];
+      PyObject* arr_obj = PyArray_FROMANY(obj.ptr(), Blob_NpyType(in.type), 0, 0,
+          NPY_ARRAY_CARRAY_RO);
+      if (arr_obj == nullptr) {
+        bp::throw_error_already_set();
+      }
+      in.owner.reset(arr_obj, &Py_DecRefWithGIL);
+      PyArrayObject* arr = reinterpret_cast<PyArrayObject*>(arr_obj);
+      in.shape.assign(PyArray_DIMS(arr), PyArray_DIMS(arr) + PyArray_NDIM(arr));
+      in.data = PyArray_DATA(arr);
+      future->inputs.push_back(std::move(in));
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      queue_.push_back(future);
+    }
+    cv_.notify_one();
+    return future;
+  }
+
+  int replicas() const {
+    return nets_.size();
+  }
+  const vector<string>& inputs() const {
+    return input_names_;
+  }
+  const vector<string>& outputs() const {
+    return output_names_;
+  }
+
+ private:
+  void WorkerEntry(size_t replica) {
+    Caffe::set_mode(mode_);
+    const size_t groups = std::max<size_t>(devices_.size(), 1UL);
+    const size_t leader = replica % groups;
+    if (mode_ == Caffe::GPU) {
+      Caffe::SetDevice(devices_[leader]);
+    }
+    shared_ptr<Net> net = boost::make_shared<Net>(param_file_, phase_, 0U, nullptr, nullptr,
+        false, level_, &stages_);
+    if (replica == leader) {
+      if (!weights_.empty()) {
+        net->CopyTrainedLayersFrom(weights_);
+      }
+      // Followers share these blobs, so bring them to the device up front
+      // and let concurrent forward passes only read them.
+      for (const shared_ptr<LayerBase>& layer : net->layers()) {
+        for (const shared_ptr<Blob>& blob : layer->blobs()) {
+          blob->current_data_memory(mode_ == Caffe::GPU);
+        }
+      }
+    } else {
+      std::unique_lock<std::mutex> lock(mutex_);
+      ready_cv_.wait(lock, [&] { return static_cast<bool>(nets_[leader]); });
+      lock.unlock();
+      net->ShareTrainedLayersWith(nets_[leader].get());
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      nets_[replica] = net;
+      ++started_;
+    }
+    ready_cv_.notify_all();
+
+    while (true) {
+      shared_ptr<NetFuture> future;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [&] { return stop_ || !queue_.empty(); });
+        if (queue_.empty()) {
+          break;
+        }
+        future = queue_.front();
+        queue_.pop_front();
+      }
+      Forward(net.get(), future.get());
+      future->Finish();
+    }
+    // Nets are released by the threads they were created by
+    std::lock_guard<std::mutex> lock(mutex_);
+    nets_[replica].reset();
+  }
+
+  static void Forward(Net* net, NetFuture* future) {
+    bool reshape = false;
+    for (const PoolArray& in : future->inputs) {
+      Blob* blob = net->blob_by_name(in.name).get();
+      if (blob->shape() != in.shape) {
+        blob->Reshape(in.shape);
+        reshape = true;
+      }
+      std::memcpy(blob->current_mutable_data_memory(false), in.data,
+          blob->count() * tsize(in.type));
+    }
+    if (reshape) {
+      net->Reshape();
+    }
+    net->Forward();
+    for (int i = 0; i < net->num_outputs(); ++i) {
+      const Blob* blob = net->output_blobs()[i];
+      PoolArray out;
+      out.name = net->blob_names()[net->output_blob_indices()[i]];
+      out.shape = blob->shape();
+      out.type = blob->data_type();
+      out.data = nullptr;
+      out.bytes.resize(blob->count() * tsize(out.type));
+      std::memcpy(out.bytes.data(), blob->current_data_memory(false), out.bytes.size());
+      future->outputs.push_back(std::move(out));
+    }
+  }
+
+  const string param_file_;
+  const string weights_;
+  const Phase phase_;
+  const int level_;
+  const vector<string> stages_;
+  const Caffe::Brew mode_;
+  vector<int> devices_;
+  vector<shared_ptr<Net>> nets_;
+  vector<std::thread> workers_;
+  vector<string> input_names_;
+  vector<Type> input_types_;
+  vector<string> output_names_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;        // new requests or stop
+  std::condition_variable ready_cv_;  // replicas constructed
+  std::deque<shared_ptr<NetFuture>> queue_;
+  size_t started_;
+  bool stop_;
+
+  DISABLE_COPY_MOVE_AND_ASSIGN(NetPool);
+};
+
+shared_ptr<NetPool> NetPool_Init(string param_file, int phase, int replicas,
+    const bp::object& weights, const int level, const bp::object& stages,
+    const bp::object& devices) {
+  vector<string> stages_vector;
+  if (!stages.is_none()) {
+    for (int i = 0; i < bp::len(stages); i++) {
+      stages_vector.push_back(bp::extract<string>(stages[i]));
+    }
+  }
+  vector<int> devices_vector;
+  if (!devices.is_none()) {
+    for (int i = 0; i < bp::len(devices); i++) {
+      devices_vector.push_back(bp::extract<int>(devices[i]));
+    }
+  }
+  string weights_file;
+  if (!weights.is_none()) {
+    weights_file = bp::extract<string>(weights);
+    CheckFile(weights_file);
+  }
+  CheckFile(param_file);
+  // Replicas are built by the workers, Python layers among them need the GIL
+  PyGILRelease gil;
+  return boost::make_shared<NetPool>(param_file, static_cast<Phase>(phase), replicas,
+      weights_file, level, stages_vector, devices_vector);
+}
+
 bp::object BlobVec_add_blob(bp::tuple args, bp::dict kwargs) {
   if (bp::len(kwargs) > 0) {
     throw std::runtime_error("BlobVec.add_blob takes no kwargs");
@@ -420,6 +910,21 @@ void Solver_StepNoGIL(Solver* solver, int iters) {
 
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(SolveOverloads, Solve, 0, 1);
 
+// Runtime metrics, see Metrics; port 0 and empty json_path disable the exporter.
+void start_metrics(int port, const string& json_path, int interval, bool layer_timing) {
+  Metrics::set_layer_timing(layer_timing);
+  Metrics::Get().Start(port, json_path, interval);
+}
+
+void stop_metrics() {
+  PyGILRelease gil;
+  Metrics::Get().Stop();
+}
+
+string metrics_text() {
+  return Metrics::Get().ExportText();
+}
+
 BOOST_PYTHON_MODULE(_caffe) {
   // below, we prepend an underscore to methods that will be replaced
   // in Python
@@ -433,6 +938,10 @@ BOOST_PYTHON_MODULE(_caffe) {
   bp::def("set_device", &set_device);
 
   bp::def("layer_type_list", &LayerRegistry::LayerTypeList);
+  bp::def("start_metrics", &start_metrics, (bp::arg("port") = 0, bp::arg("json_path") = "",
+      bp::arg("interval") = 10, bp::arg("layer_timing") = false));
+  bp::def("stop_metrics", &stop_metrics);
+  bp::def("metrics_text", &metrics_text);
 
   bp::class_<Net, shared_ptr<Net>, boost::noncopyable >("Net",
     bp::no_init)
@@ -475,6 +984,25 @@ BOOST_PYTHON_MODULE(_caffe) {
     .def("save", &Net_Save);
   BP_REGISTER_SHARED_PTR_TO_PYTHON(Net);
 
+  bp::class_<NetPool, shared_ptr<NetPool>, boost::noncopyable>("NetPool", bp::no_init)
+    .def("__init__", bp::make_constructor(&NetPool_Init,
+          bp::default_call_policies(), (bp::arg("network_file"), "phase",
+            bp::arg("replicas")=1, bp::arg("weights")=bp::object(),
+            bp::arg("level")=0, bp::arg("stages")=bp::object(),
+            bp::arg("devices")=bp::object())))
+    .def("_submit", &NetPool::Submit)
+    .add_property("replicas", &NetPool::replicas)
+    .add_property("inputs", bp::make_function(&NetPool::inputs,
+        bp::return_value_policy<bp::copy_const_reference>()))
+    .add_property("outputs", bp::make_function(&NetPool::outputs,
+        bp::return_value_policy<bp::copy_const_reference>()));
+  BP_REGISTER_SHARED_PTR_TO_PYTHON(NetPool);
+
+  bp::class_<NetFuture, shared_ptr<NetFuture>, boost::noncopyable>("NetFuture", bp::no_init)
+    .def("done", &NetFuture::done)
+    .def("result", &NetFuture_Result, (bp::arg("timeout")=bp::object()));
+  BP_REGISTER_SHARED_PTR_TO_PYTHON(NetFuture);
+
 
   bp::class_<Blob, shared_ptr<TBlob<Dtype>>, boost::noncopyable>(
     "Blob", bp::no_init)
@@ -493,7 +1021,13 @@ BOOST_PYTHON_MODULE(_caffe) {
         .add_property("data",     bp::make_function(&Blob::mutable_cpu_data<Dtype>,
               NdarrayCallPolicies()))
         .add_property("diff",     bp::make_function(&Blob::mutable_cpu_diff<Dtype>,
-              NdarrayCallPolicies()));
+              NdarrayCallPolicies()))
+        .def("data_view",         &Blob_DataView, (bp::arg("writable")=false))
+        .def("diff_view",         &Blob_DiffView, (bp::arg("writable")=false))
+        .def("bind_data",         &Blob_BindData)
+        .def("_touch_cpu_data",   &Blob_TouchCpuData)
+        .def("__dlpack__",        &Blob_DLPack, (bp::arg("stream")=bp::object()))
+        .def("__dlpack_device__", &Blob_DLPackDevice);
 
   BP_REGISTER_SHARED_PTR_TO_PYTHON(Blob);
 
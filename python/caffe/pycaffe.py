@@ -11,7 +11,7 @@ except:
 import numpy as np
 
 from ._caffe import Net, SGDSolver, NesterovSolver, AdaGradSolver, \
-        RMSPropSolver, AdaDeltaSolver, AdamSolver, LayerParameter
+        RMSPropSolver, AdaDeltaSolver, AdamSolver, LayerParameter, NetPool
 import caffe.io
 
 import six
@@ -118,6 +118,10 @@ def _Net_forward(self, blobs=None, start=None, end=None, **kwargs):
                 raise Exception('Input is not batch sized')
             self.blobs[in_].data[...] = blob
 
+    # Bound arrays may have been written since the last pass
+    for in_ in getattr(self, '_bound_inputs', ()):
+        self.blobs[in_]._touch_cpu_data()
+
     self._forward(start_ind, end_ind)
 
     # Unpack blobs to extract
@@ -259,6 +263,27 @@ def _Net_set_input_arrays(self, data, labels):
     return self._set_input_arrays(data, labels)
 
 
+def _Net_bind_inputs(self, **kwargs):
+    """
+    Bind arrays as storage of input blobs without copying.
+
+    Parameters
+    ----------
+    kwargs : Keys are input blob names and values are C contiguous ndarrays
+             of the blob's data type (see Blob.data_view().dtype).
+             Blobs are reshaped to the array shapes when needed and keep the
+             arrays alive while using them; writes to an array are seen by
+             the next forward(), also in GPU mode.
+    """
+    if not hasattr(self, '_bound_inputs'):
+        self._bound_inputs = set()
+    for in_, arr in six.iteritems(kwargs):
+        if in_ not in self.inputs:
+            raise Exception('{} is not an input blob'.format(in_))
+        self.blobs[in_].bind_data(arr)
+        self._bound_inputs.add(in_)
+
+
 def _Net_batch(self, blobs):
     """
     Batch blob lists according to net's batch size.
@@ -317,12 +342,42 @@ Net.backward = _Net_backward
 Net.forward_all = _Net_forward_all
 Net.forward_backward_all = _Net_forward_backward_all
 Net.set_input_arrays = _Net_set_input_arrays
+Net.bind_inputs = _Net_bind_inputs
 Net._batch = _Net_batch
 Net.inputs = _Net_inputs
 Net.outputs = _Net_outputs
 Net.top_names = property(lambda n: _Net_IdNameWrapper(n, Net._top_ids))
 Net.bottom_names = property(lambda n: _Net_IdNameWrapper(n, Net._bottom_ids))
 
+
+def _NetPool_forward_async(self, **kwargs):
+    """
+    Queue a forward pass on the next idle replica. The GIL is not held
+    while the pass runs.
+
+    Parameters
+    ----------
+    kwargs : Keys are input blob names and values are batch ndarrays,
+             the batch may differ from the one in the net definition.
+
+    Returns
+    -------
+    future: NetFuture whose result(timeout=None) returns
+            {output blob name: ndarray} and done() polls for completion.
+    """
+    return self._submit(kwargs)
+
+
+def _NetPool_forward(self, **kwargs):
+    """
+    Synchronous forward_async.
+    """
+    return self._submit(kwargs).result()
+
+# Attach methods to NetPool.
+NetPool.forward_async = _NetPool_forward_async
+NetPool.forward = _NetPool_forward
+
 # LayerParameter
 def _LayerParameter_to_python(self):
     from caffe.proto import caffe_pb2
@@ -74,6 +74,26 @@ class TestNet(unittest.TestCase):
         self.net.forward()
         self.net.backward()
 
+    def test_data_view(self):
+        conv = self.net.blobs['conv']
+        self.net.forward()
+        view = conv.data_view()
+        self.assertFalse(view.flags.writeable)
+        self.assertEqual(view.shape, tuple(conv.shape))
+        writable = conv.data_view(writable=True)
+        writable[...] = 3
+        self.assertEqual(view.ctypes.data, writable.ctypes.data)
+        self.assertTrue((conv.data_view() == 3).all())
+
+    def test_dlpack(self):
+        if not hasattr(np, 'from_dlpack'):
+            return
+        conv = self.net.blobs['conv']
+        conv.data_view(writable=True)[...] = 1
+        arr = np.from_dlpack(conv)
+        self.assertEqual(arr.shape, tuple(conv.shape))
+        self.assertTrue((arr == 1).all())
+
     def test_inputs_outputs(self):
         self.assertEqual(self.net.inputs, [])
         self.assertEqual(self.net.outputs, ['loss'])
@@ -317,5 +337,46 @@ layer {
         net = caffe.Net(self.f.name, caffe.TEST, stages=['deploy'])
         self.check_net(net, ['pred'])
 
+    def test_bind_inputs(self):
+        net = caffe.Net(self.f.name, caffe.TEST, stages=['deploy'])
+        dtype = net.blobs['data'].data_view().dtype
+        data = np.zeros((2, 1, 10, 10), dtype=dtype)
+        net.bind_inputs(data=data)
+        self.assertEqual(list(net.blobs['data'].shape), [2, 1, 10, 10])
+        data[...] = 1
+        self.assertTrue((net.blobs['data'].data_view() == 1).all())
+        net.reshape()
+        net.forward()
+        self.assertEqual(list(net.blobs['pred'].shape), [2, 2])
+        # Written between passes: every pass sees the current values
+        net.params['ip'][0].data[...] = np.random.randn(2, 100)
+        data[...] = 0
+        net.forward()
+        zeros = net.blobs['pred'].data.copy()
+        data[...] = 1
+        net.forward()
+        self.assertFalse(np.allclose(net.blobs['pred'].data, zeros))
+        data[...] = 0
+        net.forward()
+        np.testing.assert_allclose(net.blobs['pred'].data, zeros, rtol=1e-5)
+        with self.assertRaises(RuntimeError):
+            net.blobs['data'].bind_data(np.zeros((2, 1, 10, 10), dtype=np.int8))
+
+    def test_net_pool(self):
+        pool = caffe.NetPool(self.f.name, caffe.TEST, replicas=2,
+                             stages=['deploy'])
+        self.assertEqual(pool.replicas, 2)
+        self.assertEqual(pool.inputs, ['data'])
+        self.assertEqual(pool.outputs, ['pred'])
+        data = np.random.randn(3, 1, 10, 10)
+        futures = [pool.forward_async(data=data) for _ in range(4)]
+        results = [f.result() for f in futures]
+        for f, r in zip(futures, results):
+            self.assertTrue(f.done())
+            self.assertEqual(r['pred'].shape, (3, 2))
+            self.assertTrue(np.allclose(r['pred'], results[0]['pred']))
+        with self.assertRaises(RuntimeError):
+            pool.forward_async(label=data)
+
 # if __name__ == '__main__':
 #     unittest.main()
\ No newline at end of file
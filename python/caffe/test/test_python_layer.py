@@ -56,6 +56,21 @@ class PhaseLayer(caffe.Layer):
     def forward(self, bottom, top):
         top[0].data[()] = self.phase
 
+class CounterLayer(caffe.Layer):
+    """A data layer producing batches filled with their sequence number"""
+
+    def setup(self, bottom, top):
+        self.count = 0
+
+    def reshape(self, bottom, top):
+        top[0].reshape(2, 3)
+        top[1].reshape(2)
+
+    def forward(self, bottom, top):
+        top[0].data[...] = self.count
+        top[1].data[...] = -self.count
+        self.count += 1
+
 def python_net_file():
     with tempfile.NamedTemporaryFile(mode='w+', delete=False) as f:
         f.write("""name: 'pythonnet' force_backward: true
@@ -96,6 +111,15 @@ def phase_net_file():
           """)
         return f.name
 
+def prefetch_net_file():
+    with tempfile.NamedTemporaryFile(mode='w+', delete=False) as f:
+        f.write("""name: 'pythonnet'
+        layer { type: 'Python' name: 'layer' top: 'data' top: 'label'
+          python_param { module: 'test_python_layer' layer: 'CounterLayer'
+            prefetch: 3 } }
+          """)
+        return f.name
+
 
 @unittest.skipIf('Python' not in caffe.layer_type_list(),
     'Caffe built without Python layer support')
@@ -172,6 +196,16 @@ class TestPythonLayer(unittest.TestCase):
 
         os.remove(net_file)
 
+    def test_prefetch(self):
+        net_file = prefetch_net_file()
+        net = caffe.Net(net_file, caffe.TRAIN)
+        os.remove(net_file)
+        for i in range(5):
+            net.forward()
+            self.assertEqual(net.blobs['data'].data.shape, (2, 3))
+            self.assertTrue((net.blobs['data'].data == i).all())
+            self.assertTrue((net.blobs['label'].data == -i).all())
+
     def test_phase(self):
         net_file = phase_net_file()
         for phase in caffe.TRAIN, caffe.TEST:
@@ -1,4 +1,5 @@
 #include "caffe/batch_transformer.hpp"
+#include "caffe/util/metrics.hpp"
 
 namespace caffe {
 
@@ -19,9 +20,33 @@ BatchTransformer<Ftype, Btype>::BatchTransformer(int target_device, size_t rank,
   shared_ptr<Batch> processed = make_shared<Batch>(tp<Ftype>(), tp<Ftype>());
   processed_free_.push(processed);
   resize(false);
+  if (Metrics::enabled()) {
+    RegisterMetrics(rank);
+  }
   StartInternalThread();
 }
 
+template<typename Ftype, typename Btype>
+BatchTransformer<Ftype, Btype>::~BatchTransformer() {
+  for (int id : metric_callbacks_) {
+    Metrics::Get().RemoveCallback(id);
+  }
+}
+
+template<typename Ftype, typename Btype>
+void BatchTransformer<Ftype, Btype>::RegisterMetrics(size_t rank) {
+  const string r = std::to_string(rank);
+  // Time the solver waits here is time the net is starved of input
+  processed_full_.set_wait_metric(Metrics::Get().counter("caffe_queue_wait_seconds_total",
+      {{"queue", "processed_full"}, {"rank", r}}));
+  metric_callbacks_.push_back(Metrics::Get().AddCallback("caffe_queue_depth",
+      {{"queue", "processed_full"}, {"rank", r}},
+      [this]() { return static_cast<double>(processed_full_.size()); }));
+  metric_callbacks_.push_back(Metrics::Get().AddCallback("caffe_queue_depth",
+      {{"queue", "processed_free"}, {"rank", r}},
+      [this]() { return static_cast<double>(processed_free_.size()); }));
+}
+
 template<typename Ftype, typename Btype>
 void BatchTransformer<Ftype, Btype>::ResizeQueues(size_t queues_num) {
   StopInternalThread();
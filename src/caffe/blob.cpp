@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <climits>
 #include <vector>
 #include <unordered_set>
@@ -61,6 +62,47 @@ void Blob::Reshape(const vector<int>& shape, RESHAPE_MODE mode) {
   }
 }
 
+void Blob::SaveMemory(MemoryState* state) const {
+  state->shape = shape_;
+  state->count = count_;
+  state->data_tensor = data_tensor_;
+  state->diff_tensor = diff_tensor_;
+  state->data_type = data_tensor_->type_;
+  state->diff_type = diff_tensor_->type_;
+  state->data_count = data_tensor_->count_;
+  state->diff_count = diff_tensor_->count_;
+  state->data_arrays = data_tensor_->synced_arrays_;
+  state->diff_arrays = diff_tensor_->synced_arrays_;
+  state->data_shared_with = data_shared_with_;
+  state->diff_shared_with = diff_shared_with_;
+}
+
+void Blob::RestoreMemory(const MemoryState& state) {
+  data_tensor_ = state.data_tensor;
+  diff_tensor_ = state.diff_tensor;
+  data_tensor_->type_ = state.data_type;
+  data_tensor_->count_ = state.data_count;
+  data_tensor_->synced_arrays_ = state.data_arrays;
+  diff_tensor_->type_ = state.diff_type;
+  diff_tensor_->count_ = state.diff_count;
+  diff_tensor_->synced_arrays_ = state.diff_arrays;
+  for (Tensor* tensor : {data_tensor_.get(), diff_tensor_.get()}) {
+    // Another shape may have invalidated it, the content is recomputed anyway
+    shared_ptr<SyncedMemory>& mem = tensor->synced_arrays_[tensor->type_];
+    if (mem) {
+      mem->validate();
+    }
+  }
+  data_shared_with_ = state.data_shared_with;
+  diff_shared_with_ = state.diff_shared_with;
+  shape_ = state.shape;
+  count_ = state.count;
+  if (!shape_data_ || shape_data_->size() < shape_.size() * sizeof(int)) {
+    shape_data_ = make_shared<SyncedMemory>(shape_.size() * sizeof(int));
+  }
+  std::copy(shape_.begin(), shape_.end(), static_cast<int*>(shape_data_->mutable_cpu_data()));
+}
+
 void Blob::Reshape(const BlobShape& shape, RESHAPE_MODE mode) {
   CHECK_LE(shape.dim_size(), kMaxBlobAxes);
   vector<int> shape_vec(shape.dim_size());
@@ -4,6 +4,7 @@
 #include "caffe/util/rng.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/data_reader.hpp"
+#include "caffe/util/metrics.hpp"
 
 namespace caffe {
 
@@ -76,14 +77,52 @@ DataReader<DatumType>::DataReader(const LayerParameter& param,
   }
   db_source_ = param.data_param().source();
   init_ = make_shared<BlockingQueue<shared_ptr<DatumType>>>();
+  if (Metrics::enabled() && !sample_only) {
+    RegisterMetrics(param);
+  }
   StartInternalThread(false, Caffe::next_seed());
 }
 
 template<typename DatumType>
 DataReader<DatumType>::~DataReader() {
+  for (int id : metric_callbacks_) {
+    Metrics::Get().RemoveCallback(id);
+  }
   StopInternalThread();
 }
 
+template<typename DatumType>
+void DataReader<DatumType>::RegisterMetrics(const LayerParameter& param) {
+  const MetricLabels labels{{"layer", param.name()}, {"phase", Phase_Name(param.phase())},
+      {"rank", std::to_string(local_solver_rank_)}};
+  auto queue_labels = [&](const char* queue) {
+    MetricLabels ret{{"queue", queue}};
+    ret.insert(ret.end(), labels.begin(), labels.end());
+    return ret;
+  };
+  Metric* wait = Metrics::Get().counter("caffe_queue_wait_seconds_total",
+      queue_labels("reader_full"));
+  for (size_t i = 0; i < queues_num_; ++i) {
+    full_[i]->set_wait_metric(wait);
+  }
+  metric_callbacks_.push_back(Metrics::Get().AddCallback("caffe_queue_depth",
+      queue_labels("reader_full"), [this]() {
+        size_t depth = 0UL;
+        for (const auto& q : full_) {
+          depth += q->size();
+        }
+        return static_cast<double>(depth);
+      }));
+  metric_callbacks_.push_back(Metrics::Get().AddCallback("caffe_queue_depth",
+      queue_labels("reader_free"), [this]() {
+        size_t depth = 0UL;
+        for (const auto& q : free_) {
+          depth += q->size();
+        }
+        return static_cast<double>(depth);
+      }));
+}
+
 template<typename DatumType>
 void DataReader<DatumType>::InternalThreadEntry() {
   InternalThreadEntryN(0U);
@@ -266,6 +305,7 @@ DataReader<DatumType>::CursorManager::CursorManager(db::DB* db, DataReader<Datum
     size_t batch_size, bool cache, bool shuffle, bool epoch_count_required)
     : db_(db),
       cursor_(db->NewCursor()),
+      key_index_(db::KeyIndex::Get(db, reader->db_source_, batch_size)),
       reader_(reader),
       solver_count_(solver_count),
       solver_rank_(solver_rank),
@@ -280,7 +320,8 @@ DataReader<DatumType>::CursorManager::CursorManager(db::DB* db, DataReader<Datum
       shuffle_(shuffle),
       cached_all_(false),
       epoch_count_(0UL),
-      epoch_count_required_(epoch_count_required) {}
+      epoch_count_required_(epoch_count_required),
+      format_(Format::UNKNOWN) {}
 
 template<typename DatumType>
 DataReader<DatumType>::CursorManager::~CursorManager() {
@@ -315,21 +356,24 @@ void DataReader<DatumType>::CursorManager::next(shared_ptr<DatumType>& datum) {
   if (cached_all_) {
     return;
   }
-  for (size_t i = old_id; i < rec_id_; ++i) {
-    cursor_->Next();
-    if (!cursor_->valid()) {
-      if (epoch_count_required_ && epoch_count_ == 0UL) {  // only once if required
-        epoch_count_ = rec_id_;
-        Caffe::report_epoch_count(epoch_count_);
-      }
-      if (cache_) {
-        cached_all_ = true;
-        reader_->just_cached();
-        break;  // we cache first epoch, then we just read it from cache
-      }
-      LOG_IF(INFO, solver_rank_ == 0 && parser_thread_id_ == 0) << "Restarting data pre-fetching";
-      cursor_->SeekToFirst();
+  const size_t records = key_index_->records();
+  if (rec_id_ / records != old_id / records) {
+    if (epoch_count_required_ && epoch_count_ == 0UL) {  // only once if required
+      epoch_count_ = rec_id_;
+      Caffe::report_epoch_count(epoch_count_);
+    }
+    if (cache_) {
+      cached_all_ = true;
+      reader_->just_cached();
+      return;  // we cache first epoch, then we just read it from cache
     }
+    LOG_IF(INFO, solver_rank_ == 0 && parser_thread_id_ == 0) << "Restarting data pre-fetching";
+  }
+  if (rec_id_ == old_id + 1UL && rec_id_ % records != 0UL) {
+    cursor_->Next();
+  } else {
+    // Beginning of our next batch, or the DB wrapped around
+    key_index_->Seek(cursor_.get(), rec_id_);
   }
 }
 
@@ -361,46 +405,51 @@ void DataReader<DatumType>::CursorManager::rewind() {
   size_t rank_cycle_begin = rank_cycle_ * solver_rank_;
   rec_id_ = rank_cycle_begin + parser_thread_id_ * batch_size_;
   rec_end_ = rec_id_ + batch_size_;
-  cursor_->SeekToFirst();
-  for (size_t i = 0; i < rec_id_; ++i) {
-    cursor_->Next();
-    if (!cursor_->valid()) {
-      cursor_->SeekToFirst();
-    }
-  }
+  key_index_->Seek(cursor_.get(), rec_id_);
 }
 
 template<>
 void DataReader<Datum>::CursorManager::fetch(Datum* datum) {
-  C2TensorProtos protos;
-  if (cursor_->parse(&protos) && protos.protos_size() >= 2) {
-    C2TensorProto* image_proto = protos.mutable_protos(0);
-    C2TensorProto* label_proto = protos.mutable_protos(1);
-    if (image_proto->data_type() == C2TensorProto::STRING) {
-      // encoded image string.
-      DCHECK_EQ(image_proto->string_data_size(), 1);
-      datum->mutable_data()->assign(image_proto->string_data(0));
-      datum->set_encoded(true);
-    } else if (image_proto->data_type() == C2TensorProto::BYTE) {
-      // raw image content.
-      datum->set_allocated_data(image_proto->release_byte_data());
-      datum->set_encoded(false);
-      datum->set_channels(image_proto->dims_size() == 3 ? image_proto->dims(2) : 1);
-      datum->set_height(image_proto->dims_size() > 1 ? image_proto->dims(0) : 0);
-      datum->set_width(image_proto->dims_size() > 1 ? image_proto->dims(1) : 0);
-    } else {
-      LOG(FATAL) << "Unknown C2 image data type.";
-    }
-    if (label_proto->data_type() == C2TensorProto::INT32) {
-      DCHECK_EQ(label_proto->int32_data_size(), 1);
-      datum->set_label(label_proto->int32_data(0));
-    } else {
-      LOG(FATAL) << "Unsupported C2 label data type.";
+  bool parsed = false;
+  if (format_ == Format::UNKNOWN) {
+    parsed = cursor_->parse(&c2_protos_) && c2_protos_.protos_size() >= 2;
+    format_ = parsed ? Format::C2 : Format::DATUM;
+    LOG_IF(INFO, solver_rank_ == 0 && parser_thread_id_ == 0) << "Reading "
+        << (parsed ? "Caffe2 TensorProtos" : "Datum") << " records from " << reader_->db_source_;
+  }
+  if (format_ == Format::DATUM) {
+    if (!cursor_->parse(datum)) {
+      LOG(ERROR) << "Database cursor failed to parse Datum record";
     }
-  } else if (!cursor_->parse(datum)) {
-    LOG(ERROR) << "Database cursor failed to parse Datum record";
+    return;
+  }
+  if (!parsed && (!cursor_->parse(&c2_protos_) || c2_protos_.protos_size() < 2)) {
+    LOG(ERROR) << "Database cursor failed to parse C2TensorProtos record";
+    return;
+  }
+  C2TensorProto* image_proto = c2_protos_.mutable_protos(0);
+  const C2TensorProto& label_proto = c2_protos_.protos(1);
+  if (image_proto->data_type() == C2TensorProto::STRING) {
+    // encoded image string.
+    DCHECK_EQ(image_proto->string_data_size(), 1);
+    datum->mutable_data()->swap(*image_proto->mutable_string_data(0));
+    datum->set_encoded(true);
+  } else if (image_proto->data_type() == C2TensorProto::BYTE) {
+    // raw image content.
+    datum->mutable_data()->swap(*image_proto->mutable_byte_data());
+    datum->set_encoded(false);
+    datum->set_channels(image_proto->dims_size() == 3 ? image_proto->dims(2) : 1);
+    datum->set_height(image_proto->dims_size() > 1 ? image_proto->dims(0) : 0);
+    datum->set_width(image_proto->dims_size() > 1 ? image_proto->dims(1) : 0);
+  } else {
+    LOG(FATAL) << "Unknown C2 image data type.";
+  }
+  if (label_proto.data_type() == C2TensorProto::INT32) {
+    DCHECK_EQ(label_proto.int32_data_size(), 1);
+    datum->set_label(label_proto.int32_data(0));
+  } else {
+    LOG(FATAL) << "Unsupported C2 label data type.";
   }
-  // DLOG(INFO) << cursor_->key() << " " << datum->label();
 }
 
 template<>
@@ -1,4 +1,6 @@
-#include <functional>
+#include <algorithm>
+#include <fstream>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -16,6 +18,7 @@ void AccuracyLayer<Ftype, Btype>::LayerSetUp(
   if (has_ignore_label_) {
     ignore_label_ = this->layer_param_.accuracy_param().ignore_label();
   }
+  confusion_iters_ = this->layer_param_.accuracy_param().confusion_iters();
 }
 
 template <typename Ftype, typename Btype>
@@ -41,67 +44,238 @@ void AccuracyLayer<Ftype, Btype>::Reshape(const vector<Blob*>& bottom, const vec
   }
 }
 
-template <typename Ftype, typename Btype>
-void AccuracyLayer<Ftype, Btype>::Forward_cpu(const vector<Blob*>& bottom,
-    const vector<Blob*>& top) {
-  float accuracy = 0.F;
-  const Ftype* bottom_data = bottom[0]->cpu_data<Ftype>();
-  const Ftype* bottom_label = bottom[1]->cpu_data<Ftype>();
-  const int dim = bottom[0]->count() / outer_num_;
-  const int num_labels = bottom[0]->shape(label_axis_);
-  if (top.size() > 1) {
-    nums_buffer_.set_data(0.F);
-    top[1]->set_data(0.F);
+// Number of classes ranked before the true label: ties are ordered by
+// descending class index, like partial_sort with
+// std::greater<pair<score, index>>. The comparisons are branch free and the
+// scan stops, block-wise, as soon as the rank reaches top_k.
+template <typename Ftype>
+static int LabelRank(const Ftype* scores, int stride, int num_labels, int label, int top_k) {
+  constexpr int kBlock = 64;
+  const float label_score = static_cast<float>(scores[label * stride]);
+  int rank = 0;
+  for (int b = 0; b < label && rank < top_k; b += kBlock) {
+    const int e = std::min(b + kBlock, label);
+    for (int k = b; k < e; ++k) {
+      rank += static_cast<float>(scores[k * stride]) > label_score;
+    }
   }
-  std::vector<std::pair<float, int>> bottom_data_vector(num_labels);
-  int count = 0;
-  for (int i = 0; i < outer_num_; ++i) {
+  for (int b = label + 1; b < num_labels && rank < top_k; b += kBlock) {
+    const int e = std::min(b + kBlock, num_labels);
+    for (int k = b; k < e; ++k) {
+      rank += static_cast<float>(scores[k * stride]) >= label_score;
+    }
+  }
+  return rank;
+}
+
+// Top-1 prediction, consistent with LabelRank on ties
+template <typename Ftype>
+static int Prediction(const Ftype* scores, int stride, int num_labels) {
+  int best = 0;
+  float best_score = static_cast<float>(scores[0]);
+  for (int k = 1; k < num_labels; ++k) {
+    const float score = static_cast<float>(scores[k * stride]);
+    if (score >= best_score) {
+      best_score = score;
+      best = k;
+    }
+  }
+  return best;
+}
+
+template <typename Ftype, typename Btype>
+void AccuracyLayer<Ftype, Btype>::Count(const Ftype* bottom_data, const Ftype* bottom_label,
+    int num_labels, int outer_begin, int outer_end, Counts* counts) const {
+  const int dim = num_labels * inner_num_;
+  const bool per_class = !counts->labels.empty();
+  const bool confusion = !counts->predictions.empty();
+  for (int i = outer_begin; i < outer_end; ++i) {
     for (int j = 0; j < inner_num_; ++j) {
       const int label_value = static_cast<int>(bottom_label[i * inner_num_ + j]);
       if (has_ignore_label_ && label_value == ignore_label_) {
         continue;
       }
-      if (top.size() > 1) {
-        ++nums_buffer_.mutable_cpu_data()[label_value];
-      }
       DCHECK_GE(label_value, 0) << this->name();
       DCHECK_LT(label_value, num_labels) << this->name();
-      // Top-k accuracy
-      for (int k = 0; k < num_labels; ++k) {
-        bottom_data_vector[k] = std::make_pair(
-            static_cast<float>(bottom_data[i * dim + k * inner_num_ + j]), k);
+      const Ftype* scores = bottom_data + i * dim + j;
+      const bool hit = LabelRank(scores, inner_num_, num_labels, label_value, top_k_) < top_k_;
+      ++counts->valid;
+      counts->correct += hit;
+      if (per_class) {
+        ++counts->labels[label_value];
+        counts->hits[label_value] += hit;
       }
-
-      std::partial_sort(
-          bottom_data_vector.begin(), bottom_data_vector.begin() + top_k_,
-          bottom_data_vector.end(), std::greater<std::pair<float, int>>());
-
-      // check if true label is in top k predictions
-      for (int k = 0; k < top_k_; k++) {
-        if (bottom_data_vector[k].second == label_value) {
-          accuracy += 1.F;
-          if (top.size() > 1) {
-            Ftype* top_label = top[1]->mutable_cpu_data<Ftype>();
-            top_label[label_value] = top_label[label_value] + 1.;
-          }
-          break;
+      if (confusion) {
+        const int prediction = top_k_ == 1 && hit ? label_value :
+            Prediction(scores, inner_num_, num_labels);
+        ++counts->predictions[prediction];
+        if (prediction != label_value) {
+          ++counts->confusions[static_cast<int64_t>(label_value) * num_labels + prediction];
         }
       }
-      ++count;
     }
   }
+}
+
+template <typename Ftype, typename Btype>
+void AccuracyLayer<Ftype, Btype>::Forward_cpu(const vector<Blob*>& bottom,
+    const vector<Blob*>& top) {
+  const Ftype* bottom_data = bottom[0]->cpu_data<Ftype>();
+  const Ftype* bottom_label = bottom[1]->cpu_data<Ftype>();
+  const int num_labels = bottom[0]->shape(label_axis_);
+  const bool per_class = top.size() > 1 || confusion_iters_ > 0;
 
-  top[0]->mutable_cpu_data<Ftype>()[0] = accuracy / count;
+  // Samples are split by outer index; threads only pay off for large scans
+  constexpr size_t kMinScanPerThread = 1UL << 20;
+  const size_t scan = static_cast<size_t>(bottom[0]->count());
+  const int num_workers = std::max(1, std::min<int>({outer_num_,
+      static_cast<int>(std::thread::hardware_concurrency()),
+      static_cast<int>(scan / kMinScanPerThread)}));
+  vector<Counts> counts(num_workers);
+  for (Counts& c : counts) {
+    if (per_class) {
+      c.labels.resize(num_labels);
+      c.hits.resize(num_labels);
+    }
+    if (confusion_iters_ > 0) {
+      c.predictions.resize(num_labels);
+    }
+  }
+  auto worker = [&](int w) {
+    Count(bottom_data, bottom_label, num_labels,
+        static_cast<int>(static_cast<int64_t>(outer_num_) * w / num_workers),
+        static_cast<int>(static_cast<int64_t>(outer_num_) * (w + 1) / num_workers),
+        &counts[w]);
+  };
+  vector<std::thread> workers;
+  for (int w = 1; w < num_workers; ++w) {
+    workers.emplace_back(worker, w);
+  }
+  worker(0);
+  for (std::thread& t : workers) {
+    t.join();
+  }
+  for (int w = 1; w < num_workers; ++w) {
+    counts[0].valid += counts[w].valid;
+    counts[0].correct += counts[w].correct;
+    for (int l = 0; per_class && l < num_labels; ++l) {
+      counts[0].labels[l] += counts[w].labels[l];
+      counts[0].hits[l] += counts[w].hits[l];
+    }
+  }
+  const Counts& total = counts[0];
+
+  top[0]->mutable_cpu_data<Ftype>()[0] = static_cast<float>(total.correct) / total.valid;
   if (top.size() > 1) {
-    for (int i = 0; i < top[1]->count(); ++i) {
-      const float num = nums_buffer_.cpu_data()[i];
-      Ftype* top_label = top[1]->mutable_cpu_data<Ftype>();
-      top_label[i] = num == 0.F ? 0. : top_label[i] / num;
+    Ftype* top_label = top[1]->mutable_cpu_data<Ftype>();
+    for (int l = 0; l < num_labels; ++l) {
+      top_label[l] = total.labels[l] == 0 ? 0. :
+          static_cast<float>(total.hits[l]) / total.labels[l];
+    }
+  }
+
+  if (confusion_iters_ > 0) {
+    if (confusion_.labels.size() != static_cast<size_t>(num_labels)) {
+      confusion_ = Counts();
+      confusion_.labels.resize(num_labels);
+      confusion_.hits.resize(num_labels);
+      confusion_.predictions.resize(num_labels);
+      confusion_forwards_ = 0;
+    }
+    for (const Counts& c : counts) {
+      confusion_.valid += c.valid;
+      confusion_.correct += c.correct;
+      for (int l = 0; l < num_labels; ++l) {
+        confusion_.labels[l] += c.labels[l];
+        confusion_.hits[l] += c.hits[l];
+        confusion_.predictions[l] += c.predictions[l];
+      }
+      for (const auto& kv : c.confusions) {
+        confusion_.confusions[kv.first] += kv.second;
+      }
+    }
+    if (++confusion_forwards_ >= confusion_iters_) {
+      ReportConfusion();
     }
   }
   // Accuracy layer should not be used as a loss function.
 }
 
+template <typename Ftype, typename Btype>
+void AccuracyLayer<Ftype, Btype>::ReportConfusion() {
+  const int num_labels = confusion_.labels.size();
+  // Top-1 hits per class, i.e. the diagonal (hits counts top-k ones)
+  vector<int64_t> top1_hits(num_labels);
+  for (int l = 0; l < num_labels; ++l) {
+    top1_hits[l] = confusion_.labels[l];
+  }
+  vector<std::pair<int64_t, int64_t>> confusions(confusion_.confusions.begin(),
+      confusion_.confusions.end());
+  for (const auto& kv : confusions) {
+    top1_hits[kv.first / num_labels] -= kv.second;
+  }
+  double precision_sum = 0., recall_sum = 0.;
+  int precision_classes = 0, recall_classes = 0;
+  for (int l = 0; l < num_labels; ++l) {
+    if (confusion_.predictions[l] > 0) {
+      precision_sum += static_cast<double>(top1_hits[l]) / confusion_.predictions[l];
+      ++precision_classes;
+    }
+    if (confusion_.labels[l] > 0) {
+      recall_sum += static_cast<double>(top1_hits[l]) / confusion_.labels[l];
+      ++recall_classes;
+    }
+  }
+  std::sort(confusions.begin(), confusions.end(),
+      [](const std::pair<int64_t, int64_t>& a, const std::pair<int64_t, int64_t>& b) {
+        return a.second > b.second || (a.second == b.second && a.first < b.first);
+      });
+  LOG(INFO) << this->print_current_device() << " " << this->name() << ": "
+      << confusion_.valid << " samples over " << confusion_forwards_
+      << " iterations, macro precision "
+      << (precision_classes > 0 ? precision_sum / precision_classes : 0.)
+      << ", macro recall " << (recall_classes > 0 ? recall_sum / recall_classes : 0.);
+  const size_t kTopConfusions = 10UL;
+  for (size_t i = 0; i < std::min(kTopConfusions, confusions.size()); ++i) {
+    const int label = confusions[i].first / num_labels;
+    LOG(INFO) << "    class " << label << " predicted as "
+        << confusions[i].first % num_labels << ": " << confusions[i].second
+        << " of " << confusion_.labels[label];
+  }
+
+  const string& confusion_file = this->layer_param_.accuracy_param().confusion_file();
+  if (!confusion_file.empty()) {
+    std::ofstream ofs(confusion_file.c_str());
+    if (!ofs) {
+      LOG(ERROR) << "Failed to write " << confusion_file;
+    } else {
+      ofs << "# class labels predictions hits precision recall\n";
+      for (int l = 0; l < num_labels; ++l) {
+        ofs << l << " " << confusion_.labels[l] << " " << confusion_.predictions[l]
+            << " " << top1_hits[l] << " "
+            << (confusion_.predictions[l] > 0 ?
+                static_cast<double>(top1_hits[l]) / confusion_.predictions[l] : 0.) << " "
+            << (confusion_.labels[l] > 0 ?
+                static_cast<double>(top1_hits[l]) / confusion_.labels[l] : 0.) << "\n";
+      }
+      ofs << "# label prediction count\n";
+      for (const auto& kv : confusions) {
+        ofs << kv.first / num_labels << " " << kv.first % num_labels << " "
+            << kv.second << "\n";
+      }
+    }
+  }
+
+  const vector<int> zeros(num_labels, 0);
+  confusion_.valid = 0;
+  confusion_.correct = 0;
+  confusion_.labels = zeros;
+  confusion_.hits = zeros;
+  confusion_.predictions = zeros;
+  confusion_.confusions.clear();
+  confusion_forwards_ = 0;
+}
+
 
 INSTANTIATE_CLASS_FB(AccuracyLayer);
 REGISTER_LAYER_CLASS(Accuracy);
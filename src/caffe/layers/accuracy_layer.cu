@@ -65,6 +65,11 @@ __global__ void AccuracyForwardWithPerClassGPU(const int nthreads,
 template<typename Ftype, typename Btype>
 void AccuracyLayer<Ftype, Btype>::Forward_gpu(
     const vector<Blob*>& bottom, const vector<Blob*>& top) {
+  if (confusion_iters_ > 0) {
+    // The confusion matrix is accumulated on host
+    Forward_cpu(bottom, top);
+    return;
+  }
   const Ftype* bottom_data = bottom[0]->gpu_data<Ftype>();
   const Ftype* bottom_label = bottom[1]->gpu_data<Ftype>();
   const int dim = bottom[0]->count() / outer_num_;
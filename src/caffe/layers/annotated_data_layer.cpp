@@ -8,6 +8,7 @@
 #include "caffe/data_transformer.hpp"
 #include "caffe/layers/annotated_data_layer.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/metrics.hpp"
 #include "caffe/util/sampler.hpp"
 #include "caffe/parallel.hpp"
 
@@ -16,7 +17,9 @@ namespace caffe {
 template <typename Ftype, typename Btype>
 AnnotatedDataLayer<Ftype, Btype>::AnnotatedDataLayer(const LayerParameter& param,
     size_t solver_rank)
-  : DataLayer<Ftype, Btype>(param, solver_rank) {}
+  : DataLayer<Ftype, Btype>(param, solver_rank),
+    sampled_images_(0UL),
+    sampler_stats_report_at_(1000UL) {}
 
 template <typename Ftype, typename Btype>
 AnnotatedDataLayer<Ftype, Btype>::~AnnotatedDataLayer() {
@@ -36,6 +39,7 @@ void AnnotatedDataLayer<Ftype, Btype>::DataLayerSetUp(
   for (int i = 0; i < anno_data_param.batch_sampler_size(); ++i) {
     batch_samplers_.push_back(anno_data_param.batch_sampler(i));
   }
+  sampler_stats_.resize(batch_samplers_.size());
 
   if (this->auto_mode()) {
     if (!sample_areader_) {
@@ -158,6 +162,47 @@ void AnnotatedDataLayer<Ftype, Btype>::DataLayerSetUp(
       << top[0]->width();
 }
 
+template <typename Ftype, typename Btype>
+void AnnotatedDataLayer<Ftype, Btype>::UpdateSamplerStats(
+    const vector<SamplerStats>& batch_stats, size_t images) {
+  std::lock_guard<std::mutex> lock(sampler_stats_mutex_);
+  if (Metrics::enabled() && sampler_trials_metrics_.empty()) {
+    for (size_t i = 0; i < batch_samplers_.size(); ++i) {
+      const MetricLabels labels{{"layer", this->layer_param_.name()},
+          {"sampler", std::to_string(i)}};
+      sampler_trials_metrics_.push_back(
+          Metrics::Get().counter("caffe_ssd_sampler_trials_total", labels));
+      sampler_accepted_metrics_.push_back(
+          Metrics::Get().counter("caffe_ssd_sampler_accepted_total", labels));
+    }
+  }
+  for (size_t i = 0; i < batch_stats.size(); ++i) {
+    sampler_stats_[i].Add(batch_stats[i]);
+    if (!sampler_trials_metrics_.empty()) {
+      sampler_trials_metrics_[i]->Add(batch_stats[i].trials);
+      sampler_accepted_metrics_[i]->Add(batch_stats[i].accepted);
+    }
+  }
+  sampled_images_ += images;
+  if (sampled_images_ < sampler_stats_report_at_) {
+    return;
+  }
+  sampler_stats_report_at_ *= 10UL;
+  for (size_t i = 0; i < sampler_stats_.size(); ++i) {
+    const SamplerStats& stats = sampler_stats_[i];
+    const float trials_per_image = static_cast<float>(stats.trials) / sampled_images_;
+    LOG(INFO) << this->print_current_device()
+        << " " << this->layer_param_.name() << " batch_sampler " << i << ": "
+        << stats.accepted << " of " << stats.trials << " trials accepted ("
+        << 100.f * stats.acceptance_rate() << "%), " << trials_per_image
+        << " trials per image";
+    LOG_IF(WARNING, stats.trials > 0UL && stats.acceptance_rate() < 0.01f)
+        << this->layer_param_.name() << " batch_sampler " << i
+        << " rejects almost all of its trials, consider relaxing its"
+        << " sample_constraint or lowering max_trials";
+  }
+}
+
 // This function is called on prefetch thread
 template <typename Ftype, typename Btype>
 bool AnnotatedDataLayer<Ftype, Btype>::load_batch(Batch* batch, int thread_id, size_t queue_id) {
@@ -199,6 +244,7 @@ bool AnnotatedDataLayer<Ftype, Btype>::load_batch(Batch* batch, int thread_id, s
   map<int, vector<AnnotationGroup> > all_anno;
   int num_bboxes = 0;
 
+  vector<SamplerStats> sampler_stats(batch_samplers_.size());
   size_t current_batch_id = 0UL;
   for (size_t entry = 0; entry < batch_size; ++entry) {
     // get an anno_datum
@@ -228,7 +274,8 @@ bool AnnotatedDataLayer<Ftype, Btype>::load_batch(Batch* batch, int thread_id, s
     if (batch_samplers_.size() > 0) {
       // Generate sampled bboxes from expand_datum.
       vector<NormalizedBBox> sampled_bboxes;
-      GenerateBatchSamples(expand_datum, batch_samplers_, &sampled_bboxes);
+      GenerateBatchSamples(expand_datum, batch_samplers_, &sampled_bboxes,
+          &sampler_stats);
       if (sampled_bboxes.size() > 0) {
         // Randomly pick a sampled bbox and crop the expand_datum.
         int rand_idx = caffe_rng_rand() % sampled_bboxes.size();
@@ -334,6 +381,9 @@ bool AnnotatedDataLayer<Ftype, Btype>::load_batch(Batch* batch, int thread_id, s
       LOG(FATAL) << "Unknown annotation type.";
     }
   }
+  if (!batch_samplers_.empty()) {
+    UpdateSamplerStats(sampler_stats, batch_size);
+  }
   batch->set_data_packing(packing);
   batch->set_id(current_batch_id);
   this->sample_only_.store(false);
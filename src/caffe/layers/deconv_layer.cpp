@@ -1,9 +1,111 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
 #include <vector>
 
 #include "caffe/layers/deconv_layer.hpp"
 
 namespace caffe {
 
+namespace {
+
+// Input channels per group up to which the direct engine beats GEMM + col2im
+const int kDirectMaxGroupChannels = 16;
+// Multiply-adds worth a thread of the direct engine
+const size_t kMinWorkPerThread = 1UL << 18;
+
+// Input positions [begin, end) with 0 <= i * stride + offset < out_size
+struct ValidRange {
+  ValidRange(int size, int out_size, int stride, int offset) {
+    begin = offset >= 0 ? 0 : (stride - offset - 1) / stride;
+    end = out_size > offset ? std::min(size, (out_size - offset - 1) / stride + 1) : 0;
+    end = std::max(begin, end);
+  }
+  int begin, end;
+};
+
+// out[i * stride_h + kh * dilation_h - pad_h][j * stride_w + kw * dilation_w - pad_w]
+//   += w[kh][kw] * in[i][j]
+// S > 0 is stride_w known at compile time.
+template <int S, typename Dtype>
+void deconv_plane(const Dtype* in, int height, int width, const Dtype* w,
+    int kernel_h, int kernel_w, int pad_h, int pad_w, int stride_h, int stride_w,
+    int dilation_h, int dilation_w, Dtype* out, int out_h, int out_w) {
+  const int sw = S > 0 ? S : stride_w;
+  for (int kh = 0; kh < kernel_h; ++kh) {
+    const int off_h = kh * dilation_h - pad_h;
+    const ValidRange rows(height, out_h, stride_h, off_h);
+    for (int kw = 0; kw < kernel_w; ++kw) {
+      const Dtype wv = w[kh * kernel_w + kw];
+      const int off_w = kw * dilation_w - pad_w;
+      const ValidRange cols(width, out_w, sw, off_w);
+      for (int i = rows.begin; i < rows.end; ++i) {
+        const Dtype* in_row = in + i * width;
+        Dtype* out_row = out + (i * stride_h + off_h) * out_w + off_w;
+        for (int j = cols.begin; j < cols.end; ++j) {
+          out_row[j * sw] += wv * in_row[j];
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void deconv_plane(const Dtype* in, int height, int width, const Dtype* w,
+    int kernel_h, int kernel_w, int pad_h, int pad_w, int stride_h, int stride_w,
+    int dilation_h, int dilation_w, Dtype* out, int out_h, int out_w) {
+  switch (stride_w) {
+    case 1:
+      deconv_plane<1>(in, height, width, w, kernel_h, kernel_w, pad_h, pad_w,
+          stride_h, stride_w, dilation_h, dilation_w, out, out_h, out_w);
+      break;
+    case 2:
+      // 2x upsampling, the most common one
+      deconv_plane<2>(in, height, width, w, kernel_h, kernel_w, pad_h, pad_w,
+          stride_h, stride_w, dilation_h, dilation_w, out, out_h, out_w);
+      break;
+    default:
+      deconv_plane<0>(in, height, width, w, kernel_h, kernel_w, pad_h, pad_w,
+          stride_h, stride_w, dilation_h, dilation_w, out, out_h, out_w);
+      break;
+  }
+}
+
+// Splits a rank one filter (bilinear ones are) into w[kh][kw] = fh[kh] * fw[kw]
+template <typename Dtype>
+bool factor_filter(const Dtype* w, int kernel_h, int kernel_w, Dtype* fh, Dtype* fw) {
+  int p = 0;
+  float wmax = 0.F;
+  for (int k = 0; k < kernel_h * kernel_w; ++k) {
+    if (std::fabs(static_cast<float>(w[k])) > wmax) {
+      wmax = std::fabs(static_cast<float>(w[k]));
+      p = k;
+    }
+  }
+  if (wmax == 0.F) {
+    return false;
+  }
+  const float pivot = static_cast<float>(w[p]);
+  for (int kh = 0; kh < kernel_h; ++kh) {
+    fh[kh] = w[kh * kernel_w + p % kernel_w];
+  }
+  for (int kw = 0; kw < kernel_w; ++kw) {
+    fw[kw] = Dtype(static_cast<float>(w[(p / kernel_w) * kernel_w + kw]) / pivot);
+  }
+  for (int kh = 0; kh < kernel_h; ++kh) {
+    for (int kw = 0; kw < kernel_w; ++kw) {
+      const float f = static_cast<float>(fh[kh]) * static_cast<float>(fw[kw]);
+      if (std::fabs(static_cast<float>(w[kh * kernel_w + kw]) - f) > 1e-6F * wmax) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
 template <typename Ftype, typename Btype>
 void DeconvolutionLayer<Ftype, Btype>::compute_output_shape() {
   const int* kernel_shape_data = this->kernel_shape_.cpu_data();
@@ -21,13 +123,85 @@ void DeconvolutionLayer<Ftype, Btype>::compute_output_shape() {
   }
 }
 
+template <typename Ftype, typename Btype>
+bool DeconvolutionLayer<Ftype, Btype>::direct_forward_cpu() const {
+  return this->num_spatial_axes_ == 2 && !this->is_1x1_ &&
+      this->channels_ / this->group_ <= kDirectMaxGroupChannels;
+}
+
+template <typename Ftype, typename Btype>
+void DeconvolutionLayer<Ftype, Btype>::ForwardDirect_cpu(const Ftype* bottom_data,
+      const Ftype* weight, const Ftype* bias, Ftype* top_data) {
+  const int* kernel = this->kernel_shape_.cpu_data();
+  const int* stride = this->stride_.cpu_data();
+  const int* pad = this->pad_.cpu_data();
+  const int* dilation = this->dilation_.cpu_data();
+  const int height = this->input_shape(1);
+  const int width = this->input_shape(2);
+  const int out_h = this->output_shape_[0];
+  const int out_w = this->output_shape_[1];
+  const int in_group = this->channels_ / this->group_;
+  const int out_group = this->num_output_ / this->group_;
+  const bool depthwise = in_group == 1 && out_group == 1;
+  const int kernel_size = kernel[0] * kernel[1];
+  const size_t in_dim = static_cast<size_t>(height) * width;
+  const size_t out_dim = static_cast<size_t>(out_h) * out_w;
+  // One task per image and output channel, each owns its output plane
+  const int planes = this->num_ * this->num_output_;
+  std::atomic<int> next_plane(0);
+  auto worker = [&]() {
+    vector<Ftype> fh(kernel[0]), fw(kernel[1]), rows;
+    for (int t = next_plane++; t < planes; t = next_plane++) {
+      const int n = t / this->num_output_;
+      const int c = t % this->num_output_;
+      const int g = c / out_group;
+      Ftype* out = top_data + t * out_dim;
+      caffe_set(static_cast<int>(out_dim), bias ? bias[c] : TypedConsts<Ftype>::zero, out);
+      for (int ic = g * in_group; ic < (g + 1) * in_group; ++ic) {
+        const Ftype* in = bottom_data + (static_cast<size_t>(n) * this->channels_ + ic) * in_dim;
+        const Ftype* w = weight + (ic * out_group + c % out_group) * kernel_size;
+        if (depthwise && factor_filter(w, kernel[0], kernel[1], fh.data(), fw.data())) {
+          // Along the rows into height x out_w, then along the columns
+          rows.assign(static_cast<size_t>(height) * out_w, TypedConsts<Ftype>::zero);
+          deconv_plane(in, height, width, fw.data(), 1, kernel[1], 0, pad[1],
+              1, stride[1], 1, dilation[1], rows.data(), height, out_w);
+          deconv_plane(rows.data(), height, out_w, fh.data(), kernel[0], 1, pad[0], 0,
+              stride[0], 1, dilation[0], 1, out, out_h, out_w);
+        } else {
+          deconv_plane(in, height, width, w, kernel[0], kernel[1], pad[0], pad[1],
+              stride[0], stride[1], dilation[0], dilation[1], out, out_h, out_w);
+        }
+      }
+    }
+  };
+  const size_t work = static_cast<size_t>(planes) * in_group * kernel_size * in_dim;
+  const int threads = static_cast<int>(std::min<size_t>({
+      std::max(1U, std::thread::hardware_concurrency()),
+      static_cast<size_t>(planes),
+      std::max(1UL, work / kMinWorkPerThread)}));
+  vector<std::thread> pool;
+  for (int i = 1; i < threads; ++i) {
+    pool.emplace_back(worker);
+  }
+  worker();
+  for (std::thread& t : pool) {
+    t.join();
+  }
+}
+
 template <typename Ftype, typename Btype>
 void DeconvolutionLayer<Ftype, Btype>::Forward_cpu(const vector<Blob*>& bottom,
       const vector<Blob*>& top) {
   const Ftype* weight = this->blobs_[0]->template cpu_data<Ftype>();
+  const bool direct = direct_forward_cpu();
   for (int i = 0; i < bottom.size(); ++i) {
     const Ftype* bottom_data = bottom[i]->cpu_data<Ftype>();
     Ftype* top_data = top[i]->mutable_cpu_data<Ftype>();
+    if (direct) {
+      ForwardDirect_cpu(bottom_data, weight, this->bias_term_ ?
+          this->blobs_[1]->template cpu_data<Ftype>() : nullptr, top_data);
+      continue;
+    }
     for (int n = 0; n < this->num_; ++n) {
       this->backward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
           top_data + n * this->top_dim_);
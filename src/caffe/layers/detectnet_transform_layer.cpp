@@ -8,8 +8,10 @@
 #include <boost/static_assert.hpp>
 
 #include <algorithm>
+#include <atomic>
 #include <functional>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "caffe/util/detectnet_coverage.hpp"
@@ -300,6 +302,30 @@ Dtype DetectNetTransformationLayer<Dtype>::randDouble() {
 }
 
 
+template<typename Dtype>
+void DetectNetTransformationLayer<Dtype>::for_each_image(
+    int image_count,
+    const std::function<void(int)>& fn
+) const {
+  std::atomic<int> next_image(0);
+  auto worker = [&]() {
+    for (int i = next_image++; i < image_count; i = next_image++) {
+      fn(i);
+    }
+  };
+  const int num_workers = std::min<int>(image_count,
+      std::max(1U, a_param_.transform_threads()));
+  vector<std::thread> workers;
+  for (int i = 1; i < num_workers; ++i) {
+    workers.emplace_back(worker);
+  }
+  worker();
+  for (std::thread& t : workers) {
+    t.join();
+  }
+}
+
+
 template<typename Dtype>
 void DetectNetTransformationLayer<Dtype>::Forward_cpu(
     const vector<Blob*>& bottom,
@@ -311,28 +337,34 @@ void DetectNetTransformationLayer<Dtype>::Forward_cpu(
   const int label_count = bottom[1]->num();
   CHECK_EQ(image_count, label_count);
 
-  const vector<Mat3v> inputImages = blobToMats(*bottom[0]);
+  const Size2i input_size(bottom[0]->width(), bottom[0]->height());
   const vector<vector<BboxLabel > > labels = blobToLabels(*bottom[1]);
 
-  vector<Mat3v> outputImages(inputImages.size());
-  Blob& outputLabels = *top[1];
-
-  for (size_t iImage = 0; iImage != inputImages.size(); ++iImage) {
-    const Mat3v& inputImage = inputImages[iImage];
-    const vector<BboxLabel >& inputLabel = labels[iImage];
-
-    Mat3v& outputImage = outputImages[iImage];
-    Dtype* outputLabel = &outputLabels.mutable_cpu_data<Dtype>()[
-        outputLabels.offset(iImage, 0, 0, 0)
-    ];
-
-    AugmentSelection as = get_augmentations(inputImage.size());
-
-    outputImage = transform_image_cpu(inputImage, as);
-    transform_label_cpu(inputLabel, outputLabel, as, inputImage.size());
+  // Augmentations are drawn in image order, so they don't depend on the
+  //  number of threads
+  vector<AugmentSelection> augmentations;
+  augmentations.reserve(image_count);
+  for (int iImage = 0; iImage != image_count; ++iImage) {
+    augmentations.push_back(get_augmentations(input_size));
   }
-  // emplace images in output image blob:
-  matsToBlob(outputImages, top[0]);
+
+  // Blob memory is synced here, workers only touch disjoint raw slices
+  const Dtype* input_data = bottom[0]->cpu_data<Dtype>();
+  Dtype* output_data = top[0]->mutable_cpu_data<Dtype>();
+  Dtype* output_labels = top[1]->mutable_cpu_data<Dtype>();
+  const int input_dim = bottom[0]->count(1);
+  const int output_dim = top[0]->count(1);
+  const int label_dim = top[1]->count(1);
+
+  for_each_image(image_count, [&](int iImage) {
+    const AugmentSelection& as = augmentations[iImage];
+    const Mat3v inputImage =
+        dataToMat(input_data + iImage * input_dim, input_size);
+    matToBlob(transform_image_cpu(inputImage, as),
+        output_data + iImage * output_dim);
+    transform_label_cpu(labels[iImage], output_labels + iImage * label_dim,
+        as, input_size);
+  });
 }
 
 template<typename Dtype>
@@ -415,14 +415,12 @@ void DetectNetTransformationLayer<Dtype>::Forward_gpu(
 
   // Use CPU to transform labels
   const vector<vector<BboxLabel> > list_list_bboxes = blobToLabels(*bottom[1]);
-  for (size_t i = 0; i < bottom[1]->num(); i++) {
-    const vector<BboxLabel>& list_bboxes = list_list_bboxes[i];
-    Dtype* output_label = &top[1]->mutable_cpu_data<Dtype>()[
-      top[1]->offset(i, 0, 0, 0)
-      ];
-    transform_label_cpu(list_bboxes, output_label, augmentations[i],
-        cv::Size(bottom_shape.x, bottom_shape.y));
-  }
+  Dtype* output_labels = top[1]->mutable_cpu_data<Dtype>();
+  const int label_dim = top[1]->count(1);
+  for_each_image(bottom[1]->num(), [&](int i) {
+    transform_label_cpu(list_list_bboxes[i], output_labels + i * label_dim,
+        augmentations[i], cv::Size(bottom_shape.x, bottom_shape.y));
+  });
 }
 
 
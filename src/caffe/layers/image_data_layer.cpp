@@ -1,10 +1,13 @@
 #include <opencv2/core/core.hpp>
 
+#include <algorithm>
 #include <fstream>  // NOLINT(readability/streams)
 #include <iostream>  // NOLINT(readability/streams)
+#include <iterator>
 
 #include "caffe/solver.hpp"
 #include "caffe/layers/image_data_layer.hpp"
+#include "caffe/util/image_cache.hpp"
 #include "caffe/util/rng.hpp"
 #include "caffe/parallel.hpp"
 
@@ -13,6 +16,31 @@
 namespace caffe {
 
 static std::mutex idl_mutex_;
+static std::mutex cache_progress_mutex_;
+
+static int round_up(int v, int granularity) {
+  return (v + granularity - 1) / granularity * granularity;
+}
+
+// Copies HWC image of height x width into zeroed H x W destination
+template <typename Dtype>
+static void copy_padded(const Dtype* src, int channels, int height, int width,
+    int H, int W, bool chw, Dtype* dst) {
+  if (!chw) {
+    for (int h = 0; h < height; ++h) {
+      std::copy(src + h * width * channels, src + (h + 1) * width * channels,
+          dst + h * W * channels);
+    }
+    return;
+  }
+  for (int h = 0; h < height; ++h) {
+    for (int w = 0; w < width; ++w) {
+      for (int c = 0; c < channels; ++c) {
+        dst[(c * H + h) * W + w] = *src++;
+      }
+    }
+  }
+}
 
 static size_t idl_id(const string& ph, const string& name) {
   std::lock_guard<std::mutex> lock(idl_mutex_);
@@ -38,6 +66,9 @@ ImageDataLayer<Ftype, Btype>::ImageDataLayer(const LayerParameter& param, size_t
              << " name: " << this->name()
              << " id: " << id_
              << " threads: " << this->threads_num();
+  if (param.image_data_param().cache()) {
+    ImageCache::Get().Reserve(static_cast<size_t>(param.image_data_param().cache_size_mb()) << 20);
+  }
 }
 
 template <typename Ftype, typename Btype>
@@ -106,6 +137,11 @@ void ImageDataLayer<Ftype, Btype>::DataLayerSetUp(const vector<Blob*>& bottom,
         this->threads_num() + i + skip;
   }
 
+  if (image_data_param.read_ahead() > 0U) {
+    read_ahead_.reset(new FileReadAhead(image_data_param.read_ahead_threads(),
+        2UL * image_data_param.read_ahead() * this->threads_num()));
+  }
+
   // Read an image, and use it to initialize the top blob.
   const string& file_name = lines_[id_][line_ids_[0]].first;
   bool from_cache = false;
@@ -122,6 +158,13 @@ void ImageDataLayer<Ftype, Btype>::DataLayerSetUp(const vector<Blob*>& bottom,
                          << "' as a model, w=" << cv_img.rows << ", h=" << cv_img.cols;
     crop_height = cv_img.rows;
     crop_width = cv_img.cols;
+    if (image_data_param.bucket_granularity() > 0U) {
+      const int granularity = image_data_param.bucket_granularity();
+      crop_height = round_up(crop_height, granularity);
+      crop_width = round_up(crop_width, granularity);
+      buckets_.resize(this->threads_num());
+      bucketed_num_.resize(this->threads_num(), 0UL);
+    }
   }
   vector<int> top_shape { batch_size, cv_img.channels(), crop_height, crop_width };
   top[0]->Reshape(top_shape);
@@ -150,17 +193,200 @@ cv::Mat ImageDataLayer<Ftype, Btype>::next_mat(const string& root_folder, const
                                                int height, int width,
                                                bool is_color, int short_side, bool& from_cache) {
   from_cache = false;
-  if (this->layer_param_.image_data_param().cache()) {
-    std::lock_guard<std::mutex> lock(cache_mutex_[id_]);
-    if (cache_[id_].size() > 0) {
-      auto it = cache_[id_].find(file_name);
-      if (it != cache_[id_].end()) {
-        from_cache = true;
-        return it->second;
+  const ImageDataParameter& image_data_param = this->layer_param_.image_data_param();
+  const string path = root_folder + file_name;
+  string key;
+  cv::Mat cv_img;
+  if (image_data_param.cache()) {
+    key = ImageCacheKey(path, height, width, is_color, short_side);
+    if (ImageCache::Get().Lookup(key, &cv_img)) {
+      from_cache = true;
+      return cv_img;
+    }
+  }
+  string content;
+  if (read_ahead_ && read_ahead_->Take(path, &content)) {
+    cv_img = DecodeImageToCVMat(content, path, height, width, is_color, short_side);
+  } else {
+    cv_img = ReadImageToCVMat(path, height, width, is_color, short_side);
+  }
+  if (image_data_param.cache() && cv_img.data != nullptr) {
+    ImageCache::Get().Insert(key, cv_img, image_data_param.cache_format(),
+        image_data_param.cache_jpeg_quality());
+  }
+  return cv_img;
+}
+
+template<typename Ftype, typename Btype>
+void ImageDataLayer<Ftype, Btype>::read_ahead(size_t first, size_t step, size_t count) {
+  const ImageDataParameter& image_data_param = this->layer_param_.image_data_param();
+  const string& root_folder = image_data_param.root_folder();
+  const size_t lines_size = lines_[id_].size();
+  for (size_t i = 0UL; i < count; ++i) {
+    const string path = root_folder + lines_[id_][(first + i * step) % lines_size].first;
+    // No I/O for images we are not going to decode
+    if (image_data_param.cache() && ImageCache::Get().Contains(ImageCacheKey(path,
+        image_data_param.new_height(), image_data_param.new_width(),
+        image_data_param.is_color(), image_data_param.short_side()))) {
+      continue;
+    }
+    read_ahead_->Request(path);
+  }
+}
+
+template <typename Ftype, typename Btype>
+void ImageDataLayer<Ftype, Btype>::count_cached(bool loaded, size_t lines_size) {
+  // Progress of the first pass only, misses are cached by next_mat
+  std::lock_guard<std::mutex> lock(cache_progress_mutex_);
+  if (loaded) {
+    ++cached_num_[id_];
+  } else {
+    ++failed_num_[id_];
+  }
+  if (cached_num_[id_] + failed_num_[id_] >= lines_size) {
+    cached_[id_] = true;
+    const ImageCache::Stats stats = ImageCache::Get().stats();
+    LOG_IF(INFO, P2PManager::global_rank() == 0) << cached_num_[id_]
+              << " objects read for " << Phase_Name(this->phase_)
+              << " by layer " << this->name() << ", image cache holds " << stats.entries
+              << " objects, " << (stats.bytes >> 20) << " of " << (stats.budget >> 20)
+              << " MB, " << stats.evictions << " evicted";
+  } else if ((float) cached_num_[id_] / lines_size >=
+      cache_progress_[id_] + IDL_CACHE_PROGRESS) {
+    cache_progress_[id_] = (float) cached_num_[id_] / lines_size;
+    LOG_IF(INFO, P2PManager::global_rank() == 0)     << this->print_current_device() << " "
+              << std::setw(2) << std::setfill(' ') << f_round1(cache_progress_[id_] * 100.F)
+              << "% of objects cached for "
+              << Phase_Name(this->phase_) << " by layer '" << this->name() << "' ("
+              << cached_num_[id_] << "/" << lines_size << ")";
+  }
+}
+
+template <typename Ftype, typename Btype>
+void ImageDataLayer<Ftype, Btype>::next_line(int thread_id) {
+  const ImageDataParameter& image_data_param = this->layer_param_.image_data_param();
+  const size_t line_bucket = Caffe::device_in_use_per_host_count() * this->threads_num();
+  const size_t lines_size = lines_[id_].size();
+  line_ids_[thread_id] += line_bucket;
+  if (line_ids_[thread_id] >= lines_size) {
+    while (line_ids_[thread_id] >= lines_size) {
+      line_ids_[thread_id] -= lines_size;
+    }
+    if (thread_id == 0 &&
+        this->rank_ % Caffe::device_in_use_per_host_count() == 0) {
+      if (this->phase_ == TRAIN) {
+        // We have reached the end. Restart from the first.
+        LOG_IF(INFO, P2PManager::global_rank() == 0)
+        << this->print_current_device() << " Restarting data prefetching (" << lines_size << ")";
+        if (epoch_count_ == 0UL) {
+          epoch_count_ += std::lround(lines_[id_].size()
+              * image_data_param.dataset_share_per_node());
+          Caffe::report_epoch_count(epoch_count_);
+        }
+      }
+      if (image_data_param.shuffle()) {
+        LOG_IF(INFO, P2PManager::global_rank() == 0) << "Shuffling data";
+        ShuffleImages();
+      }
+    }
+  }
+}
+
+template <typename Ftype, typename Btype>
+bool ImageDataLayer<Ftype, Btype>::load_bucketed_batch(Batch* batch, int thread_id) {
+  const ImageDataParameter& image_data_param = this->layer_param_.image_data_param();
+  const int batch_size = image_data_param.batch_size();
+  const int granularity = image_data_param.bucket_granularity();
+  const size_t max_pending = image_data_param.bucket_max_pending() > 0U ?
+      std::max<size_t>(image_data_param.bucket_max_pending(), batch_size) : 4UL * batch_size;
+  const size_t line_bucket = Caffe::device_in_use_per_host_count() * this->threads_num();
+  const size_t lines_size = lines_[id_].size();
+  const size_t ahead = image_data_param.read_ahead();
+  Buckets& buckets = buckets_[thread_id];
+  size_t& pending = bucketed_num_[thread_id];
+
+  if (read_ahead_) {
+    read_ahead(line_ids_[thread_id], line_bucket, ahead + 1UL);
+  }
+  auto fullest = buckets.end();
+  while (true) {
+    fullest = buckets.end();
+    for (auto it = buckets.begin(); it != buckets.end(); ++it) {
+      if (fullest == buckets.end() || it->second.size() > fullest->second.size()) {
+        fullest = it;
       }
     }
+    if (fullest != buckets.end() && (fullest->second.size() >= (size_t) batch_size ||
+        pending >= max_pending)) {
+      break;
+    }
+    const size_t line_id = line_ids_[thread_id];
+    if (read_ahead_) {
+      read_ahead(line_id + ahead * line_bucket, line_bucket, 1UL);
+    }
+    bool from_cache = false;
+    cv::Mat cv_img = next_mat(image_data_param.root_folder(), lines_[id_][line_id].first,
+        image_data_param.new_height(), image_data_param.new_width(),
+        image_data_param.is_color(), image_data_param.short_side(), from_cache);
+    if (image_data_param.cache() && !cached_[id_] && !from_cache) {
+      count_cached(cv_img.data != nullptr, lines_size);
+    }
+    CHECK(cv_img.data) << "Could not load " << image_data_param.root_folder()
+                       << lines_[id_][line_id].first;
+    buckets[std::make_pair(round_up(cv_img.rows, granularity),
+        round_up(cv_img.cols, granularity))].emplace_back(cv_img, lines_[id_][line_id].second);
+    ++pending;
+    next_line(thread_id);
+  }
+
+  // The fullest bucket, topped up from the next fullest ones when short
+  vector<std::pair<cv::Mat, int>> items;
+  int height = 0, width = 0;
+  while (items.size() < (size_t) batch_size && fullest != buckets.end()) {
+    vector<std::pair<cv::Mat, int>>& bucket = fullest->second;
+    const size_t n = std::min(bucket.size(), batch_size - items.size());
+    std::move(bucket.end() - n, bucket.end(), std::back_inserter(items));
+    bucket.resize(bucket.size() - n);
+    pending -= n;
+    height = std::max(height, fullest->first.first);
+    width = std::max(width, fullest->first.second);
+    if (bucket.empty()) {
+      buckets.erase(fullest);
+    }
+    fullest = buckets.end();
+    for (auto it = buckets.begin(); it != buckets.end(); ++it) {
+      if (fullest == buckets.end() || it->second.size() > fullest->second.size()) {
+        fullest = it;
+      }
+    }
+  }
+  CHECK_EQ(items.size(), (size_t) batch_size);
+
+  const int channels = items[0].first.channels();
+  vector<int> top_shape { batch_size, channels, height, width };
+  batch->data_->Reshape(top_shape);
+  batch->label_->Reshape(vector<int>(1, batch_size));
+  Btype* prefetch_data = batch->data_->mutable_cpu_data<Btype>();
+  Btype* prefetch_label = batch->label_->mutable_cpu_data<Btype>();
+  std::fill(prefetch_data, prefetch_data + batch->data_->count(), Btype(0));
+#if defined(USE_CUDNN)
+  const Packing packing = NHWC;
+#else
+  const Packing packing = NCHW;
+#endif
+  vector<Btype> tmp;
+  for (int item_id = 0; item_id < batch_size; ++item_id) {
+    const cv::Mat& cv_img = items[item_id].first;
+    CHECK_EQ(channels, cv_img.channels());
+    tmp.resize(cv_img.total() * channels);
+    this->bdt(thread_id)->Transform(cv_img, tmp.data(), tmp.size(), false);
+    copy_padded(tmp.data(), channels, cv_img.rows, cv_img.cols, height, width,
+        packing == NCHW, prefetch_data + batch->data_->offset(item_id));
+    prefetch_label[item_id] = items[item_id].second;
   }
-  return ReadImageToCVMat(root_folder + file_name, height, width, is_color, short_side);
+  batch->set_data_packing(packing);
+  batch->set_id(this->batch_id(thread_id));
+  return cached_[id_];
 }
 
 template <typename Ftype, typename Btype>
@@ -174,13 +400,19 @@ bool ImageDataLayer<Ftype, Btype>::load_batch(Batch* batch, int thread_id, size_
   const int crop = this->layer_param_.transform_param().crop_size();
   const bool is_color = image_data_param.is_color();
   const bool cache_on = image_data_param.cache();
-  const bool shuffle = image_data_param.shuffle();
   const string& root_folder = image_data_param.root_folder();
-  unordered_map<std::string, cv::Mat>& cache = cache_[id_];
+  if (crop <= 0 && image_data_param.bucket_granularity() > 0U) {
+    return load_bucketed_batch(batch, thread_id);
+  }
 
   size_t line_id = line_ids_[thread_id];
   const size_t line_bucket = Caffe::device_in_use_per_host_count() * this->threads_num();
   const size_t lines_size = lines_[id_].size();
+  const size_t ahead = image_data_param.read_ahead();
+  if (read_ahead_) {
+    // Lines this thread is going to load next, possibly reshuffled meanwhile
+    read_ahead(line_id, line_bucket, ahead + 1UL);
+  }
   // Reshape according to the first image of each batch
   // on single input batches allows for inputs of varying dimension.
   const string& file_name = lines_[id_][line_id].first;
@@ -213,6 +445,9 @@ bool ImageDataLayer<Ftype, Btype>::load_batch(Batch* batch, int thread_id, size_
   const size_t buf_len = batch->data_->offset(1);
   for (int item_id = 0; item_id < batch_size; ++item_id) {
     CHECK_GT(lines_size, line_id);
+    if (read_ahead_) {
+      read_ahead(line_id + ahead * line_bucket, line_bucket, 1UL);
+    }
     const string& file_name = lines_[id_][line_id].first;
     from_cache = false;
     cv::Mat cv_img = next_mat(root_folder, file_name, new_height, new_width, is_color, short_side,
@@ -231,58 +466,9 @@ bool ImageDataLayer<Ftype, Btype>::load_batch(Batch* batch, int thread_id, size_
       prefetch_label[item_id] = lines_[id_][line_id].second;
     }
     if (cache_on && !cached_[id_] && !from_cache) {
-      std::lock_guard<std::mutex> lock(cache_mutex_[id_]);
-      if (cv_img.data != nullptr) {
-        auto em = cache.emplace(file_name, cv_img);
-        if (em.second) {
-          ++cached_num_[id_];
-        } else {
-          DLOG(WARNING) << this->print_current_device()
-                        << " Duplicate @ " << line_id << " " << file_name;
-        }
-      } else {
-        ++failed_num_[id_];
-      }
-      if (cached_num_[id_] + failed_num_[id_] >= lines_size) {
-        cached_[id_] = true;
-        LOG_IF(INFO, P2PManager::global_rank() == 0) << cache.size()
-                  << " objects cached for " << Phase_Name(this->phase_)
-                  << " by layer " << this->name();
-      } else if ((float) cached_num_[id_] / lines_size >=
-          cache_progress_[id_] + IDL_CACHE_PROGRESS) {
-        cache_progress_[id_] = (float) cached_num_[id_] / lines_size;
-        LOG_IF(INFO, P2PManager::global_rank() == 0)     << this->print_current_device() << " "
-                  << std::setw(2) << std::setfill(' ') << f_round1(cache_progress_[id_] * 100.F)
-                  << "% of objects cached for "
-                  << Phase_Name(this->phase_) << " by layer '" << this->name() << "' ("
-                  << cached_num_[id_] << "/" << lines_size << ")";
-      }
-    }
-
-    // go to the next iter
-    line_ids_[thread_id] += line_bucket;
-    if (line_ids_[thread_id] >= lines_size) {
-      while (line_ids_[thread_id] >= lines_size) {
-        line_ids_[thread_id] -= lines_size;
-      }
-      if (thread_id == 0 &&
-          this->rank_ % Caffe::device_in_use_per_host_count() == 0) {
-        if (this->phase_ == TRAIN) {
-          // We have reached the end. Restart from the first.
-          LOG_IF(INFO, P2PManager::global_rank() == 0)
-          << this->print_current_device() << " Restarting data prefetching (" << lines_size << ")";
-          if (epoch_count_ == 0UL) {
-            epoch_count_ += std::lround(lines_[id_].size()
-                * image_data_param.dataset_share_per_node());
-            Caffe::report_epoch_count(epoch_count_);
-          }
-        }
-        if (shuffle) {
-          LOG_IF(INFO, P2PManager::global_rank() == 0) << "Shuffling data";
-          ShuffleImages();
-        }
-      }
+      count_cached(cv_img.data != nullptr, lines_size);
     }
+    next_line(thread_id);
     line_id = line_ids_[thread_id];
   }
   batch->set_data_packing(packing);
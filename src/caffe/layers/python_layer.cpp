@@ -50,5 +50,50 @@ void PyErrReportAndForward() {
   bp::throw_error_already_set();
 }
 
+PythonPrefetcher::PythonPrefetcher(const bp::object& layer, size_t batches, Type dtype,
+    size_t tops)
+    : InternalThread(Caffe::device(), 0UL, 1UL, false, "PythonPrefetcher"),
+      layer_(layer),
+      tops_(tops) {
+  for (size_t i = 0; i < batches; ++i) {
+    free_.push(make_shared<Batch>(dtype, dtype));
+  }
+}
+
+PythonPrefetcher::~PythonPrefetcher() {
+  // The thread might be waiting for the GIL held by whoever destroys the net
+  if (PyGILState_Check()) {
+    PyGILRelease gil;
+    StopInternalThread();
+  } else {
+    StopInternalThread();
+  }
+}
+
+void PythonPrefetcher::InternalThreadEntry() {
+  const vector<Blob*> bottom;
+  try {
+    while (!must_stop(0)) {
+      shared_ptr<Batch> batch = free_.pop();
+      vector<Blob*> top(1, batch->data_.get());
+      if (tops_ > 1UL) {
+        top.push_back(batch->label_.get());
+      }
+      {
+        PyGILAquire pgil;
+        try {
+          layer_.attr("reshape")(bottom, top);
+          layer_.attr("forward")(bottom, top);
+        } catch (...) {
+          PyErrFatal();
+        }
+      }
+      full_.push(batch);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
 }
 #endif
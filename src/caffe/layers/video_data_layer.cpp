@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <algorithm>
 #include <csignal>
+#include <fstream>  // NOLINT(readability/streams)
 #include <map>
 #include <string>
 #include <vector>
@@ -21,9 +22,6 @@ VideoDataLayer<Ftype, Btype>::VideoDataLayer(const LayerParameter& param, size_t
 template <typename Ftype, typename Btype>
 VideoDataLayer<Ftype, Btype>::~VideoDataLayer() {
   this->StopInternalThread();
-  if (cap_.isOpened()) {
-    cap_.release();
-  }
 }
 
 template <typename Ftype, typename Btype>
@@ -32,37 +30,33 @@ void VideoDataLayer<Ftype, Btype>::DataLayerSetUp(
   const int batch_size = this->layer_param_.data_param().batch_size();
   const VideoDataParameter& video_data_param =
       this->layer_param_.video_data_param();
-  video_type_ = video_data_param.video_type();
-  skip_frames_ = video_data_param.skip_frames();
-  CHECK_GE(skip_frames_, 0);
-  TBlob<Btype> transformed_datum;
-  // Read an image, and use it to initialize the top blob.
-  cv::Mat cv_img;
-  if (video_type_ == VideoDataParameter_VideoType_WEBCAM) {
-    const int device_id = video_data_param.device_id();
-    if (!cap_.open(device_id)) {
-      LOG(FATAL) << "Failed to open webcam: " << device_id;
-    }
-    cap_ >> cv_img;
-  } else if (video_type_ == VideoDataParameter_VideoType_VIDEO) {
-    CHECK(video_data_param.has_video_file()) << "Must provide video file!";
-    const string& video_file = video_data_param.video_file();
-    if (!cap_.open(video_file)) {
-      LOG(FATAL) << "Failed to open video: " << video_file;
+  vector<VideoReader::Source> sources;
+  if (video_data_param.video_type() == VideoDataParameter_VideoType_WEBCAM) {
+    sources.emplace_back(string(), 0);
+  } else if (video_data_param.video_type() == VideoDataParameter_VideoType_VIDEO) {
+    if (video_data_param.has_video_list()) {
+      std::ifstream infile(video_data_param.video_list().c_str());
+      CHECK(infile.good()) << "Failed to open video list " << video_data_param.video_list();
+      string path;
+      int label;
+      while (infile >> path >> label) {
+        sources.emplace_back(path, label);
+      }
+    } else {
+      CHECK(video_data_param.has_video_file()) << "Must provide video file!";
+      sources.emplace_back(video_data_param.video_file(), 0);
     }
-    total_frames_ = cap_.get(cv::CAP_PROP_FRAME_COUNT);
-    processed_frames_ = 0;
-    // Read image to infer shape.
-    cap_ >> cv_img;
-    // Set index back to the first frame.
-    cap_.set(cv::CAP_PROP_POS_FRAMES, 0);
   } else {
     LOG(FATAL) << "Unknow video type!";
   }
-  CHECK(cv_img.data) << "Could not load image!";
-  // Use data_transformer to infer the expected blob shape from a cv_image.
-  top_shape_ = this->bdt(0)->InferBlobShape(cv_img);
-  transformed_datum.Reshape(top_shape_);
+  reader_.reset(new VideoReader(video_data_param, sources, this->rank_));
+  CHECK_EQ(batch_size % reader_->clip_length(), 0)
+      << "batch_size must be a multiple of clip_length";
+  reader_->StartInternalThread();
+  // Use the first decoded frame to infer the expected blob shape.
+  shared_ptr<VideoClip> clip = reader_->peek_full();
+  CHECK(clip && clip->frames[0].data) << "Could not load image!";
+  top_shape_ = this->bdt(0)->InferBlobShape(clip->frames[0]);
   top_shape_[0] = batch_size;
   top[0]->Reshape(top_shape_);
   vector<int> label_shape(1, batch_size);
@@ -87,14 +81,13 @@ bool VideoDataLayer<Ftype, Btype>::load_batch(Batch* batch, int thread_id, size_
   CHECK(batch->data_->count());
   TBlob<Btype> transformed_datum;
 
-  // Reshape according to the first anno_datum of each batch
-  // on single input batches allows for inputs of varying dimension.
   const int batch_size = this->layer_param_.data_param().batch_size();
-  top_shape_[0] = 1;
-  transformed_datum.Reshape(top_shape_);
+  vector<int> shape = top_shape_;
+  shape[0] = 1;
+  transformed_datum.Reshape(shape);
   // Reshape batch according to the batch_size.
-  top_shape_[0] = batch_size;
-  batch->data_->Reshape(top_shape_);
+  shape[0] = batch_size;
+  batch->data_->Reshape(shape);
 
   Ftype* top_data = batch->data_->mutable_cpu_data<Ftype>();
   Ftype* top_label = NULL;  // suppress warnings about uninitialized variables
@@ -102,53 +95,41 @@ bool VideoDataLayer<Ftype, Btype>::load_batch(Batch* batch, int thread_id, size_
     top_label = batch->label_->mutable_cpu_data<Ftype>();
   }
 
-  int skip_frames = skip_frames_;
-  for (int item_id = 0; item_id < batch_size; ++item_id) {
+  int item_id = 0;
+  while (item_id < batch_size) {
     timer.Start();
-    cv::Mat cv_img;
-    if (video_type_ == VideoDataParameter_VideoType_WEBCAM) {
-      cap_ >> cv_img;
-    } else if (video_type_ == VideoDataParameter_VideoType_VIDEO) {
-      if (processed_frames_ >= total_frames_) {
-        LOG(INFO) << "Finished processing video.";
-        raise(SIGINT);
+    shared_ptr<VideoClip> clip = reader_->pop_full();
+    read_time += timer.MicroSeconds();
+    if (!clip) {
+      LOG(INFO) << "Finished processing video.";
+      raise(SIGINT);
+      // Zero filled tail, the solver stops after this iteration
+      const int offset = batch->data_->offset(item_id);
+      caffe_set(batch->data_->count() - offset, Ftype(0), top_data + offset);
+      for (; this->output_labels_ && item_id < batch_size; ++item_id) {
+        top_label[item_id] = 0;
       }
-      ++processed_frames_;
-      cap_ >> cv_img;
-    } else {
-      LOG(FATAL) << "Unknown video type.";
+      break;
     }
-    CHECK(cv_img.data) << "Could not load image!";
-    read_time += timer.MicroSeconds();
-    if (skip_frames > 0) {
-      --skip_frames;
-      --item_id;
-    } else {
-      skip_frames = skip_frames_;
-      timer.Start();
+    timer.Start();
+    for (const cv::Mat& cv_img : clip->frames) {
       // Apply transformations (mirror, crop...) to the image
       int offset = batch->data_->offset(item_id);
       transformed_datum.set_cpu_data(top_data + offset);
-      this->bdt(0)->Transform(cv_img, &(transformed_datum));
-      trans_time += timer.MicroSeconds();
+      this->bdt(thread_id)->Transform(cv_img, &(transformed_datum));
+      if (this->output_labels_) {
+        top_label[item_id] = clip->label;
+      }
+      ++item_id;
     }
-    CHECK(cv_img.data) << "Could not load image!";
-    read_time += timer.MicroSeconds();
-    timer.Start();
-    // Apply transformations (mirror, crop...) to the image
-    int offset = batch->data_->offset(item_id);
-    transformed_datum.set_cpu_data(top_data + offset);
-    this->bdt(0)->Transform(cv_img, &(transformed_datum));
     trans_time += timer.MicroSeconds();
-    if (this->output_labels_) {
-      top_label[item_id] = 0;
-    }
+    reader_->push_free(clip);
   }
-  timer.Stop();
   batch_timer.Stop();
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+  batch->set_id(this->batch_id(thread_id));
   return true;
 }
 
@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <atomic>
 #include <map>
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
@@ -9,6 +10,7 @@
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/layers/window_data_layer.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/image_cache.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/rng.hpp"
 
@@ -54,6 +56,10 @@ void WindowDataLayer<Ftype, Btype>::DataLayerSetUp(const vector<Blob*>& bottom,
       << this->layer_param_.window_data_param().root_folder();
 
   cache_images_ = this->layer_param_.window_data_param().cache_images();
+  if (this->layer_param_.window_data_param().cache_decoded()) {
+    ImageCache::Get().Reserve(
+        static_cast<size_t>(this->layer_param_.window_data_param().decoded_cache_mb()) << 20);
+  }
   string root_folder = this->layer_param_.window_data_param().root_folder();
 
   const bool prefetch_needs_rand =
@@ -172,6 +178,15 @@ void WindowDataLayer<Ftype, Btype>::DataLayerSetUp(const vector<Blob*>& bottom,
   top[1]->Reshape(label_shape_);
   this->batch_transformer_->reshape(top[0]->shape(), label_shape_);
 
+  const unsigned int crop_threads = this->layer_param_.window_data_param().crop_threads();
+  crop_pools_.clear();
+  crop_pools_.resize(this->transf_num_);
+  if (crop_threads > 1U) {
+    for (size_t i = 0UL; i < crop_pools_.size(); ++i) {
+      crop_pools_[i].reset(new ThreadPool(crop_threads - 1U));
+    }
+  }
+
   // data mean
   has_mean_file_ = this->transform_param_.has_mean_file();
   has_mean_values_ = this->transform_param_.mean_value_size() > 0;
@@ -208,34 +223,36 @@ unsigned int WindowDataLayer<Ftype, Btype>::PrefetchRand() {
   return (*prefetch_rng)();
 }
 
-// This function is called on prefetch thread
 template <typename Ftype, typename Btype>
-bool WindowDataLayer<Ftype, Btype>::load_batch(Batch* batch,
-    int thread_id, size_t queue_id) {
-  // At each iteration, sample N windows where N*p are foreground (object)
-  // windows and N*(1-p) are background (non-object) windows
-  CPUTimer batch_timer;
-  batch_timer.Start();
-  double read_time = 0;
-  double trans_time = 0;
-  CPUTimer timer;
-  batch->data_->Reshape(data_shape_);
-  batch->label_->Reshape(label_shape_);
-  Ftype* top_data = batch->data_->mutable_cpu_data<Ftype>();
-  Ftype* top_label = batch->label_->mutable_cpu_data<Ftype>();
+cv::Mat WindowDataLayer<Ftype, Btype>::LoadImage(int image_index) const {
+  const WindowDataParameter& window_param = this->layer_param_.window_data_param();
+  const string& path = image_database_[image_index].first;
+  const string key = window_param.cache_decoded() ? ImageCacheKey(path, 0, 0, true, 0) : string();
+  cv::Mat cv_img;
+  if (window_param.cache_decoded() && ImageCache::Get().Lookup(key, &cv_img)) {
+    return cv_img;
+  }
+  if (this->cache_images_) {
+    DecodeDatumToCVMat(image_database_cache_[image_index].second, true, cv_img, false);
+  } else {
+    cv_img = cv::imread(path, cv::IMREAD_COLOR);
+  }
+  if (window_param.cache_decoded() && cv_img.data) {
+    ImageCache::Get().Insert(key, cv_img);
+  }
+  return cv_img;
+}
+
+template <typename Ftype, typename Btype>
+void WindowDataLayer<Ftype, Btype>::WarpWindow(const cv::Mat& cv_img,
+    const vector<float>& window, bool do_mirror, const Ftype* mean, Ftype* top_data) const {
   const Ftype scale = this->layer_param_.window_data_param().scale();
-  const int batch_size = this->layer_param_.window_data_param().batch_size();
   const int context_pad = this->layer_param_.window_data_param().context_pad();
   const int crop_size = this->transform_param_.crop_size();
-  const bool mirror = this->transform_param_.mirror();
-  const float fg_fraction =
-      this->layer_param_.window_data_param().fg_fraction();
-  Ftype* mean = NULL;
   int mean_off = 0;
   int mean_width = 0;
   int mean_height = 0;
   if (this->has_mean_file_) {
-    mean = this->data_mean_.mutable_cpu_data();
     mean_off = (this->data_mean_.width() - crop_size) / 2;
     mean_width = this->data_mean_.width();
     mean_height = this->data_mean_.height();
@@ -244,6 +261,149 @@ bool WindowDataLayer<Ftype, Btype>::load_batch(Batch* batch,
   const string& crop_mode = this->layer_param_.window_data_param().crop_mode();
 
   bool use_square = (crop_mode == "square") ? true : false;
+  const int channels = cv_img.channels();
+
+  // crop window out of image and warp it
+  int x1 = window[WindowDataLayer<Ftype, Btype>::X1];
+  int y1 = window[WindowDataLayer<Ftype, Btype>::Y1];
+  int x2 = window[WindowDataLayer<Ftype, Btype>::X2];
+  int y2 = window[WindowDataLayer<Ftype, Btype>::Y2];
+
+  int pad_w = 0;
+  int pad_h = 0;
+  if (context_pad > 0 || use_square) {
+    // scale factor by which to expand the original region
+    // such that after warping the expanded region to crop_size x crop_size
+    // there's exactly context_pad amount of padding on each side
+    Ftype context_scale = static_cast<Ftype>(crop_size) /
+        static_cast<Ftype>(crop_size - 2*context_pad);
+
+    // compute the expanded region
+    Ftype half_height = static_cast<Ftype>(y2-y1+1)/2.0;
+    Ftype half_width = static_cast<Ftype>(x2-x1+1)/2.0;
+    Ftype center_x = static_cast<Ftype>(x1) + half_width;
+    Ftype center_y = static_cast<Ftype>(y1) + half_height;
+    if (use_square) {
+      if (half_height > half_width) {
+        half_width = half_height;
+      } else {
+        half_height = half_width;
+      }
+    }
+    x1 = static_cast<int>(round(center_x - half_width*context_scale));
+    x2 = static_cast<int>(round(center_x + half_width*context_scale));
+    y1 = static_cast<int>(round(center_y - half_height*context_scale));
+    y2 = static_cast<int>(round(center_y + half_height*context_scale));
+
+    // the expanded region may go outside of the image
+    // so we compute the clipped (expanded) region and keep track of
+    // the extent beyond the image
+    int unclipped_height = y2-y1+1;
+    int unclipped_width = x2-x1+1;
+    int pad_x1 = std::max(0, -x1);
+    int pad_y1 = std::max(0, -y1);
+    int pad_x2 = std::max(0, x2 - cv_img.cols + 1);
+    int pad_y2 = std::max(0, y2 - cv_img.rows + 1);
+    // clip bounds
+    x1 = x1 + pad_x1;
+    x2 = x2 - pad_x2;
+    y1 = y1 + pad_y1;
+    y2 = y2 - pad_y2;
+    CHECK_GT(x1, -1);
+    CHECK_GT(y1, -1);
+    CHECK_LT(x2, cv_img.cols);
+    CHECK_LT(y2, cv_img.rows);
+
+    int clipped_height = y2-y1+1;
+    int clipped_width = x2-x1+1;
+
+    // scale factors that would be used to warp the unclipped
+    // expanded region
+    Ftype scale_x =
+        static_cast<Ftype>(crop_size)/static_cast<Ftype>(unclipped_width);
+    Ftype scale_y =
+        static_cast<Ftype>(crop_size)/static_cast<Ftype>(unclipped_height);
+
+    // size to warp the clipped expanded region to
+    cv_crop_size.width =
+        static_cast<int>(round(static_cast<Ftype>(clipped_width)*scale_x));
+    cv_crop_size.height =
+        static_cast<int>(round(static_cast<Ftype>(clipped_height)*scale_y));
+    pad_x1 = static_cast<int>(round(static_cast<Ftype>(pad_x1)*scale_x));
+    pad_x2 = static_cast<int>(round(static_cast<Ftype>(pad_x2)*scale_x));
+    pad_y1 = static_cast<int>(round(static_cast<Ftype>(pad_y1)*scale_y));
+    pad_y2 = static_cast<int>(round(static_cast<Ftype>(pad_y2)*scale_y));
+
+    pad_h = pad_y1;
+    // if we're mirroring, we mirror the padding too (to be pedantic)
+    if (do_mirror) {
+      pad_w = pad_x2;
+    } else {
+      pad_w = pad_x1;
+    }
+
+    // ensure that the warped, clipped region plus the padding fits in the
+    // crop_size x crop_size image (it might not due to rounding)
+    if (pad_h + cv_crop_size.height > crop_size) {
+      cv_crop_size.height = crop_size - pad_h;
+    }
+    if (pad_w + cv_crop_size.width > crop_size) {
+      cv_crop_size.width = crop_size - pad_w;
+    }
+  }
+
+  cv::Rect roi(x1, y1, x2-x1+1, y2-y1+1);
+  cv::Mat cv_cropped_img;
+  cv::resize(cv_img(roi), cv_cropped_img, cv_crop_size, 0, 0, cv::INTER_LINEAR);
+
+  // horizontal flip at random
+  if (do_mirror) {
+    cv::flip(cv_cropped_img, cv_cropped_img, 1);
+  }
+
+  // copy the warped window into top_data, channel planes row by row so that
+  // the inner loops are contiguous in the destination and get vectorized
+  const float fscale = scale;
+  for (int c = 0; c < channels; ++c) {
+    const float mean_value = this->has_mean_values_ ? this->mean_values_[c] : 0.F;
+    for (int h = 0; h < cv_cropped_img.rows; ++h) {
+      const unsigned char* ptr = cv_cropped_img.ptr<unsigned char>(h) + c;
+      Ftype* dst = top_data + (c * crop_size + h + pad_h) * crop_size + pad_w;
+      if (this->has_mean_file_) {
+        const Ftype* mean_row = mean + (c * mean_height + h + mean_off + pad_h) * mean_width
+            + mean_off + pad_w;
+        for (int w = 0; w < cv_cropped_img.cols; ++w) {
+          dst[w] = static_cast<Ftype>((static_cast<float>(ptr[w * channels]) -
+              static_cast<float>(mean_row[w])) * fscale);
+        }
+      } else {
+        for (int w = 0; w < cv_cropped_img.cols; ++w) {
+          dst[w] = static_cast<Ftype>((static_cast<float>(ptr[w * channels]) - mean_value)
+              * fscale);
+        }
+      }
+    }
+  }
+}
+
+// This function is called on prefetch thread
+template <typename Ftype, typename Btype>
+bool WindowDataLayer<Ftype, Btype>::load_batch(Batch* batch,
+    int thread_id, size_t queue_id) {
+  // At each iteration, sample N windows where N*p are foreground (object)
+  // windows and N*(1-p) are background (non-object) windows
+  CPUTimer batch_timer;
+  batch_timer.Start();
+  batch->data_->Reshape(data_shape_);
+  batch->label_->Reshape(label_shape_);
+  Ftype* top_data = batch->data_->mutable_cpu_data<Ftype>();
+  Ftype* top_label = batch->label_->mutable_cpu_data<Ftype>();
+  const int batch_size = this->layer_param_.window_data_param().batch_size();
+  const bool mirror = this->transform_param_.mirror();
+  const float fg_fraction =
+      this->layer_param_.window_data_param().fg_fraction();
+  const Ftype* mean = this->has_mean_file_ ? this->data_mean_.cpu_data() : nullptr;
+  const size_t item_len = batch->data_->count() / batch_size;
 
   // zero out batch
   caffe_set(batch->data_->count(), Ftype(0), top_data);
@@ -252,206 +412,56 @@ bool WindowDataLayer<Ftype, Btype>::load_batch(Batch* batch,
       * fg_fraction);
   const int num_samples[2] = { batch_size - num_fg, num_fg };
 
+  // Sample windows in the same order as before (the RNG is not shared with
+  // the workers), grouped by image so that each one is decoded once
+  vector<const vector<float>*> windows(batch_size);
+  vector<bool> mirrors(batch_size);
+  std::map<int, vector<int>> image_items;
   int item_id = 0;
   // sample from bg set then fg set
   for (int is_fg = 0; is_fg < 2; ++is_fg) {
     for (int dummy = 0; dummy < num_samples[is_fg]; ++dummy) {
-      // sample a window
-      timer.Start();
       const unsigned int rand_index = PrefetchRand();
-      vector<float> window = (is_fg) ?
-          fg_windows_[rand_index % fg_windows_.size()] :
-          bg_windows_[rand_index % bg_windows_.size()];
-
-      bool do_mirror = mirror && PrefetchRand() % 2;
-
-      // load the image containing the window
-      pair<std::string, vector<int> > image =
-          image_database_[window[WindowDataLayer<Ftype, Btype>::IMAGE_INDEX]];
-
-      cv::Mat cv_img;
-      if (this->cache_images_) {
-        pair<std::string, Datum> image_cached =
-          image_database_cache_[window[WindowDataLayer<Ftype, Btype>::IMAGE_INDEX]];
-        DecodeDatumToCVMat(image_cached.second, true, cv_img, false);
-      } else {
-        cv_img = cv::imread(image.first, cv::IMREAD_COLOR);
-        if (!cv_img.data) {
-          LOG(ERROR) << "Could not open or find file " << image.first;
-          return true;
-        }
-      }
-      read_time += timer.MicroSeconds();
-      timer.Start();
-      const int channels = cv_img.channels();
-
-      // crop window out of image and warp it
-      int x1 = window[WindowDataLayer<Ftype, Btype>::X1];
-      int y1 = window[WindowDataLayer<Ftype, Btype>::Y1];
-      int x2 = window[WindowDataLayer<Ftype, Btype>::X2];
-      int y2 = window[WindowDataLayer<Ftype, Btype>::Y2];
-
-      int pad_w = 0;
-      int pad_h = 0;
-      if (context_pad > 0 || use_square) {
-        // scale factor by which to expand the original region
-        // such that after warping the expanded region to crop_size x crop_size
-        // there's exactly context_pad amount of padding on each side
-        Ftype context_scale = static_cast<Ftype>(crop_size) /
-            static_cast<Ftype>(crop_size - 2*context_pad);
-
-        // compute the expanded region
-        Ftype half_height = static_cast<Ftype>(y2-y1+1)/2.0;
-        Ftype half_width = static_cast<Ftype>(x2-x1+1)/2.0;
-        Ftype center_x = static_cast<Ftype>(x1) + half_width;
-        Ftype center_y = static_cast<Ftype>(y1) + half_height;
-        if (use_square) {
-          if (half_height > half_width) {
-            half_width = half_height;
-          } else {
-            half_height = half_width;
-          }
-        }
-        x1 = static_cast<int>(round(center_x - half_width*context_scale));
-        x2 = static_cast<int>(round(center_x + half_width*context_scale));
-        y1 = static_cast<int>(round(center_y - half_height*context_scale));
-        y2 = static_cast<int>(round(center_y + half_height*context_scale));
-
-        // the expanded region may go outside of the image
-        // so we compute the clipped (expanded) region and keep track of
-        // the extent beyond the image
-        int unclipped_height = y2-y1+1;
-        int unclipped_width = x2-x1+1;
-        int pad_x1 = std::max(0, -x1);
-        int pad_y1 = std::max(0, -y1);
-        int pad_x2 = std::max(0, x2 - cv_img.cols + 1);
-        int pad_y2 = std::max(0, y2 - cv_img.rows + 1);
-        // clip bounds
-        x1 = x1 + pad_x1;
-        x2 = x2 - pad_x2;
-        y1 = y1 + pad_y1;
-        y2 = y2 - pad_y2;
-        CHECK_GT(x1, -1);
-        CHECK_GT(y1, -1);
-        CHECK_LT(x2, cv_img.cols);
-        CHECK_LT(y2, cv_img.rows);
-
-        int clipped_height = y2-y1+1;
-        int clipped_width = x2-x1+1;
-
-        // scale factors that would be used to warp the unclipped
-        // expanded region
-        Ftype scale_x =
-            static_cast<Ftype>(crop_size)/static_cast<Ftype>(unclipped_width);
-        Ftype scale_y =
-            static_cast<Ftype>(crop_size)/static_cast<Ftype>(unclipped_height);
-
-        // size to warp the clipped expanded region to
-        cv_crop_size.width =
-            static_cast<int>(round(static_cast<Ftype>(clipped_width)*scale_x));
-        cv_crop_size.height =
-            static_cast<int>(round(static_cast<Ftype>(clipped_height)*scale_y));
-        pad_x1 = static_cast<int>(round(static_cast<Ftype>(pad_x1)*scale_x));
-        pad_x2 = static_cast<int>(round(static_cast<Ftype>(pad_x2)*scale_x));
-        pad_y1 = static_cast<int>(round(static_cast<Ftype>(pad_y1)*scale_y));
-        pad_y2 = static_cast<int>(round(static_cast<Ftype>(pad_y2)*scale_y));
-
-        pad_h = pad_y1;
-        // if we're mirroring, we mirror the padding too (to be pedantic)
-        if (do_mirror) {
-          pad_w = pad_x2;
-        } else {
-          pad_w = pad_x1;
-        }
-
-        // ensure that the warped, clipped region plus the padding fits in the
-        // crop_size x crop_size image (it might not due to rounding)
-        if (pad_h + cv_crop_size.height > crop_size) {
-          cv_crop_size.height = crop_size - pad_h;
-        }
-        if (pad_w + cv_crop_size.width > crop_size) {
-          cv_crop_size.width = crop_size - pad_w;
-        }
-      }
-
-      cv::Rect roi(x1, y1, x2-x1+1, y2-y1+1);
-      cv::Mat cv_cropped_img = cv_img(roi);
-      cv::resize(cv_cropped_img, cv_cropped_img,
-          cv_crop_size, 0, 0, cv::INTER_LINEAR);
-
-      // horizontal flip at random
-      if (do_mirror) {
-        cv::flip(cv_cropped_img, cv_cropped_img, 1);
-      }
-
-      // copy the warped window into top_data
-      for (int h = 0; h < cv_cropped_img.rows; ++h) {
-        const uchar* ptr = cv_cropped_img.ptr<uchar>(h);
-        int img_index = 0;
-        for (int w = 0; w < cv_cropped_img.cols; ++w) {
-          for (int c = 0; c < channels; ++c) {
-            int top_index = ((item_id * channels + c) * crop_size + h + pad_h)
-                     * crop_size + w + pad_w;
-            // int top_index = (c * height + h) * width + w;
-            Ftype pixel = static_cast<Ftype>(ptr[img_index++]);
-            if (this->has_mean_file_) {
-              int mean_index = (c * mean_height + h + mean_off + pad_h)
-                           * mean_width + w + mean_off + pad_w;
-              top_data[top_index] = (pixel - mean[mean_index]) * scale;
-            } else {
-              if (this->has_mean_values_) {
-                top_data[top_index] = (pixel - this->mean_values_[c]) * scale;
-              } else {
-                top_data[top_index] = pixel * scale;
-              }
-            }
-          }
-        }
+      windows[item_id] = (is_fg) ?
+          &fg_windows_[rand_index % fg_windows_.size()] :
+          &bg_windows_[rand_index % bg_windows_.size()];
+      mirrors[item_id] = mirror && PrefetchRand() % 2;
+      top_label[item_id] = (*windows[item_id])[WindowDataLayer<Ftype, Btype>::LABEL];
+      image_items[(*windows[item_id])[WindowDataLayer<Ftype, Btype>::IMAGE_INDEX]]
+          .push_back(item_id);
+      item_id++;
+    }
+  }
+  vector<std::pair<int, vector<int>>> groups(image_items.begin(), image_items.end());
+
+  std::atomic<size_t> next_group(0UL);
+  auto worker = [&]() {
+    for (size_t g = next_group++; g < groups.size(); g = next_group++) {
+      cv::Mat cv_img = LoadImage(groups[g].first);
+      if (!cv_img.data) {
+        LOG(ERROR) << "Could not open or find file " << image_database_[groups[g].first].first;
+        continue;
       }
-      trans_time += timer.MicroSeconds();
-      // get window label
-      top_label[item_id] = window[WindowDataLayer<Ftype, Btype>::LABEL];
-
-      #if 0
-      // useful debugging code for dumping transformed windows to disk
-      string file_id;
-      std::stringstream ss;
-      ss << PrefetchRand();
-      ss >> file_id;
-      std::ofstream inf((string("dump/") + file_id +
-          string("_info.txt")).c_str(), std::ofstream::out);
-      inf << image.first << std::endl
-          << window[WindowDataLayer<Ftype, Btype>::X1]+1 << std::endl
-          << window[WindowDataLayer<Ftype, Btype>::Y1]+1 << std::endl
-          << window[WindowDataLayer<Ftype, Btype>::X2]+1 << std::endl
-          << window[WindowDataLayer<Ftype, Btype>::Y2]+1 << std::endl
-          << do_mirror << std::endl
-          << top_label[item_id] << std::endl
-          << is_fg << std::endl;
-      inf.close();
-      std::ofstream top_data_file((string("dump/") + file_id +
-          string("_data.txt")).c_str(),
-          std::ofstream::out | std::ofstream::binary);
-      for (int c = 0; c < channels; ++c) {
-        for (int h = 0; h < crop_size; ++h) {
-          for (int w = 0; w < crop_size; ++w) {
-            top_data_file.write(reinterpret_cast<char*>(
-                &top_data[((item_id * channels + c) * crop_size + h)
-                          * crop_size + w]),
-                sizeof(Ftype));
-          }
-        }
+      for (int item : groups[g].second) {
+        WarpWindow(cv_img, *windows[item], mirrors[item], mean, top_data + item * item_len);
       }
-      top_data_file.close();
-      #endif
-
-      item_id++;
     }
+  };
+  // The calling thread is one of the workers, the others come from its pool
+  ThreadPool* pool = crop_pools_[thread_id].get();
+  const size_t num_workers = pool == nullptr ? 1UL : std::min<size_t>(groups.size(),
+      this->layer_param_.window_data_param().crop_threads());
+  for (size_t i = 1UL; i < num_workers; ++i) {
+    pool->runTask(worker);
   }
+  worker();
+  if (num_workers > 1UL) {
+    pool->waitWorkComplete();
+  }
+
   batch_timer.Stop();
-  DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
-  DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
-  DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+  DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms, "
+             << groups.size() << " images, " << num_workers << " threads.";
   batch->set_id(this->batch_id(thread_id));
   return true;
 }
@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <chrono>
 #include <map>
 #include <set>
 #include <boost/thread.hpp>
@@ -15,6 +16,7 @@
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/insert_splits.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/metrics.hpp"
 #include "caffe/util/signal_handler.h"
 #include "caffe/util/upgrade_proto.hpp"
 
@@ -68,6 +70,39 @@ Net::Net(const string& param_file,
   Init(param);
 }
 
+Net::Net(const FrozenFile& frozen_file, size_t solver_rank)
+    : root_net_(nullptr),
+      solver_(nullptr),
+      solver_rank_(solver_rank),
+      solver_init_flag_(nullptr),
+      inner_net_(false),
+      eltwise_mem_sharing_(false) {
+  NetParameter param;
+  CHECK(ReadProtoFromBinaryFile(frozen_file.path, &param))
+      << "Failed to parse frozen net file " << frozen_file.path;
+  CHECK(param.frozen()) << frozen_file.path << " is not a frozen net, see 'caffe freeze'";
+  // Weights are moved aside so that Init copies the definition only. The
+  // layers get shape-only blobs: they skip their fillers and are loaded below.
+  vector<google::protobuf::RepeatedPtrField<BlobProto>> weights(param.layer_size());
+  for (int i = 0; i < param.layer_size(); ++i) {
+    LayerParameter* layer_param = param.mutable_layer(i);
+    weights[i].Swap(layer_param->mutable_blobs());
+    for (const BlobProto& blob : weights[i]) {
+      *layer_param->add_blobs()->mutable_shape() = blob.shape();
+    }
+  }
+  Init(param);
+  CHECK_EQ(layers_.size(), weights.size());
+  for (int i = 0; i < layers_.size(); ++i) {
+    vector<shared_ptr<Blob>>& blobs = layers_[i]->blobs();
+    CHECK_EQ(blobs.size(), weights[i].size())
+        << "Incompatible number of blobs for layer " << layer_names_[i];
+    for (int j = 0; j < blobs.size(); ++j) {
+      blobs[j]->FromProto(weights[i].Get(j), false);
+    }
+  }
+}
+
 Net::~Net() {
 }
 
@@ -77,19 +112,34 @@ void Net::Init(const NetParameter& in_param) {
   // Set phase from the state.
   phase_ = in_param.state().phase();
   eltwise_mem_sharing_ = in_param.eltwise_mem_sharing();
+  reshape_cache_size_ = in_param.reshape_cache_size();
   // Filter layers based on their include/exclude rules and
   // the current NetState.
+  // Frozen nets have been filtered and split when written.
   NetParameter filtered_param;
-  FilterNet(in_param, &filtered_param);
+  if (in_param.frozen()) {
+    filtered_param = in_param;
+  } else {
+    FilterNet(in_param, &filtered_param);
+  }
   net_param_ = filtered_param;
   batch_per_solver_ = caffe::P2PSync::divide_batch_size(&filtered_param);
-  LOG_IF(INFO, Caffe::root_solver())
-      << "Initializing net from parameters: " << std::endl
-      << filtered_param.DebugString();
+  if (in_param.frozen()) {
+    LOG_IF(INFO, Caffe::root_solver()) << "Initializing frozen net " << in_param.name()
+        << " of " << in_param.layer_size() << " layers";
+  } else {
+    LOG_IF(INFO, Caffe::root_solver())
+        << "Initializing net from parameters: " << std::endl
+        << filtered_param.DebugString();
+  }
   infer_count_ = 0UL;
   // Create a copy of filtered_param with splits added where necessary.
   NetParameter param;
-  InsertSplits(filtered_param, &param);
+  if (in_param.frozen()) {
+    param.Swap(&filtered_param);
+  } else {
+    InsertSplits(filtered_param, &param);
+  }
   // Basically, build all the layers and set up their connections.
   name_ = param.name();
   map<string, int> blob_name_to_idx;
@@ -683,15 +733,52 @@ void Net::AppendParam(const NetParameter& param, const int layer_id, const int p
   }
 }
 
+// Host clock taken after the layer's kernels are done, used by per-layer timing
+static std::chrono::steady_clock::time_point SyncedNow() {
+  if (Caffe::mode() == Caffe::GPU) {
+    CUDA_CHECK(cudaStreamSynchronize(Caffe::thread_stream()));
+  }
+  return std::chrono::steady_clock::now();
+}
+
+void Net::InitLayerMetrics() {
+  if (layer_forward_metrics_.size() == layers_.size()) {
+    return;
+  }
+  layer_forward_metrics_.resize(layers_.size());
+  layer_backward_metrics_.resize(layers_.size());
+  for (int i = 0; i < layers_.size(); ++i) {
+    const MetricLabels labels{{"net", name_}, {"layer", layer_names_[i]},
+        {"rank", std::to_string(solver_rank_)}};
+    layer_forward_metrics_[i] = Metrics::Get().summary("caffe_layer_forward_seconds", labels);
+    layer_backward_metrics_[i] = Metrics::Get().summary("caffe_layer_backward_seconds", labels);
+  }
+}
+
 float Net::ForwardFromTo(int start, int end) {
   CHECK_GE(start, 0);
   CHECK_LT(end, layers_.size());
+  const bool timed = Metrics::enabled() && Metrics::layer_timing();
+  if (timed) {
+    InitLayerMetrics();
+  }
+  if (start == 0) {
+    SwitchReshapeCache();
+  }
   float loss = 0;
   for (int i = start; i <= end; ++i) {
     // LOG(INFO) << " ****** [Forward] (" << i << ") Layer '" << layer_names_[i];
     // << "' FT " << Type_Name(layers_[i]->forward_type())
     // << " BT " << Type_Name(layers_[i]->backward_type());
+    std::chrono::steady_clock::time_point layer_start;
+    if (timed) {
+      layer_start = SyncedNow();
+    }
     float layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
+    if (timed) {
+      layer_forward_metrics_[i]->Observe(
+          std::chrono::duration<double>(SyncedNow() - layer_start).count());
+    }
     loss += layer_loss;
     if (debug_info_) {
       ForwardDebugInfo(i);
@@ -701,6 +788,78 @@ float Net::ForwardFromTo(int start, int end) {
   return loss;
 }
 
+void Net::Compile() {
+  CHECK_EQ(phase_, TEST) << "Only TEST nets can be compiled";
+  Reshape();
+  plan_.clear();
+  plan_mode_ = Caffe::mode();
+  plan_input_shapes_.clear();
+  for (Blob* blob : net_input_blobs_) {
+    plan_input_shapes_.push_back(blob->shape());
+  }
+  for (int i = 0; i < layers_.size(); ++i) {
+    LayerBase* layer = layers_[i].get();
+    PlanStep step{layer, &bottom_vecs_[i], &top_vecs_[i],
+        plan_mode_ == Caffe::GPU && !layer->is_enforced_cpu(), false, {}, {}};
+    for (int top_id = 0; top_id < top_vecs_[i].size(); ++top_id) {
+      step.regular = step.regular || layer->loss(top_id) != 0.F;
+      step.top_shapes.push_back(top_vecs_[i][top_id]->shape());
+    }
+    for (Blob* bottom : bottom_vecs_[i]) {
+      step.bottom_tensors.push_back(bottom->data_tensor());
+    }
+    plan_.push_back(std::move(step));
+  }
+  LOG(INFO) << "Compiled net " << name() << ": " << plan_.size() << " steps on "
+            << (plan_mode_ == Caffe::GPU ? "GPU" : "CPU");
+}
+
+const vector<Blob*>& Net::ForwardCompiled() {
+  if (debug_info_ || (Metrics::enabled() && Metrics::layer_timing())) {
+    return Forward();  // keeps the per-layer diagnostics
+  }
+  bool stale = plan_.empty() || plan_mode_ != Caffe::mode();
+  for (int i = 0; !stale && i < net_input_blobs_.size(); ++i) {
+    stale = net_input_blobs_[i]->shape() != plan_input_shapes_[i];
+  }
+  if (stale) {
+    Compile();
+  }
+  for (size_t s = 0; s < plan_.size(); ++s) {
+    PlanStep& step = plan_[s];
+    if (step.regular) {
+      step.layer->Forward(*step.bottom, *step.top);
+      continue;
+    }
+    bool realias = false;
+    for (int bottom_id = 0; bottom_id < step.bottom->size(); ++bottom_id) {
+      const Tensor* tensor = (*step.bottom)[bottom_id]->data_tensor();
+      realias = realias || tensor != step.bottom_tensors[bottom_id];
+      step.bottom_tensors[bottom_id] = tensor;
+    }
+    if (realias) {
+      // Reshape shares the new bottom storage with aliasing tops
+      step.layer->Forward(*step.bottom, *step.top);
+    } else {
+      step.layer->ForwardPlanned(*step.bottom, *step.top, step.gpu);
+    }
+    for (int top_id = 0; top_id < step.top->size(); ++top_id) {
+      if ((*step.top)[top_id]->shape() != step.top_shapes[top_id]) {
+        step.top_shapes[top_id] = (*step.top)[top_id]->shape();
+        bool demoted = false;
+        for (size_t next = s + 1; next < plan_.size(); ++next) {
+          demoted = demoted || !plan_[next].regular;
+          plan_[next].regular = true;
+        }
+        LOG_IF(INFO, demoted) << "Layer " << step.layer->name() << " changed its output shape, "
+                              << "the layers after it reshape on every forward";
+      }
+    }
+  }
+  ++infer_count_;
+  return net_output_blobs_;
+}
+
 float Net::ForwardFrom(int start) {
   return ForwardFromTo(start, layers_.size() - 1);
 }
@@ -742,12 +901,24 @@ void Net::BackwardFromTo(int start, int end) {
 void Net::BackwardFromToAu(int start, int end, bool apply_update) {
   CHECK_GE(end, 0);
   CHECK_LT(start, layers_.size());
+  const bool timed = Metrics::enabled() && Metrics::layer_timing();
+  if (timed) {
+    InitLayerMetrics();
+  }
   for (int i = start; i >= end; --i) {
     if (!layer_need_backward_[i]) {
       continue;
     }
 
+    std::chrono::steady_clock::time_point layer_start;
+    if (timed) {
+      layer_start = SyncedNow();
+    }
     layers_[i]->Backward(top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
+    if (timed) {
+      layer_backward_metrics_[i]->Observe(
+          std::chrono::duration<double>(SyncedNow() - layer_start).count());
+    }
 
     if (debug_info_) {
       BackwardDebugInfo(i);
@@ -1115,11 +1286,61 @@ void Net::Backward(bool apply_update) {
 }
 
 void Net::Reshape() {
+  SwitchReshapeCache();
   for (int i = 0; i < layers_.size(); ++i) {
     layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
   }
 }
 
+void Net::SwitchReshapeCache() {
+  if (reshape_cache_size_ == 0UL || net_input_blobs_.empty()) {
+    return;
+  }
+  vector<vector<int>> input_shapes;
+  for (Blob* blob : net_input_blobs_) {
+    input_shapes.push_back(blob->shape());
+  }
+  if (!reshape_cache_.empty() && reshape_cache_.front().input_shapes == input_shapes) {
+    return;
+  }
+  // Inputs are shaped and filled by the caller, and so are the tensors
+  // of blobs sharing them, e.g. tops of a Split or Reshape of an input:
+  // their memory is left alone, Reshape shares it again
+  vector<bool> is_input(blobs_.size(), false);
+  for (int i = 0; i < blobs_.size(); ++i) {
+    for (Blob* input : net_input_blobs_) {
+      is_input[i] = is_input[i] || blobs_[i].get() == input ||
+          blobs_[i]->SharesTensorWith(*input);
+    }
+  }
+  if (!reshape_cache_.empty()) {
+    ReshapeCacheEntry& current = reshape_cache_.front();
+    current.blobs.resize(blobs_.size());
+    for (int i = 0; i < blobs_.size(); ++i) {
+      if (!is_input[i]) {
+        blobs_[i]->SaveMemory(&current.blobs[i]);
+      }
+    }
+  }
+  auto it = std::find_if(reshape_cache_.begin(), reshape_cache_.end(),
+      [&](const ReshapeCacheEntry& entry) { return entry.input_shapes == input_shapes; });
+  if (it != reshape_cache_.end()) {
+    reshape_cache_.splice(reshape_cache_.begin(), reshape_cache_, it);
+    for (int i = 0; i < blobs_.size(); ++i) {
+      if (!is_input[i] && it->blobs[i].data_tensor) {
+        blobs_[i]->RestoreMemory(it->blobs[i]);
+      }
+    }
+    return;
+  }
+  // New shape: blobs reallocate on Reshape, the memory of the previous
+  // shape stays with its entry
+  reshape_cache_.push_front(ReshapeCacheEntry{input_shapes, {}});
+  if (reshape_cache_.size() > reshape_cache_size_) {
+    reshape_cache_.pop_back();
+  }
+}
+
 void Net::CopyTrainedLayersFrom(const NetParameter& param) {
   int num_source_layers = param.layer_size();
   for (int i = 0; i < num_source_layers; ++i) {
@@ -1266,6 +1487,21 @@ void Net::ToProto(NetParameter* param, bool write_diff) const {
   }
 }
 
+void Net::ToFrozenProto(NetParameter* param) const {
+  // Keeps the net-wide settings of the filtered definition, but takes the
+  // layers as instantiated: split layers included, with their weights.
+  *param = net_param_;
+  param->clear_layer();
+  param->clear_layers();
+  param->clear_input();
+  param->clear_input_shape();
+  param->clear_input_dim();
+  for (int i = 0; i < layers_.size(); ++i) {
+    layers_[i]->ToProto(param->add_layer(), false);
+  }
+  param->set_frozen(true);
+}
+
 void Net::ToHDF5(const string& filename, bool write_diff) const {
   hid_t file_hid = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
       H5P_DEFAULT);
@@ -1,3 +1,4 @@
+#include <chrono>
 #include <cstdio>
 
 #include <string>
@@ -8,6 +9,7 @@
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 #include "caffe/util/bbox_util.hpp"
+#include "caffe/util/metrics.hpp"
 
 namespace caffe {
 
@@ -231,6 +233,23 @@ void Solver::Step(int iters) {
   const bool test_and_snapshot_enabled = ts_epochs_remaining > 0;
   --ts_epochs_remaining;
 
+  Metric* iteration_seconds = nullptr;
+  Metric* test_seconds = nullptr;
+  Metric* images_total = nullptr;
+  Metric* images_per_second = nullptr;
+  Metric* iteration_gauge = nullptr;
+  Metric* loss_gauge = nullptr;
+  if (Metrics::enabled()) {
+    const MetricLabels labels{{"rank", std::to_string(rank_)}};
+    Metrics& metrics = Metrics::Get();
+    iteration_seconds = metrics.summary("caffe_iteration_seconds", labels);
+    test_seconds = metrics.summary("caffe_test_seconds", labels);
+    images_total = metrics.counter("caffe_images_total", labels);
+    images_per_second = metrics.gauge("caffe_images_per_second", labels);
+    iteration_gauge = metrics.gauge("caffe_iteration", labels);
+    loss_gauge = metrics.gauge("caffe_loss", labels);
+  }
+
   const bool use_multi_gpu_testing = Caffe::device_in_use_per_host_count() > 1;
   const string mgpu_str = use_multi_gpu_testing ? "[MultiGPU] " : "";
   LOG_IF(INFO, rank_ == 0) << mgpu_str << "Initial Test started...";
@@ -271,6 +290,9 @@ void Solver::Step(int iters) {
       callback_soft_barrier();
       float lapse = iteration_timer_->Seconds();
       LOG_IF(INFO, rank_ == 0) << mgpu_str << "Tests completed in " << lapse << "s";
+      if (test_seconds != nullptr) {
+        test_seconds->Observe(lapse);
+      }
     }
     if (requested_early_exit_) {
       // Break out of the while loop because stop was requested while testing.
@@ -290,6 +312,7 @@ void Solver::Step(int iters) {
       iteration_timer_->Start();
     }
 
+    const auto iteration_start = std::chrono::steady_clock::now();
     if (net_->phase() == TRAIN) {
       iteration_start_signal();
     }
@@ -312,6 +335,14 @@ void Solver::Step(int iters) {
       total_lapse_ += iteration_timer_->Seconds();
       break;
     }
+    if (iteration_seconds != nullptr) {
+      const double seconds = std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - iteration_start).count();
+      const double images = static_cast<double>(bps) * param_.iter_size();
+      iteration_seconds->Observe(seconds);
+      images_total->Add(images);
+      images_per_second->Set(seconds > 0. ? images / seconds : 0.);
+    }
 
     epoch_count = Caffe::epoch_count();
     if (epoch_count > 0UL) {
@@ -322,6 +353,10 @@ void Solver::Step(int iters) {
     }
     // average the loss across iterations for smoothed reporting
     UpdateSmoothedLoss(loss, start_iter, average_loss);
+    if (loss_gauge != nullptr) {
+      loss_gauge->Set(smoothed_loss_);
+      iteration_gauge->Set(iter_ + 1);
+    }
     if (this->param_display() && (display || rel_iter <= 2 || iter_ + 1 == stop_iter)) {
       float lapse = iteration_timer_->Seconds();
       iteration_timer_->Start();
@@ -717,6 +752,7 @@ vector<float> Solver::TestDetection(const int test_net_id, const int iters) {
 
 void Solver::SnapshotWithScores(const vector<float>& scores) {
   CHECK_EQ(0, rank_);
+  const auto start = std::chrono::steady_clock::now();
   string model_filename;
   switch (param_.snapshot_format()) {
   case caffe::SolverParameter_SnapshotFormat_BINARYPROTO:
@@ -729,6 +765,10 @@ void Solver::SnapshotWithScores(const vector<float>& scores) {
     LOG(FATAL) << "Unsupported snapshot format.";
   }
   SnapshotSolverState(model_filename);
+  if (Metrics::enabled()) {
+    Metrics::Get().summary("caffe_snapshot_seconds")->Observe(std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count());
+  }
 }
 
 void Solver::CheckSnapshotWritePermissions() {
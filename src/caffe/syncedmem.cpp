@@ -117,6 +117,12 @@ void SyncedMemory::set_cpu_data(void* data) {
   cpu_ptr_ = data;
   head_ = HEAD_AT_CPU;
   own_cpu_data_ = false;
+  cpu_owner_.reset();
+}
+
+void SyncedMemory::set_cpu_data(void* data, const shared_ptr<void>& owner) {
+  set_cpu_data(data);
+  cpu_owner_ = owner;
 }
 
 const void* SyncedMemory::gpu_data(int group) {
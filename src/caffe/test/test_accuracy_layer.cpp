@@ -1,4 +1,7 @@
 #include <cfloat>
+#include <cstdio>
+#include <fstream>
+#include <string>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -7,6 +10,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/accuracy_layer.hpp"
+#include "caffe/util/io.hpp"
 #include "caffe/util/rng.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -339,4 +343,46 @@ TYPED_TEST(AccuracyLayerTest, TestForwardCPUPerClassWithIgnoreLabel) {
   }
 }
 
+TYPED_TEST(AccuracyLayerTest, TestConfusionFile) {
+  LayerParameter layer_param;
+  const string confusion_file = MakeTempFilename();
+  layer_param.mutable_accuracy_param()->set_confusion_iters(2);
+  layer_param.mutable_accuracy_param()->set_confusion_file(confusion_file);
+  AccuracyLayer<TypeParam, TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Written after the second pass only
+  EXPECT_FALSE(std::ifstream(confusion_file.c_str()).good());
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+
+  vector<int> labels(10, 0), predictions(10, 0), hits(10, 0);
+  for (int i = 0; i < 100; ++i) {
+    int max_id = 0;
+    for (int j = 1; j < 10; ++j) {
+      if (this->blob_bottom_data_->data_at(i, j, 0, 0) >=
+          this->blob_bottom_data_->data_at(i, max_id, 0, 0)) {
+        max_id = j;
+      }
+    }
+    const int id = static_cast<int>(this->blob_bottom_label_->data_at(i, 0, 0, 0));
+    labels[id] += 2;
+    predictions[max_id] += 2;
+    hits[id] += max_id == id ? 2 : 0;
+  }
+  std::ifstream ifs(confusion_file.c_str());
+  ASSERT_TRUE(ifs.good());
+  string line;
+  std::getline(ifs, line);
+  for (int l = 0; l < 10; ++l) {
+    int cls, num_labels, num_predictions, num_hits;
+    float precision, recall;
+    ifs >> cls >> num_labels >> num_predictions >> num_hits >> precision >> recall;
+    EXPECT_EQ(l, cls);
+    EXPECT_EQ(labels[l], num_labels);
+    EXPECT_EQ(predictions[l], num_predictions);
+    EXPECT_EQ(hits[l], num_hits);
+  }
+  std::remove(confusion_file.c_str());
+}
+
 }  // namespace caffe
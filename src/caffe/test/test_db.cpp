@@ -6,7 +6,9 @@
 
 #include "caffe/common.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/convert_pipeline.hpp"
 #include "caffe/util/db.hpp"
+#include "caffe/util/format.hpp"
 #include "caffe/util/io.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -93,6 +95,61 @@ TYPED_TEST(DBTest, TestSeekToFirst) {
   EXPECT_EQ(datum.width(), 480);
 }
 
+TYPED_TEST(DBTest, TestSeekToKey) {
+  unique_ptr<db::DB> db(db::GetDB(TypeParam::backend));
+  db->Open(this->source_, db::READ);
+  unique_ptr<db::Cursor> cursor(db->NewCursor());
+  cursor->SeekToKey("fish-bike.jpg");
+  EXPECT_TRUE(cursor->valid());
+  EXPECT_EQ(cursor->key(), "fish-bike.jpg");
+  // Positions at the next key when there's no exact match
+  cursor->SeekToKey("dog.jpg");
+  EXPECT_TRUE(cursor->valid());
+  EXPECT_EQ(cursor->key(), "fish-bike.jpg");
+  cursor->SeekToKey("a.jpg");
+  EXPECT_TRUE(cursor->valid());
+  EXPECT_EQ(cursor->key(), "cat.jpg");
+  cursor->SeekToKey("zebra.jpg");
+  EXPECT_FALSE(cursor->valid());
+}
+
+TYPED_TEST(DBTest, TestKeyIndex) {
+  unique_ptr<db::DB> db(db::GetDB(TypeParam::backend));
+  db->Open(this->source_, db::READ);
+  shared_ptr<db::KeyIndex> index = db::KeyIndex::Get(db.get(), this->source_, 2UL);
+  EXPECT_EQ(2UL, index->records());
+  // Shared while held
+  EXPECT_EQ(index, db::KeyIndex::Get(db.get(), this->source_, 2UL));
+  unique_ptr<db::Cursor> cursor(db->NewCursor());
+  index->Seek(cursor.get(), 1UL);
+  EXPECT_EQ(cursor->key(), "fish-bike.jpg");
+  // Positions wrap around
+  index->Seek(cursor.get(), 4UL);
+  EXPECT_EQ(cursor->key(), "cat.jpg");
+  index->Seek(cursor.get(), 7UL);
+  EXPECT_EQ(cursor->key(), "fish-bike.jpg");
+}
+
+TYPED_TEST(DBTest, TestKeyIndexRebuilt) {
+  unique_ptr<db::DB> db(db::GetDB(TypeParam::backend));
+  db->Open(this->source_, db::READ);
+  shared_ptr<db::KeyIndex> index1 = db::KeyIndex::Get(db.get(), this->source_, 1UL);
+  shared_ptr<db::KeyIndex> index2 = db::KeyIndex::Get(db.get(), this->source_, 2UL);
+  // One per stride
+  EXPECT_NE(index1, index2);
+  EXPECT_EQ(2UL, index1->records());
+  // Released indices are built again on the next request
+  weak_ptr<db::KeyIndex> released(index1);
+  index1.reset();
+  EXPECT_TRUE(released.expired());
+  index1 = db::KeyIndex::Get(db.get(), this->source_, 1UL);
+  ASSERT_TRUE(index1);
+  EXPECT_EQ(2UL, index1->records());
+  unique_ptr<db::Cursor> cursor(db->NewCursor());
+  index1->Seek(cursor.get(), 1UL);
+  EXPECT_EQ(cursor->key(), "fish-bike.jpg");
+}
+
 TYPED_TEST(DBTest, TestKeyValue) {
   unique_ptr<db::DB> db(db::GetDB(TypeParam::backend));
   db->Open(this->source_, db::READ);
@@ -132,6 +189,73 @@ TYPED_TEST(DBTest, TestWrite) {
   txn->Commit();
 }
 
+TYPED_TEST(DBTest, TestWriteStreaming) {
+  const string source = MakeTempDir() + "/streaming_db";
+  // 32MB in total, well above the default LMDB map size of 10MB
+  const int num_records = 320;
+  const string value(100000, 'x');
+  {
+    unique_ptr<db::DB> db(db::GetDB(TypeParam::backend));
+    db->Open(source, db::NEW);
+    unique_ptr<db::Transaction> txn(db->NewAppendTransaction());
+    for (int i = 0; i < num_records; ++i) {
+      txn->Put(format_int(i, 8), value);
+      if (i % 100 == 99) {
+        txn->Commit();
+        txn.reset(db->NewAppendTransaction());
+      }
+    }
+    txn->Commit();
+  }
+  unique_ptr<db::DB> db(db::GetDB(TypeParam::backend));
+  db->Open(source, db::READ);
+  unique_ptr<db::Cursor> cursor(db->NewCursor());
+  int count = 0;
+  for (; cursor->valid(); cursor->Next(), ++count) {
+    EXPECT_EQ(cursor->key(), format_int(count, 8));
+    EXPECT_EQ(cursor->size(), value.size());
+  }
+  EXPECT_EQ(count, num_records);
+}
+
+TYPED_TEST(DBTest, TestConvertPipeline) {
+  const string source = MakeTempDir() + "/pipeline_db";
+  const size_t num_items = 100UL;
+  {
+    unique_ptr<db::DB> db(db::GetDB(TypeParam::backend));
+    db->Open(source, db::NEW);
+    // Small queue and commit interval to exercise slot reuse and commits
+    ConvertPipeline pipeline(db.get(), 4, 3, 7, true);
+    size_t written = pipeline.Run(num_items,
+        [](size_t index, string* key, string* value) -> bool {
+          if (index % 10 == 5) {
+            return false;  // skipped item
+          }
+          *key = format_int(index, 8);
+          Datum datum;
+          datum.set_label(index);
+          CHECK(datum.SerializeToString(value));
+          return true;
+        });
+    EXPECT_EQ(written, num_items - num_items / 10);
+  }
+  unique_ptr<db::DB> db(db::GetDB(TypeParam::backend));
+  db->Open(source, db::READ);
+  unique_ptr<db::Cursor> cursor(db->NewCursor());
+  for (size_t index = 0UL; index < num_items; ++index) {
+    if (index % 10 == 5) {
+      continue;
+    }
+    ASSERT_TRUE(cursor->valid());
+    EXPECT_EQ(cursor->key(), format_int(index, 8));
+    Datum datum;
+    EXPECT_TRUE(cursor->parse(&datum));
+    EXPECT_EQ(datum.label(), index);
+    cursor->Next();
+  }
+  EXPECT_FALSE(cursor->valid());
+}
+
 }  // namespace caffe
 
 #endif  // USE_LEVELDB, USE_LMDB
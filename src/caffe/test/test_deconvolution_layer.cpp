@@ -129,6 +129,46 @@ TYPED_TEST(DeconvolutionLayerTest, TestSimpleDeconvolution) {
   }
 }
 
+TYPED_TEST(DeconvolutionLayerTest, TestBilinearUpsample) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param = layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(4);
+  convolution_param->add_stride(2);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(3);
+  convolution_param->set_group(3);
+  convolution_param->set_bias_term(false);
+  convolution_param->mutable_weight_filler()->set_type("bilinear");
+  DeconvolutionLayer<Dtype, Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(12, this->blob_top_->height());
+  EXPECT_EQ(8, this->blob_top_->width());
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype* weights = layer.blobs()[0]->template cpu_data<Dtype>();
+  // Every input value scattered with its channel's filter
+  for (int n = 0; n < 2; ++n) {
+    for (int c = 0; c < 3; ++c) {
+      for (int h = 0; h < 12; ++h) {
+        for (int w = 0; w < 8; ++w) {
+          float expected = 0.F;
+          for (int kh = (h + 1) % 2; kh < 4; kh += 2) {
+            for (int kw = (w + 1) % 2; kw < 4; kw += 2) {
+              const int ih = (h + 1 - kh) / 2;
+              const int iw = (w + 1 - kw) / 2;
+              if (ih >= 0 && ih < 6 && iw >= 0 && iw < 4) {
+                expected += static_cast<float>(weights[c * 16 + kh * 4 + kw]) *
+                    static_cast<float>(this->blob_bottom_->data_at(n, c, ih, iw));
+              }
+            }
+          }
+          EXPECT_NEAR(expected, this->blob_top_->data_at(n, c, h, w), tol<Dtype>(1e-4, 1e-2));
+        }
+      }
+    }
+  }
+}
+
 TYPED_TEST(DeconvolutionLayerTest, TestGradient) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
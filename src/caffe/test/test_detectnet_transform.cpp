@@ -144,6 +144,43 @@ TYPED_TEST(DetectNetTransformationLayerTest, TestNoAugmentation) {
   }
 }
 
+TYPED_TEST(DetectNetTransformationLayerTest, TestCoverageLabel) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (is_type<Dtype>(DOUBLE)) {
+    return;  // FIXME
+  }
+  LayerParameter layer_param = this->layerParamNoAug();
+  DetectNetTransformationLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // The 16x16 box at the origin, shrunk by scale_cvg to (4, 4)-(12, 12),
+  // covers gridboxes 1 and 2 of stride 4 in both directions
+  const TBlob<Dtype>& label = *this->blob_top_label_;
+  ASSERT_EQ(9, label.channels());
+  ASSERT_EQ(8, label.height());
+  ASSERT_EQ(8, label.width());
+  for (int g_y = 0; g_y < 8; ++g_y) {
+    for (int g_x = 0; g_x < 8; ++g_x) {
+      const bool covered = g_x >= 1 && g_x < 3 && g_y >= 1 && g_y < 3;
+      const Dtype expected[9] = {
+        1.F,                 // foreground
+        -4.F * g_x,          // top left corner relative to the gridbox
+        -4.F * g_y,
+        16.F - 4.F * g_x,    // bottom right corner
+        16.F - 4.F * g_y,
+        1.F / 16.F,          // inverse size
+        1.F / 16.F,
+        1.F,                 // obj_norm, at least 1 without obj_norm
+        1.F                  // coverage of the only class
+      };
+      for (int c = 0; c < 9; ++c) {
+        EXPECT_FLOAT_EQ(covered ? expected[c] : Dtype(0), label.data_at(0, c, g_y, g_x))
+            << "plane " << c << " of gridbox " << g_x << "," << g_y;
+      }
+    }
+  }
+}
+
 TYPED_TEST(DetectNetTransformationLayerTest, TestAllAugmentation) {
   typedef typename TypeParam::Dtype Dtype;
   if (is_type<Dtype>(DOUBLE)) {
@@ -0,0 +1,84 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/util/feature_writer.hpp"
+#include "caffe/util/hdf5.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class FeatureWriterTest : public ::testing::Test {
+ protected:
+  FeatureWriterTest() : shape_{2, 3, 1, 2} {}
+
+  // Two mini-batches, of 2 rows and 1 row, where value i is i
+  void WriteRows(const string& name, const string& type) {
+    vector<float> data(kNum * kDim);
+    for (size_t i = 0; i < data.size(); ++i) {
+      data[i] = i;
+    }
+    unique_ptr<FeatureWriter> writer(GetFeatureWriter(name, type, shape_));
+    writer->Write(data.data(), 2, kDim);
+    writer->Write(data.data() + 2 * kDim, 1, kDim);
+    writer->Close();
+  }
+
+  static constexpr int kNum = 3;
+  static constexpr int kDim = 6;
+  const vector<int> shape_;
+};
+
+constexpr int FeatureWriterTest::kNum;
+constexpr int FeatureWriterTest::kDim;
+
+TEST_F(FeatureWriterTest, TestBinary) {
+  const string name = MakeTempFilename();
+  WriteRows(name, "binary");
+  FILE* file = std::fopen(name.c_str(), "rb");
+  ASSERT_TRUE(file != nullptr);
+  int64_t header[8];
+  ASSERT_EQ(1UL, std::fread(header, sizeof(header), 1, file));
+  EXPECT_EQ(0, std::memcmp(header, "CAFFEFEA", 8));
+  EXPECT_EQ(1, header[1]);
+  EXPECT_EQ(kNum, header[2]);
+  EXPECT_EQ(kDim, header[3]);
+  EXPECT_EQ(3, header[4]);
+  EXPECT_EQ(1, header[5]);
+  EXPECT_EQ(2, header[6]);
+  EXPECT_EQ(0, header[7]);
+  vector<float> data(kNum * kDim + 1);
+  // Rows in the order they were written and nothing after them
+  ASSERT_EQ(static_cast<size_t>(kNum * kDim),
+      std::fread(data.data(), sizeof(float), data.size(), file));
+  EXPECT_TRUE(std::feof(file));
+  std::fclose(file);
+  for (int i = 0; i < kNum * kDim; ++i) {
+    EXPECT_EQ(i, data[i]);
+  }
+}
+
+TEST_F(FeatureWriterTest, TestHDF5) {
+  const string name = MakeTempFilename();
+  WriteRows(name, "hdf5");
+  hid_t file_id = H5Fopen(name.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+  ASSERT_GE(file_id, 0);
+  TBlob<float> blob;
+  hdf5_load_nd_dataset(file_id, "data", 2, 2, &blob);
+  EXPECT_GE(H5Fclose(file_id), 0);
+  ASSERT_EQ(2, blob.num_axes());
+  EXPECT_EQ(kNum, blob.shape(0));
+  EXPECT_EQ(kDim, blob.shape(1));
+  for (int i = 0; i < kNum * kDim; ++i) {
+    EXPECT_EQ(i, blob.cpu_data()[i]);
+  }
+}
+
+}  // namespace caffe
@@ -153,6 +153,39 @@ TYPED_TEST(Im2colLayerTest, TestRect) {
   }
 }
 
+TYPED_TEST(Im2colLayerTest, TestRectPad) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param = layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_h(3);
+  convolution_param->set_kernel_w(2);
+  convolution_param->set_pad_h(1);
+  convolution_param->set_pad_w(2);
+  convolution_param->set_stride_h(2);
+  convolution_param->set_stride_w(3);
+  Im2colLayer<Dtype, Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Asymmetric padding: every output against the padded input
+  const int height = this->blob_bottom_->height();
+  const int width = this->blob_bottom_->width();
+  ASSERT_EQ(3, this->blob_top_->height());
+  ASSERT_EQ(3, this->blob_top_->width());
+  for (int n = 0; n < 2; ++n) {
+    for (int c = 0; c < 18; ++c) {
+      for (int h = 0; h < 3; ++h) {
+        for (int w = 0; w < 3; ++w) {
+          const int h_in = h * 2 - 1 + (c / 2) % 3;
+          const int w_in = w * 3 - 2 + c % 2;
+          const bool inside = h_in >= 0 && h_in < height && w_in >= 0 && w_in < width;
+          EXPECT_EQ(inside ? this->blob_bottom_->data_at(n, c / 6, h_in, w_in) : Dtype(0),
+              this->blob_top_->data_at(n, c, h, w));
+        }
+      }
+    }
+  }
+}
+
 TYPED_TEST(Im2colLayerTest, TestRectGradient) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -0,0 +1,96 @@
+#include <opencv2/core/core.hpp>
+
+#include <cstring>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/image_cache.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ImageCacheTest : public ::testing::Test {
+ protected:
+  static cv::Mat MakeImage(int rows, int cols, int seed) {
+    cv::Mat img(rows, cols, CV_8UC3);
+    for (int i = 0; i < rows; ++i) {
+      for (int j = 0; j < cols; ++j) {
+        img.at<cv::Vec3b>(i, j) = cv::Vec3b(seed + i, seed + j, seed + i + j);
+      }
+    }
+    return img;
+  }
+
+  static bool Equal(const cv::Mat& a, const cv::Mat& b) {
+    return a.rows == b.rows && a.cols == b.cols && a.type() == b.type() &&
+        a.isContinuous() && b.isContinuous() &&
+        memcmp(a.data, b.data, a.total() * a.elemSize()) == 0;
+  }
+};
+
+TEST_F(ImageCacheTest, TestHitMiss) {
+  ImageCache cache(1UL << 24);
+  cv::Mat img = MakeImage(8, 16, 1), out;
+  EXPECT_FALSE(cache.Lookup("a", &out));
+  EXPECT_TRUE(cache.Insert("a", img));
+  EXPECT_TRUE(cache.Lookup("a", &out));
+  EXPECT_TRUE(Equal(img, out));
+  const ImageCache::Stats stats = cache.stats();
+  EXPECT_EQ(1UL, stats.hits);
+  EXPECT_EQ(1UL, stats.misses);
+  EXPECT_EQ(1UL, stats.entries);
+  EXPECT_GE(stats.bytes, img.total() * img.elemSize());
+}
+
+TEST_F(ImageCacheTest, TestEncoded) {
+  ImageCache cache(1UL << 24);
+  cv::Mat img = MakeImage(32, 32, 7), out;
+  EXPECT_TRUE(cache.Insert("png", img, ImageDataParameter_CacheFormat_PNG));
+  EXPECT_TRUE(cache.Lookup("png", &out));
+  EXPECT_TRUE(Equal(img, out));  // lossless
+  EXPECT_TRUE(cache.Insert("jpg", img, ImageDataParameter_CacheFormat_JPEG, 90));
+  EXPECT_TRUE(cache.Lookup("jpg", &out));
+  EXPECT_EQ(img.rows, out.rows);
+  EXPECT_EQ(img.cols, out.cols);
+  EXPECT_EQ(img.type(), out.type());
+}
+
+TEST_F(ImageCacheTest, TestBudget) {
+  const cv::Mat img = MakeImage(64, 64, 3);  // 12 KB
+  const size_t budget = 64UL * ImageCache::kShards * 1024UL;
+  ImageCache cache(budget);
+  for (int i = 0; i < 1000; ++i) {
+    cache.Insert("img" + std::to_string(i), img);
+  }
+  const ImageCache::Stats stats = cache.stats();
+  EXPECT_LE(stats.bytes, budget);
+  EXPECT_GT(stats.evictions, 0UL);
+  EXPECT_EQ(1000UL, stats.insertions);
+  EXPECT_EQ(stats.insertions - stats.evictions, stats.entries);
+  // Larger than a shard
+  EXPECT_FALSE(cache.Insert("big", MakeImage(512, 512, 0)));
+  EXPECT_EQ(1UL, cache.stats().rejections);
+}
+
+TEST_F(ImageCacheTest, TestSecondChance) {
+  const cv::Mat img = MakeImage(64, 64, 5);
+  ImageCache cache(64UL * ImageCache::kShards * 1024UL);
+  cv::Mat out;
+  ASSERT_TRUE(cache.Insert("hot", img));
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(cache.Lookup("hot", &out));
+    cache.Insert("cold" + std::to_string(i), img);
+  }
+  EXPECT_TRUE(cache.Lookup("hot", &out));
+}
+
+TEST_F(ImageCacheTest, TestKey) {
+  EXPECT_NE(ImageCacheKey("a.jpg", 0, 0, true, 0), ImageCacheKey("a.jpg", 0, 0, false, 0));
+  EXPECT_NE(ImageCacheKey("a.jpg", 10, 20, true, 0), ImageCacheKey("a.jpg", 20, 10, true, 0));
+  EXPECT_EQ(ImageCacheKey("a.jpg", 0, 0, true, 256), ImageCacheKey("a.jpg", 0, 0, true, 256));
+}
+
+}  // namespace caffe
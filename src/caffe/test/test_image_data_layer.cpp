@@ -145,6 +145,36 @@ TYPED_TEST(ImageDataLayerTest, TestReshape) {
   EXPECT_EQ(481, this->blob_top_data_->width());
 }
 
+TYPED_TEST(ImageDataLayerTest, TestBuckets) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  ImageDataParameter* image_data_param = param.mutable_image_data_param();
+  image_data_param->set_threads(1);
+  image_data_param->set_batch_size(2);
+  image_data_param->set_source(this->filename_reshape_.c_str());
+  image_data_param->set_shuffle(false);
+  image_data_param->set_bucket_granularity(32);
+  ImageDataLayer<Dtype, Dtype> layer(param, 0UL);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(384, this->blob_top_data_->height());
+  EXPECT_EQ(480, this->blob_top_data_->width());
+  // cat.jpg bucket fills up first: cat, fish-bike, cat
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(2, this->blob_top_data_->num());
+  EXPECT_EQ(3, this->blob_top_data_->channels());
+  EXPECT_EQ(384, this->blob_top_data_->height());
+  EXPECT_EQ(480, this->blob_top_data_->width());
+  EXPECT_EQ(0, this->blob_top_label_->cpu_data()[0]);
+  EXPECT_EQ(0, this->blob_top_label_->cpu_data()[1]);
+  // fish-bike.jpg, 323x481 padded
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(2, this->blob_top_data_->num());
+  EXPECT_EQ(352, this->blob_top_data_->height());
+  EXPECT_EQ(512, this->blob_top_data_->width());
+  EXPECT_EQ(1, this->blob_top_label_->cpu_data()[0]);
+  EXPECT_EQ(1, this->blob_top_label_->cpu_data()[1]);
+}
+
 TYPED_TEST(ImageDataLayerTest, TestShuffle) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter param;
@@ -0,0 +1,109 @@
+#include <boost/thread.hpp>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/metrics.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class MetricsTest : public ::testing::Test {};
+
+TEST_F(MetricsTest, TestCounterAndGauge) {
+  Metrics& metrics = Metrics::Get();
+  Metric* counter = metrics.counter("test_counter_total", {{"queue", "a"}});
+  counter->Add(2.);
+  counter->Add(3.);
+  EXPECT_EQ(counter, metrics.counter("test_counter_total", {{"queue", "a"}}));
+  metrics.gauge("test_gauge")->Set(7.);
+  metrics.gauge("test_gauge")->Set(4.5);
+  const string text = metrics.ExportText();
+  EXPECT_NE(string::npos, text.find("# TYPE test_counter_total counter\n"
+      "test_counter_total{queue=\"a\"} 5\n"));
+  EXPECT_NE(string::npos, text.find("# TYPE test_gauge gauge\ntest_gauge 4.5\n"));
+}
+
+TEST_F(MetricsTest, TestSummary) {
+  Metric* summary = Metrics::Get().summary("test_seconds", {{"layer", "conv1"}});
+  summary->Observe(1.);
+  summary->Observe(3.);
+  double sum, avg;
+  size_t count;
+  summary->Read(&sum, &count, &avg);
+  EXPECT_EQ(4., sum);
+  EXPECT_EQ(2UL, count);
+  EXPECT_NEAR(1. + Metric::kAverageWeight * 2., avg, 1e-9);
+  const string text = Metrics::Get().ExportText();
+  EXPECT_NE(string::npos, text.find("test_seconds_sum{layer=\"conv1\"} 4\n"));
+  EXPECT_NE(string::npos, text.find("test_seconds_count{layer=\"conv1\"} 2\n"));
+  EXPECT_NE(string::npos, text.find("# TYPE test_seconds_avg gauge\n"));
+}
+
+TEST_F(MetricsTest, TestLabelEscaping) {
+  EXPECT_EQ("a=\"x\\\"y\\\\z\",b=\"1\"",
+      FormatMetricLabels({{"a", "x\"y\\z"}, {"b", "1"}}));
+}
+
+TEST_F(MetricsTest, TestCallbacks) {
+  Metrics& metrics = Metrics::Get();
+  const int id1 = metrics.AddCallback("test_depth", {{"queue", "q"}}, []() { return 2.; });
+  const int id2 = metrics.AddCallback("test_depth", {{"queue", "q"}}, []() { return 3.; });
+  EXPECT_NE(string::npos, metrics.ExportText().find("test_depth{queue=\"q\"} 5\n"));
+  metrics.RemoveCallback(id1);
+  EXPECT_NE(string::npos, metrics.ExportText().find("test_depth{queue=\"q\"} 3\n"));
+  metrics.RemoveCallback(id2);
+  EXPECT_EQ(string::npos, metrics.ExportText().find("test_depth"));
+}
+
+TEST_F(MetricsTest, TestQueueWait) {
+  Metric* wait = Metrics::Get().counter("test_queue_wait_seconds_total");
+  BlockingQueue<int> queue;
+  queue.set_wait_metric(wait);
+  queue.push(1);
+  EXPECT_EQ(1, queue.pop());
+  double value, avg;
+  size_t count;
+  wait->Read(&value, &count, &avg);
+  EXPECT_EQ(0., value);  // didn't block
+  boost::thread producer([&queue]() {
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(50));
+    queue.push(2);
+  });
+  EXPECT_EQ(2, queue.pop("waiting"));
+  producer.join();
+  wait->Read(&value, &count, &avg);
+  EXPECT_GT(value, 0.02);
+}
+
+TEST_F(MetricsTest, TestJsonDump) {
+  const string path = MakeTempFilename();
+  Metrics::Get().gauge("test_json_gauge", {{"phase", "TEST"}})->Set(1.25);
+  Metrics::Get().Start(0, path, 1);
+  Metrics::Get().Stop();
+  std::ifstream ifs(path.c_str());
+  ASSERT_TRUE(ifs.good());
+  std::stringstream ss;
+  ss << ifs.rdbuf();
+  const string json = ss.str();
+  EXPECT_EQ(0UL, json.find("{\"timestamp\": "));
+  EXPECT_NE(string::npos, json.find("{\"name\": \"test_json_gauge\", \"type\": \"gauge\", "
+      "\"labels\": {\"phase\": \"TEST\"}, \"value\": 1.25}"));
+  std::remove(path.c_str());
+}
+
+TEST_F(MetricsTest, TestStopDisables) {
+  Metrics::Get().Start(0, "", 1);
+  EXPECT_TRUE(Metrics::enabled());
+  Metrics::Get().Stop();
+  EXPECT_FALSE(Metrics::enabled());
+}
+
+}  // namespace caffe
@@ -1,3 +1,4 @@
+#include <fstream>
 #include <string>
 #include <utility>
 #include <vector>
@@ -10,6 +11,7 @@
 #include "caffe/filler.hpp"
 #include "caffe/net.hpp"
 #include "caffe/type.hpp"
+#include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -640,7 +642,7 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     InitNetFromProtoString(proto);
   }
 
-  virtual void InitReshapableNet() {
+  virtual void InitReshapableNet(int reshape_cache_size = 0) {
     string proto =
         "name: 'ReshapableNetwork' "
         "layer { "
@@ -710,7 +712,7 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     proto += Type_Name(tp<Dtype>());
     proto += "  default_backward_math: ";
     proto += Type_Name(tp<Dtype>());
-    proto += " ";
+    proto += " reshape_cache_size: " + std::to_string(reshape_cache_size) + " ";
     InitNetFromProtoString(proto);
   }
 
@@ -2596,6 +2598,242 @@ TYPED_TEST(NetTest, TestReshape) {
   EXPECT_FALSE(same_spatial_shape);
 }
 
+TYPED_TEST(NetTest, TestForwardCompiled) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  Caffe::set_mode(TypeParam::device);
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  TBlob<Dtype> blob1(2, 3, 12, 10);
+  TBlob<Dtype> blob2(4, 3, 9, 11);
+  filler.Fill(&blob1);
+  filler.Fill(&blob2);
+
+  this->InitReshapableNet();
+  ASSERT_EQ(TEST, this->net_->phase());
+  EXPECT_FALSE(this->net_->compiled());
+  Blob* input_blob = this->net_->input_blobs()[0];
+  Blob* output_blob = this->net_->output_blobs()[0];
+  for (TBlob<Dtype>* blob : {&blob1, &blob2, &blob1}) {
+    input_blob->Reshape(blob->shape());
+    caffe_copy<Dtype>(blob->count(), blob->cpu_data(), input_blob->mutable_cpu_data<Dtype>());
+    this->net_->Forward();
+    TBlob<Dtype> expected;
+    expected.CopyFrom(*output_blob, false, true);
+    // Recompiled for the new input shape, then run from the plan
+    for (int i = 0; i < 2; ++i) {
+      this->net_->ForwardCompiled();
+      EXPECT_TRUE(this->net_->compiled());
+      ASSERT_EQ(expected.shape(), output_blob->shape());
+      for (int j = 0; j < expected.count(); ++j) {
+        EXPECT_NEAR(expected.cpu_data()[j], output_blob->cpu_data<Dtype>()[j],
+            tol<Dtype>(1e-4, 1e-2));
+      }
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestForwardCompiledAfterDataLayer) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_mode(TypeParam::device);
+  const string source = MakeTempFilename();
+  std::ofstream outfile(source.c_str(), std::ofstream::out);
+  outfile << EXAMPLES_SOURCE_DIR "images/cat.jpg 0" << std::endl;
+  outfile << EXAMPLES_SOURCE_DIR "images/fish-bike.jpg 1" << std::endl;
+  outfile.close();
+  // The data layer swaps a new batch into its top on every forward, the
+  // Reshape layer has to share it again
+  const string proto =
+      "name: 'PrefetchingNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'ImageData' "
+      "  top: 'data' "
+      "  top: 'label' "
+      "  image_data_param { "
+      "    source: '" + source + "' "
+      "    batch_size: 1 "
+      "    new_height: 8 "
+      "    new_width: 8 "
+      "    shuffle: false "
+      "    threads: 1 "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'flat' "
+      "  type: 'Reshape' "
+      "  bottom: 'data' "
+      "  top: 'flat' "
+      "  reshape_param { "
+      "    shape { dim: 1 dim: -1 } "
+      "  } "
+      "} ";
+  this->InitNetFromProtoString(proto);
+  const shared_ptr<Blob> data = this->net_->blob_by_name("data");
+  const shared_ptr<Blob> label = this->net_->blob_by_name("label");
+  const shared_ptr<Blob> flat = this->net_->blob_by_name("flat");
+  for (int i = 0; i < 4; ++i) {
+    this->net_->ForwardCompiled();
+    EXPECT_EQ(i % 2, static_cast<int>(label->cpu_data<Dtype>()[0]));
+    ASSERT_EQ(data->count(), flat->count());
+    for (int j = 0; j < data->count(); ++j) {
+      EXPECT_EQ(data->cpu_data<Dtype>()[j], flat->cpu_data<Dtype>()[j]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestReshapeCache) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  Caffe::set_mode(TypeParam::device);
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  TBlob<Dtype> blob1(2, 3, 12, 10);
+  TBlob<Dtype> blob2(4, 3, 9, 11);
+  filler.Fill(&blob1);
+  filler.Fill(&blob2);
+
+  this->InitReshapableNet(2);
+  Blob* input_blob = this->net_->input_blobs()[0];
+  Blob* output_blob = this->net_->output_blobs()[0];
+  vector<TBlob<Dtype>> expected(2);
+  vector<const void*> memory(2);
+  for (int i = 0; i < 4; ++i) {
+    TBlob<Dtype>* blob = i % 2 == 0 ? &blob1 : &blob2;
+    input_blob->Reshape(blob->shape());
+    caffe_copy<Dtype>(blob->count(), blob->cpu_data(), input_blob->mutable_cpu_data<Dtype>());
+    this->net_->Forward();
+    const void* output_memory = output_blob->current_data_memory(false);
+    if (i < 2) {
+      expected[i].CopyFrom(*output_blob, false, true);
+      memory[i] = output_memory;
+      continue;
+    }
+    // Back to a cached shape: same result in the same memory
+    EXPECT_EQ(memory[i % 2], output_memory);
+    ASSERT_EQ(expected[i % 2].shape(), output_blob->shape());
+    for (int j = 0; j < expected[i % 2].count(); ++j) {
+      EXPECT_NEAR(expected[i % 2].cpu_data()[j], output_blob->cpu_data<Dtype>()[j],
+          tol<Dtype>(1e-4, 1e-2));
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestReshapeCacheSplitInput) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  Caffe::set_mode(TypeParam::device);
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  TBlob<Dtype> blob1(2, 3, 12, 10);
+  TBlob<Dtype> blob2(4, 3, 9, 11);
+  filler.Fill(&blob1);
+  filler.Fill(&blob2);
+
+  // Two consumers of the input: the tops of the inserted Split share its
+  // tensors and must not be switched with the other blobs
+  const string proto =
+      "name: 'SplitInputNetwork' "
+      "reshape_cache_size: 2 "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  input_param { "
+      "    shape: { dim: 1 dim: 3 dim: 10 dim: 10 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'conv1' "
+      "  type: 'Convolution' "
+      "  bottom: 'data' "
+      "  top: 'conv1' "
+      "  convolution_param { "
+      "    num_output: 2 "
+      "    kernel_size: 3 "
+      "    weight_filler { "
+      "      type: 'gaussian' "
+      "      std: 0.1 "
+      "    } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'pool1' "
+      "  type: 'Pooling' "
+      "  bottom: 'data' "
+      "  top: 'pool1' "
+      "  pooling_param { "
+      "    pool: MAX "
+      "    kernel_size: 2 "
+      "    stride: 2 "
+      "  } "
+      "} ";
+  this->InitNetFromProtoString(proto);
+  Blob* input_blob = this->net_->input_blobs()[0];
+  ASSERT_EQ(2, this->net_->output_blobs().size());
+  TBlob<Dtype> expected[2][2];
+  for (int i = 0; i < 4; ++i) {
+    TBlob<Dtype>* blob = i % 2 == 0 ? &blob1 : &blob2;
+    input_blob->Reshape(blob->shape());
+    caffe_copy<Dtype>(blob->count(), blob->cpu_data(), input_blob->mutable_cpu_data<Dtype>());
+    this->net_->Forward();
+    // The input keeps what the caller wrote
+    ASSERT_EQ(blob->shape(), input_blob->shape());
+    for (int j = 0; j < blob->count(); ++j) {
+      EXPECT_EQ(blob->cpu_data()[j], input_blob->cpu_data<Dtype>()[j]);
+    }
+    for (int k = 0; k < 2; ++k) {
+      Blob* output_blob = this->net_->output_blobs()[k];
+      if (i < 2) {
+        expected[i][k].CopyFrom(*output_blob, false, true);
+        continue;
+      }
+      ASSERT_EQ(expected[i % 2][k].shape(), output_blob->shape());
+      for (int j = 0; j < output_blob->count(); ++j) {
+        EXPECT_NEAR(expected[i % 2][k].cpu_data()[j], output_blob->cpu_data<Dtype>()[j],
+            tol<Dtype>(1e-4, 1e-2));
+      }
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestFrozenNet) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  Caffe::set_mode(TypeParam::device);
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  TBlob<Dtype> blob(2, 3, 12, 10);
+  filler.Fill(&blob);
+
+  this->InitReshapableNet();
+  NetParameter frozen_param;
+  this->net_->ToFrozenProto(&frozen_param);
+  EXPECT_TRUE(frozen_param.frozen());
+  EXPECT_EQ(this->net_->layers().size(), frozen_param.layer_size());
+  const string frozen_file = MakeTempFilename();
+  WriteProtoToBinaryFile(frozen_param, frozen_file);
+  Net frozen_net(Net::FrozenFile{frozen_file});
+  EXPECT_EQ(this->net_->layer_names(), frozen_net.layer_names());
+  // Same weights, so the same output
+  for (Net* net : {this->net_.get(), &frozen_net}) {
+    Blob* input_blob = net->input_blobs()[0];
+    input_blob->Reshape(blob.shape());
+    caffe_copy<Dtype>(blob.count(), blob.cpu_data(), input_blob->mutable_cpu_data<Dtype>());
+    net->Forward();
+  }
+  Blob* output_blob = this->net_->output_blobs()[0];
+  Blob* frozen_output_blob = frozen_net.output_blobs()[0];
+  ASSERT_EQ(output_blob->shape(), frozen_output_blob->shape());
+  for (int j = 0; j < output_blob->count(); ++j) {
+    EXPECT_EQ(output_blob->cpu_data<Dtype>()[j], frozen_output_blob->cpu_data<Dtype>()[j]);
+  }
+}
+
 TYPED_TEST(NetTest, TestSkipPropagateDown) {
   // check bottom_need_backward if propagate_down is true
   this->InitSkipPropNet(false);
@@ -0,0 +1,75 @@
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/read_ahead.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class FileReadAheadTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    for (int i = 0; i < 8; ++i) {
+      files_.push_back(MakeTempFilename());
+      std::ofstream ofs(files_.back().c_str(), std::ios::binary);
+      ofs << "content " << i;
+    }
+  }
+  void TearDown() override {
+    for (const string& f : files_) {
+      std::remove(f.c_str());
+    }
+  }
+
+  vector<string> files_;
+};
+
+TEST_F(FileReadAheadTest, TestTake) {
+  FileReadAhead read_ahead(2, 16UL);
+  for (const string& f : files_) {
+    read_ahead.Request(f);
+  }
+  string content;
+  for (size_t i = 0UL; i < files_.size(); ++i) {
+    // Not started reads are handed back to the caller
+    if (read_ahead.Take(files_[i], &content)) {
+      EXPECT_EQ("content " + std::to_string(i), content);
+    }
+  }
+  EXPECT_EQ(files_.size(), read_ahead.hits() + read_ahead.misses());
+  // Taken already
+  EXPECT_FALSE(read_ahead.Take(files_[0], &content));
+}
+
+TEST_F(FileReadAheadTest, TestBounded) {
+  FileReadAhead read_ahead(1, 2UL);
+  for (const string& f : files_) {
+    read_ahead.Request(f);
+  }
+  string content;
+  size_t taken = 0UL;
+  for (const string& f : files_) {
+    taken += read_ahead.Take(f, &content) ? 1UL : 0UL;
+  }
+  EXPECT_LE(taken, 2UL);
+}
+
+TEST_F(FileReadAheadTest, TestMissingFile) {
+  FileReadAhead read_ahead(1, 4UL);
+  const string missing = files_[0] + ".missing";
+  read_ahead.Request(missing);
+  string content;
+  EXPECT_FALSE(read_ahead.Take(missing, &content));
+  EXPECT_FALSE(FileReadAhead::ReadFile(missing, &content));
+  EXPECT_TRUE(FileReadAhead::ReadFile(files_[3], &content));
+  EXPECT_EQ("content 3", content);
+}
+
+}  // namespace caffe
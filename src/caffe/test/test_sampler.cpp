@@ -0,0 +1,161 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/bbox_util.hpp"
+#include "caffe/util/sampler.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class SamplerTest : public ::testing::Test {
+ protected:
+  SamplerTest() {
+    Caffe::set_random_seed(1701);
+    batch_sampler_.mutable_sampler()->set_min_scale(0.3f);
+    batch_sampler_.mutable_sampler()->set_min_aspect_ratio(0.5f);
+    batch_sampler_.mutable_sampler()->set_max_aspect_ratio(2.f);
+    batch_sampler_.set_max_trials(50);
+    unit_bbox_.set_xmin(0.f);
+    unit_bbox_.set_ymin(0.f);
+    unit_bbox_.set_xmax(1.f);
+    unit_bbox_.set_ymax(1.f);
+    AddObject(0.2f, 0.2f, 0.6f, 0.7f);
+  }
+
+  // Compares GenerateSamples with the per-trial path: every trial checked by
+  // SatisfySampleConstraint until max_sample of them pass. The random numbers
+  // drawn do not depend on the constraint, so an unconstrained run from the
+  // same seed yields the trials the constrained run has seen. Accepted bboxes
+  // must be exactly those which satisfy the constraint, in the same order,
+  // hence every rejected trial must fail it.
+  void CheckAgainstPerTrial() {
+    const int kSeed = 1701;
+    BatchSampler unconstrained(batch_sampler_);
+    unconstrained.clear_sample_constraint();
+    unconstrained.clear_max_sample();
+    vector<NormalizedBBox> trials;
+    Caffe::set_random_seed(kSeed);
+    GenerateSamples(unit_bbox_, objects_, unconstrained, &trials);
+    ASSERT_EQ(batch_sampler_.max_trials(), trials.size());
+
+    vector<NormalizedBBox> sampled;
+    SamplerStats stats;
+    Caffe::set_random_seed(kSeed);
+    GenerateSamples(unit_bbox_, objects_, batch_sampler_, &sampled, &stats);
+
+    const size_t max_sample = batch_sampler_.has_max_sample() ?
+        batch_sampler_.max_sample() : trials.size();
+    vector<NormalizedBBox> expected;
+    size_t checked = 0UL, rejected = 0UL;
+    for (const NormalizedBBox& trial : trials) {
+      if (expected.size() >= max_sample) {
+        break;
+      }
+      ++checked;
+      if (SatisfySampleConstraint(trial, objects_, batch_sampler_.sample_constraint())) {
+        expected.push_back(trial);
+      } else {
+        ++rejected;
+      }
+    }
+    // Both outcomes are exercised
+    EXPECT_GT(rejected, 0UL);
+    EXPECT_GT(expected.size(), 0UL);
+    EXPECT_EQ(checked, stats.trials);
+    EXPECT_EQ(expected.size(), stats.accepted);
+    ASSERT_EQ(expected.size(), sampled.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+      EXPECT_EQ(expected[i].xmin(), sampled[i].xmin());
+      EXPECT_EQ(expected[i].ymin(), sampled[i].ymin());
+      EXPECT_EQ(expected[i].xmax(), sampled[i].xmax());
+      EXPECT_EQ(expected[i].ymax(), sampled[i].ymax());
+    }
+  }
+
+  void AddObject(float xmin, float ymin, float xmax, float ymax) {
+    NormalizedBBox object;
+    object.set_xmin(xmin);
+    object.set_ymin(ymin);
+    object.set_xmax(xmax);
+    object.set_ymax(ymax);
+    objects_.push_back(object);
+  }
+
+  BatchSampler batch_sampler_;
+  NormalizedBBox unit_bbox_;
+  vector<NormalizedBBox> objects_;
+};
+
+TEST_F(SamplerTest, TestUnconstrained) {
+  vector<NormalizedBBox> sampled;
+  SamplerStats stats;
+  GenerateSamples(unit_bbox_, objects_, batch_sampler_, &sampled, &stats);
+  EXPECT_EQ(50UL, sampled.size());
+  EXPECT_EQ(50UL, stats.trials);
+  EXPECT_EQ(50UL, stats.accepted);
+  for (const NormalizedBBox& bbox : sampled) {
+    EXPECT_GE(bbox.xmin(), 0.f);
+    EXPECT_GE(bbox.ymin(), 0.f);
+    EXPECT_LE(bbox.xmax(), 1.f + 1e-6f);
+    EXPECT_LE(bbox.ymax(), 1.f + 1e-6f);
+    EXPECT_GE(BBoxSize(bbox), 0.3f * 0.3f - 1e-6f);
+  }
+}
+
+TEST_F(SamplerTest, TestConstrained) {
+  batch_sampler_.mutable_sample_constraint()->set_min_jaccard_overlap(0.5f);
+  batch_sampler_.set_max_sample(1);
+  vector<NormalizedBBox> sampled;
+  SamplerStats stats;
+  for (int i = 0; i < 100; ++i) {
+    GenerateSamples(unit_bbox_, objects_, batch_sampler_, &sampled, &stats);
+  }
+  EXPECT_GT(stats.trials, stats.accepted);
+  EXPECT_EQ(sampled.size(), stats.accepted);
+  EXPECT_LE(sampled.size(), 100UL);
+  for (const NormalizedBBox& bbox : sampled) {
+    EXPECT_TRUE(SatisfySampleConstraint(bbox, objects_,
+        batch_sampler_.sample_constraint()));
+  }
+}
+
+TEST_F(SamplerTest, TestJaccardMatchesPerTrial) {
+  AddObject(0.5f, 0.1f, 0.9f, 0.4f);
+  batch_sampler_.set_max_trials(200);
+  batch_sampler_.mutable_sample_constraint()->set_min_jaccard_overlap(0.3f);
+  batch_sampler_.mutable_sample_constraint()->set_max_jaccard_overlap(0.7f);
+  CheckAgainstPerTrial();
+}
+
+TEST_F(SamplerTest, TestSampleCoverageMatchesPerTrial) {
+  AddObject(0.5f, 0.1f, 0.9f, 0.4f);
+  batch_sampler_.set_max_trials(200);
+  batch_sampler_.mutable_sample_constraint()->set_min_sample_coverage(0.5f);
+  CheckAgainstPerTrial();
+}
+
+TEST_F(SamplerTest, TestObjectCoverageMatchesPerTrial) {
+  AddObject(0.5f, 0.1f, 0.9f, 0.4f);
+  batch_sampler_.set_max_trials(200);
+  batch_sampler_.mutable_sample_constraint()->set_min_object_coverage(0.9f);
+  CheckAgainstPerTrial();
+  // Stopping at max_sample checks only the trials up to the last accepted
+  batch_sampler_.set_max_sample(3);
+  CheckAgainstPerTrial();
+}
+
+TEST_F(SamplerTest, TestNoObjects) {
+  batch_sampler_.mutable_sample_constraint()->set_min_object_coverage(0.1f);
+  vector<NormalizedBBox> sampled;
+  SamplerStats stats;
+  GenerateSamples(unit_bbox_, vector<NormalizedBBox>(), batch_sampler_,
+      &sampled, &stats);
+  EXPECT_EQ(0UL, sampled.size());
+  EXPECT_EQ(50UL, stats.trials);
+  EXPECT_EQ(0.f, stats.acceptance_rate());
+}
+
+}  // namespace caffe
@@ -0,0 +1,79 @@
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/video_reader.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class VideoReaderTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    video_ = MakeTempDir() + "/video.avi";
+    missing_ = video_ + ".missing";
+    cv::VideoWriter writer(video_, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), 10.,
+        cv::Size(32, 24));
+    ASSERT_TRUE(writer.isOpened());
+    for (int i = 0; i < kFrames; ++i) {
+      writer.write(cv::Mat(24, 32, CV_8UC3, cv::Scalar(i * 20, i * 20, i * 20)));
+    }
+    param_.set_video_type(VideoDataParameter_VideoType_VIDEO);
+    param_.set_clip_length(2);
+  }
+
+  // Takes all clips of a non-looping reader
+  int PopAll(VideoReader* reader, int label) {
+    int clips = 0;
+    while (shared_ptr<VideoClip> clip = reader->pop_full()) {
+      EXPECT_EQ(label, clip->label);
+      EXPECT_EQ(2UL, clip->frames.size());
+      EXPECT_EQ(24, clip->frames[0].rows);
+      EXPECT_EQ(32, clip->frames[0].cols);
+      reader->push_free(clip);
+      ++clips;
+    }
+    return clips;
+  }
+
+  static constexpr int kFrames = 8;
+  string video_;
+  string missing_;
+  VideoDataParameter param_;
+};
+
+constexpr int VideoReaderTest::kFrames;
+
+TEST_F(VideoReaderTest, TestClips) {
+  param_.set_decode_threads(1);
+  VideoReader reader(param_, {{video_, 3}}, 0UL);
+  reader.StartInternalThread();
+  EXPECT_EQ(kFrames / 2, PopAll(&reader, 3));
+  EXPECT_FALSE(reader.pop_full());
+}
+
+TEST_F(VideoReaderTest, TestFailedSource) {
+  // The thread given the missing source is done first, the other one still
+  // decodes: neither peek_full nor pop_full takes that for the end
+  param_.set_decode_threads(2);
+  VideoReader reader(param_, {{missing_, 0}, {video_, 1}}, 0UL);
+  reader.StartInternalThread();
+  shared_ptr<VideoClip> clip = reader.peek_full();
+  ASSERT_TRUE(clip);
+  EXPECT_EQ(1, clip->label);
+  EXPECT_EQ(kFrames / 2, PopAll(&reader, 1));
+}
+
+TEST_F(VideoReaderTest, TestNoSourceDecodable) {
+  param_.set_decode_threads(2);
+  VideoReader reader(param_, {{missing_, 0}, {missing_, 1}}, 0UL);
+  reader.StartInternalThread();
+  EXPECT_FALSE(reader.peek_full());
+  EXPECT_FALSE(reader.pop_full());
+}
+
+}  // namespace caffe
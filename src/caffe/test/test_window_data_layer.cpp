@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/window_data_layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class WindowDataLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  WindowDataLayerTest()
+      : seed_(1701),
+        blob_top_data_(new TBlob<Dtype>()),
+        blob_top_label_(new TBlob<Dtype>()) {}
+  virtual void SetUp() {
+    blob_top_vec_.push_back(blob_top_data_);
+    blob_top_vec_.push_back(blob_top_label_);
+    // One foreground window on the cat, inside the image even after context
+    // padding, and background windows on both images which get clipped
+    filename_ = MakeTempFilename();
+    std::ofstream outfile(filename_.c_str(), std::ofstream::out);
+    LOG(INFO) << "Using temporary file " << filename_;
+    outfile << "# 0\n" EXAMPLES_SOURCE_DIR "images/cat.jpg\n3 360 480\n3\n"
+            << "1 1.0 100 80 139 119\n"
+            << "0 0.0 0 0 30 30\n"
+            << "0 0.0 440 320 479 359\n";
+    outfile << "# 1\n" EXAMPLES_SOURCE_DIR "images/fish-bike.jpg\n3 323 481\n2\n"
+            << "0 0.0 0 290 60 322\n"
+            << "0 0.0 200 100 260 200\n";
+    outfile.close();
+  }
+
+  virtual ~WindowDataLayerTest() {
+    delete blob_top_data_;
+    delete blob_top_label_;
+  }
+
+  void FillParam(LayerParameter* param, unsigned int crop_threads) {
+    WindowDataParameter* window_param = param->mutable_window_data_param();
+    window_param->set_source(filename_.c_str());
+    window_param->set_batch_size(kBatchSize);
+    window_param->set_fg_fraction(0.5F);
+    window_param->set_context_pad(kContextPad);
+    window_param->set_crop_threads(crop_threads);
+    TransformationParameter* transform_param = param->mutable_transform_param();
+    transform_param->set_crop_size(kCropSize);
+    transform_param->set_mirror(true);
+    for (int c = 0; c < 3; ++c) {
+      transform_param->add_mean_value(kMean[c]);
+    }
+  }
+
+  // Runs a fresh layer from the same seed and copies its first batch out
+  void ReadBatch(unsigned int crop_threads, vector<Dtype>* data, vector<Dtype>* labels) {
+    Caffe::set_random_seed(seed_);
+    LayerParameter param;
+    FillParam(&param, crop_threads);
+    WindowDataLayer<Dtype, Dtype> layer(param, 0UL);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    layer.Forward(blob_bottom_vec_, blob_top_vec_);
+    data->assign(blob_top_data_->cpu_data(), blob_top_data_->cpu_data() + blob_top_data_->count());
+    labels->assign(blob_top_label_->cpu_data(),
+        blob_top_label_->cpu_data() + blob_top_label_->count());
+  }
+
+  static constexpr int kBatchSize = 8;
+  static constexpr int kCropSize = 16;
+  static constexpr int kContextPad = 4;
+  static constexpr float kMean[3] = {104.F, 117.F, 123.F};
+
+  int seed_;
+  string filename_;
+  TBlob<Dtype>* const blob_top_data_;
+  TBlob<Dtype>* const blob_top_label_;
+  vector<Blob*> blob_bottom_vec_;
+  vector<Blob*> blob_top_vec_;
+};
+
+template <typename TypeParam> constexpr int WindowDataLayerTest<TypeParam>::kBatchSize;
+template <typename TypeParam> constexpr int WindowDataLayerTest<TypeParam>::kCropSize;
+template <typename TypeParam> constexpr int WindowDataLayerTest<TypeParam>::kContextPad;
+template <typename TypeParam> constexpr float WindowDataLayerTest<TypeParam>::kMean[3];
+
+TYPED_TEST_CASE(WindowDataLayerTest, TestDtypesAndCPUOnly);
+
+TYPED_TEST(WindowDataLayerTest, TestCropThreads) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<Dtype> data1, labels1, data4, labels4;
+  this->ReadBatch(1U, &data1, &labels1);
+  EXPECT_EQ(this->kBatchSize, this->blob_top_data_->num());
+  EXPECT_EQ(3, this->blob_top_data_->channels());
+  EXPECT_EQ(this->kCropSize, this->blob_top_data_->height());
+  EXPECT_EQ(this->kCropSize, this->blob_top_data_->width());
+  this->ReadBatch(4U, &data4, &labels4);
+  ASSERT_EQ(data1.size(), data4.size());
+  ASSERT_EQ(labels1.size(), labels4.size());
+  for (size_t i = 0; i < labels1.size(); ++i) {
+    EXPECT_EQ(labels1[i], labels4[i]);
+  }
+  for (size_t i = 0; i < data1.size(); ++i) {
+    EXPECT_EQ(data1[i], data4[i]) << "at " << i;
+  }
+}
+
+TYPED_TEST(WindowDataLayerTest, TestWarpReference) {
+  typedef typename TypeParam::Dtype Dtype;
+  const int crop_size = this->kCropSize;
+  // context_scale = 16 / (16 - 2 * 4) = 2 doubles the 40x40 window around its
+  // center (120, 100) to [80, 160] x [60, 140], all of it inside the image
+  cv::Mat cat = cv::imread(EXAMPLES_SOURCE_DIR "images/cat.jpg", cv::IMREAD_COLOR);
+  ASSERT_TRUE(cat.data);
+  cv::Mat warped[2];
+  cv::resize(cat(cv::Rect(80, 60, 81, 81)), warped[0], cv::Size(crop_size, crop_size),
+      0, 0, cv::INTER_LINEAR);
+  cv::flip(warped[0], warped[1], 1);
+  vector<Dtype> expected[2];
+  for (int m = 0; m < 2; ++m) {
+    for (int c = 0; c < 3; ++c) {
+      for (int h = 0; h < crop_size; ++h) {
+        for (int w = 0; w < crop_size; ++w) {
+          expected[m].push_back(static_cast<Dtype>(
+              static_cast<float>(warped[m].at<cv::Vec3b>(h, w)[c]) - this->kMean[c]));
+        }
+      }
+    }
+  }
+
+  const int item_len = 3 * crop_size * crop_size;
+  int found[2] = {0, 0};
+  for (int iter = 0; iter < 4; ++iter) {
+    vector<Dtype> data, labels;
+    this->ReadBatch(4U, &data, &labels);
+    this->seed_ += 1;
+    for (int item = 0; item < this->kBatchSize; ++item) {
+      if (labels[item] != Dtype(1)) {
+        continue;
+      }
+      const Dtype* window = &data[item * item_len];
+      bool matched = false;
+      for (int m = 0; m < 2 && !matched; ++m) {
+        if (std::equal(window, window + item_len, expected[m].begin())) {
+          ++found[m];
+          matched = true;
+        }
+      }
+      EXPECT_TRUE(matched) << "foreground window " << item << " differs from the reference";
+    }
+  }
+  // Half of every batch is foreground, both orientations show up
+  EXPECT_EQ(4 * this->kBatchSize / 2, found[0] + found[1]);
+  EXPECT_GT(found[0], 0);
+  EXPECT_GT(found[1], 0);
+}
+
+}  // namespace caffe
@@ -1,15 +1,18 @@
 #include <boost/thread.hpp>
+#include <chrono>
 #include <string>
 
 #include "caffe/data_reader.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/metrics.hpp"
+#include "caffe/video_reader.hpp"
 
 namespace caffe {
 
 template<typename T>
-BlockingQueue<T>::BlockingQueue() {}
+BlockingQueue<T>::BlockingQueue() : wait_metric_(nullptr) {}
 
 template<typename T>
 BlockingQueue<T>::~BlockingQueue() {}
@@ -36,23 +39,43 @@ bool BlockingQueue<T>::try_pop(T* t) {
 template<typename T>
 T BlockingQueue<T>::pop(const char* log_on_wait) {
   boost::mutex::scoped_lock lock(mutex_);
+  const bool timed = wait_metric_ != nullptr && queue_.empty();
+  std::chrono::steady_clock::time_point wait_start;
+  if (timed) {
+    wait_start = std::chrono::steady_clock::now();
+  }
   while (queue_.empty()) {
     LOG_EVERY_N(INFO, 10000) << log_on_wait;
     condition_.wait(lock);
   }
   T t = queue_.front();
   queue_.pop();
+  lock.unlock();
+  if (timed) {
+    wait_metric_->Add(std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - wait_start).count());
+  }
   return t;
 }
 
 template<typename T>
 T BlockingQueue<T>::pop() {
   boost::mutex::scoped_lock lock(mutex_);
+  const bool timed = wait_metric_ != nullptr && queue_.empty();
+  std::chrono::steady_clock::time_point wait_start;
+  if (timed) {
+    wait_start = std::chrono::steady_clock::now();
+  }
   while (queue_.empty()) {
     condition_.wait(lock);
   }
   T t(queue_.front());
   queue_.pop();
+  lock.unlock();
+  if (timed) {
+    wait_metric_->Add(std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - wait_start).count());
+  }
   return t;
 }
 
@@ -96,6 +119,7 @@ template class BlockingQueue<shared_ptr<Batch>>;
 template class BlockingQueue<shared_ptr<Datum>>;
 template class BlockingQueue<shared_ptr<AnnotatedDatum>>;
 template class BlockingQueue<P2PSync*>;
+template class BlockingQueue<shared_ptr<VideoClip>>;
 template class BlockingQueue<shared_ptr<caffe::TBlob<float>>>;
 template class BlockingQueue<shared_ptr<caffe::TBlob<double>>>;
 template class BlockingQueue<shared_ptr<caffe::TBlob<float16>>>;
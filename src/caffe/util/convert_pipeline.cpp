@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <iomanip>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "caffe/util/convert_pipeline.hpp"
+
+namespace caffe {
+
+ConvertPipeline::ConvertPipeline(db::DB* db, int num_threads,
+    size_t queue_depth, size_t commit_interval, bool sorted_keys)
+    : db_(db),
+      num_threads_(num_threads > 0 ? num_threads : default_threads()),
+      queue_depth_(std::max<size_t>(queue_depth, 1UL)),
+      commit_interval_(std::max<size_t>(commit_interval, 1UL)),
+      sorted_keys_(sorted_keys),
+      num_items_(0UL),
+      next_item_(0UL),
+      written_(0UL),
+      records_(0UL),
+      bytes_(0UL) {
+  CHECK_NOTNULL(db_);
+}
+
+int ConvertPipeline::default_threads() {
+  return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+size_t ConvertPipeline::Run(size_t num_items, const Encoder& encoder) {
+  num_items_ = num_items;
+  next_item_ = 0UL;
+  written_ = 0UL;
+  records_ = 0UL;
+  bytes_ = 0UL;
+  slots_.clear();
+  slots_.resize(queue_depth_);
+  start_ = std::chrono::steady_clock::now();
+  LOG(INFO) << "Converting " << num_items_ << " items using " << num_threads_
+            << " reader threads, queue depth " << queue_depth_
+            << (sorted_keys_ ? ", append mode" : "");
+
+  std::thread writer(&ConvertPipeline::WriterEntry, this);
+  vector<std::thread> readers;
+  readers.reserve(num_threads_);
+  for (int i = 0; i < num_threads_; ++i) {
+    readers.emplace_back(&ConvertPipeline::ReaderEntry, this, std::cref(encoder));
+  }
+  for (std::thread& reader : readers) {
+    reader.join();
+  }
+  writer.join();
+  return records_;
+}
+
+void ConvertPipeline::ReaderEntry(const Encoder& encoder) {
+  string key, value;
+  while (true) {
+    size_t index;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (next_item_ >= num_items_) {
+        return;
+      }
+      index = next_item_++;
+      // The slot is ours once the writer consumed the item queue_depth_ back
+      slot_free_.wait(lock, [&] { return index < written_ + queue_depth_; });
+    }
+    key.clear();
+    value.clear();
+    const bool ok = encoder(index, &key, &value);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      Slot& slot = slots_[index % queue_depth_];
+      slot.key.swap(key);
+      slot.value.swap(value);
+      slot.ok = ok;
+      slot.ready = true;
+    }
+    slot_ready_.notify_all();
+  }
+}
+
+void ConvertPipeline::WriterEntry() {
+  unique_ptr<db::Transaction> txn(sorted_keys_ ?
+      db_->NewAppendTransaction() : db_->NewTransaction());
+  size_t in_txn = 0UL;
+  string key, value;
+  for (size_t index = 0UL; index < num_items_; ++index) {
+    bool ok;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      Slot& slot = slots_[index % queue_depth_];
+      slot_ready_.wait(lock, [&] { return slot.ready; });
+      // Swapping keeps string capacities cycling between slots and the writer
+      key.swap(slot.key);
+      value.swap(slot.value);
+      ok = slot.ok;
+      slot.ready = false;
+      ++written_;
+    }
+    slot_free_.notify_all();
+    if (!ok) {
+      continue;
+    }
+    txn->Put(key, value);
+    bytes_ += value.size();
+    ++records_;
+    if (++in_txn == commit_interval_) {
+      txn->Commit();
+      txn.reset(sorted_keys_ ? db_->NewAppendTransaction() : db_->NewTransaction());
+      in_txn = 0UL;
+      ReportProgress(false);
+    }
+  }
+  if (in_txn > 0UL) {
+    txn->Commit();
+  }
+  ReportProgress(true);
+}
+
+void ConvertPipeline::ReportProgress(bool last) {
+  const double elapsed = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start_).count();
+  const double rate = elapsed > 0. ? records_ / elapsed : 0.;
+  const double mb_rate = elapsed > 0. ? bytes_ / 1048576. / elapsed : 0.;
+  LOG(INFO) << "Processed " << records_ << " files" << (last ? " total" : "")
+            << " (" << written_ << "/" << num_items_ << "), "
+            << std::fixed << std::setprecision(1) << rate << " files/s, "
+            << mb_rate << " MB/s";
+}
+
+}  // namespace caffe
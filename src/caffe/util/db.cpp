@@ -2,7 +2,10 @@
 #include "caffe/util/db_leveldb.hpp"
 #include "caffe/util/db_lmdb.hpp"
 
+#include <algorithm>
+#include <map>
 #include <string>
+#include <utility>
 
 namespace caffe { namespace db {
 
@@ -37,5 +40,55 @@ DB* GetDB(const string& backend) {
   return NULL;
 }
 
+std::mutex KeyIndex::mutex_;
+
+shared_ptr<KeyIndex> KeyIndex::Get(DB* db, const string& source, size_t stride) {
+  // The global lock only covers the map, the scan runs under the entry's own
+  // lock so that only those asking for the same source and stride wait for it
+  struct Entry {
+    std::mutex mutex;
+    weak_ptr<KeyIndex> index;
+  };
+  static std::map<std::pair<string, size_t>, shared_ptr<Entry>> indices;
+  shared_ptr<Entry> entry;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shared_ptr<Entry>& slot = indices[std::make_pair(source, stride)];
+    if (!slot) {
+      slot = make_shared<Entry>();
+    }
+    entry = slot;
+  }
+  std::lock_guard<std::mutex> lock(entry->mutex);
+  shared_ptr<KeyIndex> index = entry->index.lock();
+  if (!index) {
+    index = make_shared<KeyIndex>(db, stride);
+    entry->index = index;
+    LOG(INFO) << "Indexed " << index->records() << " records of " << source
+              << " with " << index->keys_.size() << " keys";
+  }
+  return index;
+}
+
+KeyIndex::KeyIndex(DB* db, size_t stride)
+    : stride_(std::max(stride, 1UL)), records_(0UL) {
+  unique_ptr<Cursor> cursor(db->NewCursor());
+  for (cursor->SeekToFirst(); cursor->valid(); cursor->Next(), ++records_) {
+    if (records_ % stride_ == 0UL) {
+      keys_.push_back(cursor->key());
+    }
+  }
+  CHECK_GT(records_, 0UL) << "Empty database";
+}
+
+void KeyIndex::Seek(Cursor* cursor, size_t pos) const {
+  pos %= records_;
+  cursor->SeekToKey(keys_[pos / stride_]);
+  for (size_t i = pos % stride_; i > 0UL; --i) {
+    cursor->Next();
+  }
+  CHECK(cursor->valid()) << "Database changed since it was indexed";
+}
+
 }  // namespace db
 }  // namespace caffe
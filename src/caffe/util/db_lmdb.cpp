@@ -3,6 +3,7 @@
 
 #include <sys/stat.h>
 
+#include <algorithm>
 #include <string>
 
 namespace caffe { namespace db {
@@ -49,58 +50,131 @@ LMDBTransaction* LMDB::NewTransaction() {
   return new LMDBTransaction(mdb_env_);
 }
 
-void LMDBTransaction::Put(const string& key, const string& value) {
-  keys.push_back(key);
-  values.push_back(value);
+LMDBTransaction* LMDB::NewAppendTransaction() {
+  return new LMDBTransaction(mdb_env_, MDB_APPEND, true);
 }
 
-void LMDBTransaction::Commit() {
-  MDB_dbi mdb_dbi;
+constexpr size_t LMDBTransaction::kCheckpointBytes;
+constexpr size_t LMDBTransaction::kGrowRecords;
+constexpr size_t LMDBTransaction::kReservePages;
+
+LMDBTransaction::LMDBTransaction(MDB_env* mdb_env, unsigned int put_flags,
+    bool checkpoints)
+    : mdb_env_(mdb_env),
+      put_flags_(put_flags),
+      checkpoints_(checkpoints),
+      mdb_txn_(nullptr),
+      mdb_dbi_(),
+      free_bytes_(0UL),
+      txn_bytes_(0UL),
+      records_(0UL),
+      record_bytes_(0UL),
+      replay_bytes_(0UL) {
+  MDB_stat stat;
+  MDB_CHECK(mdb_env_stat(mdb_env_, &stat));
+  page_size_ = stat.ms_psize;
+}
+
+LMDBTransaction::~LMDBTransaction() {
+  if (mdb_txn_ != nullptr) {
+    mdb_txn_abort(mdb_txn_);
+  }
+}
+
+// Rough upper bound of the map space taken by one record: values which
+// don't fit into a leaf node go to their own overflow pages, small records
+// are counted twice since leaves are only half full after a split.
+size_t LMDBTransaction::Footprint(size_t key_size, size_t value_size) const {
+  const size_t node_size = key_size + value_size + 8UL;
+  if (node_size * 2UL > page_size_) {
+    return (value_size + 16UL + page_size_ - 1UL) / page_size_ * page_size_ +
+        2UL * (key_size + 16UL);
+  }
+  return 2UL * (node_size + 2UL);
+}
+
+void LMDBTransaction::Begin(size_t need, bool grow) {
+  MDB_envinfo info;
+  MDB_CHECK(mdb_env_info(mdb_env_, &info));
+  const size_t used = (info.me_last_pgno + 1UL) * page_size_;
+  size_t map_size = info.me_mapsize;
+  if (grow || used + need > map_size) {
+    // Room for at least kGrowRecords more records of the average size seen
+    // so far, and at least double of what is used already
+    const size_t avg = records_ > 0UL ? record_bytes_ / records_ : need;
+    map_size = std::max(used + need + std::max(used, avg * kGrowRecords),
+        info.me_mapsize + (grow ? info.me_mapsize / 2UL : 0UL));
+    map_size = (map_size + page_size_ - 1UL) / page_size_ * page_size_;
+    DLOG(INFO) << "Growing LMDB map size to " << (map_size >> 20) << "MB ...";
+    MDB_CHECK(mdb_env_set_mapsize(mdb_env_, map_size));
+  }
+  free_bytes_ = map_size - used;
+  txn_bytes_ = 0UL;
+  MDB_CHECK(mdb_txn_begin(mdb_env_, NULL, 0, &mdb_txn_));
+  MDB_CHECK(mdb_dbi_open(mdb_txn_, NULL, 0, &mdb_dbi_));
+}
+
+void LMDBTransaction::Checkpoint() {
+  MDB_CHECK(mdb_txn_commit(mdb_txn_));
+  mdb_txn_ = nullptr;
+  replay_.clear();
+  replay_bytes_ = 0UL;
+}
+
+bool LMDBTransaction::TryPut(const string& key, const string& value) {
   MDB_val mdb_key, mdb_data;
-  MDB_txn *mdb_txn;
-
-  // Initialize MDB variables
-  MDB_CHECK(mdb_txn_begin(mdb_env_, NULL, 0, &mdb_txn));
-  MDB_CHECK(mdb_dbi_open(mdb_txn, NULL, 0, &mdb_dbi));
-
-  bool out_of_memory = false;
-  for (int i = 0; i < keys.size(); i++) {
-    mdb_key.mv_size = keys[i].size();
-    mdb_key.mv_data = const_cast<char*>(keys[i].data());
-    mdb_data.mv_size = values[i].size();
-    mdb_data.mv_data = const_cast<char*>(values[i].data());
-
-    int put_rc = mdb_put(mdb_txn, mdb_dbi, &mdb_key, &mdb_data, 0);
-    if (put_rc == MDB_MAP_FULL) {
-      out_of_memory = true;
-      break;
-    } else {
-      // Failed for some other reason
-      MDB_CHECK(put_rc);
-    }
+  mdb_key.mv_size = key.size();
+  mdb_key.mv_data = const_cast<char*>(key.data());
+  mdb_data.mv_size = value.size();
+  mdb_data.mv_data = const_cast<char*>(value.data());
+  int put_rc = mdb_put(mdb_txn_, mdb_dbi_, &mdb_key, &mdb_data, put_flags_);
+  if (put_rc == MDB_MAP_FULL) {
+    return false;
+  }
+  MDB_CHECK(put_rc);
+  return true;
+}
+
+// Grows the map, starts the txn over and replays what was put since the
+// last checkpoint, followed by the new record
+void LMDBTransaction::Regrow(const string& key, const string& value, size_t footprint) {
+  mdb_txn_abort(mdb_txn_);
+  mdb_txn_ = nullptr;
+  const size_t replayed = txn_bytes_;
+  Begin(2UL * (replayed + footprint) + kReservePages * page_size_, true);
+  for (const pair<string, string>& kv : replay_) {
+    CHECK(TryPut(kv.first, kv.second)) << "LMDB map is full after growing";
   }
+  CHECK(TryPut(key, value)) << "LMDB map is full after growing";
+  txn_bytes_ = replayed;
+}
 
-  if (!out_of_memory) {
-    // Commit the transaction
-    MDB_CHECK(mdb_txn_commit(mdb_txn));
-    mdb_dbi_close(mdb_env_, mdb_dbi);
-    keys.clear();
-    values.clear();
-  } else {
-    // Double the map size and retry
-    mdb_txn_abort(mdb_txn);
-    mdb_dbi_close(mdb_env_, mdb_dbi);
-    DoubleMapSize();
-    Commit();
+void LMDBTransaction::Put(const string& key, const string& value) {
+  const size_t footprint = Footprint(key.size(), value.size());
+  const size_t reserve = kReservePages * page_size_;
+  ++records_;
+  record_bytes_ += footprint;
+  if (checkpoints_ && mdb_txn_ != nullptr && (txn_bytes_ + footprint + reserve > free_bytes_ ||
+      replay_bytes_ >= kCheckpointBytes)) {
+    Checkpoint();
+  }
+  if (mdb_txn_ == nullptr) {
+    Begin(footprint + reserve, false);
   }
+  // Without checkpoints the map is grown before it gets full, or when the
+  // estimate was off and the failed txn is unusable
+  if (txn_bytes_ + footprint + reserve > free_bytes_ || !TryPut(key, value)) {
+    Regrow(key, value, footprint);
+  }
+  txn_bytes_ += footprint;
+  replay_.emplace_back(key, value);
+  replay_bytes_ += key.size() + value.size();
 }
 
-void LMDBTransaction::DoubleMapSize() {
-  struct MDB_envinfo current_info;
-  MDB_CHECK(mdb_env_info(mdb_env_, &current_info));
-  size_t new_size = current_info.me_mapsize * 2;
-  DLOG(INFO) << "Doubling LMDB map size to " << (new_size>>20) << "MB ...";
-  MDB_CHECK(mdb_env_set_mapsize(mdb_env_, new_size));
+void LMDBTransaction::Commit() {
+  if (mdb_txn_ != nullptr) {
+    Checkpoint();
+  }
 }
 
 }  // namespace db
@@ -3,7 +3,6 @@
 
 #include <boost/array.hpp>
 #include <boost/foreach.hpp>
-#include <boost/ref.hpp>
 #include <boost/static_assert.hpp>
 
 #include <algorithm>
@@ -16,26 +15,12 @@
 using namespace cv;  // NOLINT(build/namespaces)
 using boost::array;
 using std::unique_ptr;
-using boost::reference_wrapper;
-using boost::ref;
 
 #define foreach_ BOOST_FOREACH
-#define TRANSFORMED_LABEL_AT(coverageClass, _x, _y, _z) \
-transformedLabels[(coverageClass)->gridROI_.area() * (_z) \
-                + (_y) * (coverageClass)->gridROI_.width \
-                + (_x)]
 
 namespace caffe {
 
 
-template<typename Dtype>
-void zeroCoverage(vector<reference_wrapper<Dtype> >* coverages) {
-  foreach_(reference_wrapper<Dtype>& coverage, *coverages) {
-    coverage.get() = 0.0;
-  }
-}
-
-
 template<typename Dtype>
 CoverageGenerator<Dtype>::CoverageGenerator(
     const DetectNetGroundTruthParameter& param
@@ -232,52 +217,6 @@ Rect CoverageGenerator<Dtype>::imageRectToGridRect(const Rectv& area) const {
 
 BOOST_STATIC_ASSERT(CoverageGenerator<float>::TRANSFORMED_LABEL_SIZE == 8);
 
-template<typename Dtype>
-TransformedLabel_<Dtype>::TransformedLabel_(
-    const CoverageGenerator<Dtype>& cgen,
-    Dtype* transformedLabels,
-    size_t g_x,
-    size_t g_y
-):  // foreground:
-    foreground(TRANSFORMED_LABEL_AT(&cgen, g_x, g_y, 0)),
-    // top left corner x,y:
-    topLeft_x(TRANSFORMED_LABEL_AT(&cgen, g_x, g_y, 1)),
-    topLeft_y(TRANSFORMED_LABEL_AT(&cgen, g_x, g_y, 2)),
-    // bottom right corner x,y:
-    bottomRight_x(TRANSFORMED_LABEL_AT(&cgen, g_x, g_y, 3)),
-    bottomRight_y(TRANSFORMED_LABEL_AT(&cgen, g_x, g_y, 4)),
-    // inverse size:
-    dimension_w(TRANSFORMED_LABEL_AT(&cgen, g_x, g_y, 5)),
-    dimension_h(TRANSFORMED_LABEL_AT(&cgen, g_x, g_y, 6)),
-    // obj_norm
-    obj_norm(TRANSFORMED_LABEL_AT(&cgen, g_x, g_y, 7)),
-    coverages() {
-  size_t coverageDimensions =
-      cgen.label_size_ - CoverageGenerator<Dtype>::TRANSFORMED_LABEL_SIZE;
-  coverages.reserve(coverageDimensions);
-  for (size_t iCoverage = 0;
-      iCoverage != coverageDimensions;
-      ++iCoverage) {
-    Dtype& coverage = TRANSFORMED_LABEL_AT(
-        &cgen,
-        g_x,
-        g_y,
-        CoverageGenerator<Dtype>::TRANSFORMED_LABEL_SIZE + iCoverage);
-
-    coverages.push_back(ref(coverage));
-  }
-}
-
-
-template <typename Dtype>
-TransformedLabel_<Dtype> CoverageGenerator<Dtype>::transformedLabelAt(
-    Dtype* transformedLabels,
-    size_t g_x,
-    size_t g_y
-) const {
-  return TransformedLabel_<Dtype>(*this, transformedLabels, g_x, g_y);
-}
-
 template<typename Dtype>
 Dtype CoverageGenerator<Dtype>::objectNormValue(
     const CoverageRegion& coverageRegion
@@ -297,6 +236,14 @@ void CoverageGenerator<Dtype>::generate(
   // clear out transformed_label, things may remain inside from the last batch
   this->clearLabel(transformedLabels);
 
+  // labels are planar: plane z of gridbox (x, y) is at
+  //  z * planeStride + y * gridROI_.width + x
+  const size_t planeStride = gridROI_.area();
+  const size_t numCoverages = label_size_ - TRANSFORMED_LABEL_SIZE;
+  const Dtype stride = this->param_.stride();
+  Dtype* const coverages =
+      transformedLabels + planeStride * TRANSFORMED_LABEL_SIZE;
+
   // foreach bbox in list:
   foreach_(const BboxLabel& label, bboxList) {
     Rectv bbox(label.bbox);
@@ -309,51 +256,52 @@ void CoverageGenerator<Dtype>::generate(
     //  classes, but must fit within coverage Rectf:
     unique_ptr<CoverageRegion> coverageRegion(
         this->coverageRegion(coverage));
-    Dtype dObjNormValue = objectNormValue(*coverageRegion);
+
+    // values which don't depend on the gridbox:
+    const size_t coverageClass = labels_.at(size_t(label.classNumber));
+    const Dtype dimension_w = 1.0 / bbox.width;
+    const Dtype dimension_h = 1.0 / bbox.height;
+    const Dtype objNorm =
+        std::max(this->minObjNorm_, objectNormValue(*coverageRegion));
 
     // This Rect includes all gridspaces which overlap the coverage rectangle:
     Rect g_coverage(this->imageRectToGridRect(coverage));
 
-    for (size_t g_y = g_coverage.tl().y; g_y < g_coverage.br().y; g_y++) {
-      for (size_t g_x = g_coverage.tl().x; g_x < g_coverage.br().x; g_x++) {
+    for (int g_y = g_coverage.tl().y; g_y < g_coverage.br().y; g_y++) {
+      const Dtype gridTop = g_y * stride;
+      const size_t rowOffset = g_y * gridROI_.width;
+      for (int g_x = g_coverage.tl().x; g_x < g_coverage.br().x; g_x++) {
         // the current gridbox:
-        Rectv gridBox(
-          Point2v(g_x, g_y) * (Dtype)this->param_.stride(),
-          Size2v(this->param_.stride(), this->param_.stride()));
+        const Dtype gridLeft = g_x * stride;
+        Rectv gridBox(gridLeft, gridTop, stride, stride);
 
         // the amount of the gridbox covered by the coverage region:
         Dtype cvgArea =
             coverageRegion->intersectionArea(gridBox)
           / this->gridBoxArea_;
+        if (cvgArea <= FLT_EPSILON) {
+          continue;
+        }
 
-        TransformedLabel tLabel(this->transformedLabelAt(
-            transformedLabels,
-            g_x,
-            g_y));
-
-        if (cvgArea > FLT_EPSILON) {
-          zeroCoverage(&tLabel.coverages);
-          Dtype& tLabel_coverages =
-              tLabel.coverages[labels_.at(size_t(label.classNumber))];
-          // coverage (clamped from 0..1)
-          tLabel_coverages = 1.0;
-
-          // bbox
-          tLabel.topLeft_x     = bbox.tl().x - gridBox.tl().x;
-          tLabel.topLeft_y     = bbox.tl().y - gridBox.tl().y;
-          tLabel.bottomRight_x = bbox.br().x - gridBox.tl().x;
-          tLabel.bottomRight_y = bbox.br().y - gridBox.tl().y;
-
-          // bbox dimensions
-          tLabel.dimension_w = 1.0 / bbox.width;
-          tLabel.dimension_h = 1.0 / bbox.height;
-
-          // obj_norm
-          tLabel.obj_norm = std::max(this->minObjNorm_, dObjNormValue);
-
-          // foreground:
-          tLabel.foreground = 1.0;
+        const size_t cell = rowOffset + g_x;
+        // coverage (clamped from 0..1), one-hot over the classes
+        for (size_t iCoverage = 0; iCoverage != numCoverages; ++iCoverage) {
+          coverages[planeStride * iCoverage + cell] = 0.0;
         }
+        coverages[planeStride * coverageClass + cell] = 1.0;
+
+        // foreground:
+        transformedLabels[planeStride * 0 + cell] = 1.0;
+        // bbox
+        transformedLabels[planeStride * 1 + cell] = bbox.tl().x - gridLeft;
+        transformedLabels[planeStride * 2 + cell] = bbox.tl().y - gridTop;
+        transformedLabels[planeStride * 3 + cell] = bbox.br().x - gridLeft;
+        transformedLabels[planeStride * 4 + cell] = bbox.br().y - gridTop;
+        // bbox dimensions
+        transformedLabels[planeStride * 5 + cell] = dimension_w;
+        transformedLabels[planeStride * 6 + cell] = dimension_h;
+        // obj_norm
+        transformedLabels[planeStride * 7 + cell] = objNorm;
       }  // foreach x
     }  // foreach y
   }
@@ -365,5 +313,4 @@ INSTANTIATE_CLASS_CPU(RectangularCoverageGenerator);
 
 }  // namespace caffe
 
-#undef TRANSFORMED_LABEL_AT
 #undef foreach_
@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/db.hpp"
+#include "caffe/util/feature_writer.hpp"
+#include "caffe/util/format.hpp"
+#include "caffe/util/hdf5.hpp"
+
+namespace caffe {
+
+// Legacy output: one Datum with float_data per image in a LevelDB/LMDB.
+class DBFeatureWriter : public FeatureWriter {
+ public:
+  DBFeatureWriter(const string& name, const string& db_type,
+      const vector<int>& shape)
+      : db_(db::GetDB(db_type)), name_(name), count_(0) {
+    db_->Open(name, db::NEW);
+    txn_.reset(db_->NewAppendTransaction());
+    datum_.set_channels(shape.size() > 1 ? shape[1] : 1);
+    datum_.set_height(shape.size() > 2 ? shape[2] : 1);
+    datum_.set_width(shape.size() > 3 ? shape[3] : 1);
+  }
+  void Write(const float* data, int num, int dim) override {
+    datum_.mutable_float_data()->Resize(dim, 0.F);
+    string out;
+    for (int n = 0; n < num; ++n) {
+      std::memcpy(datum_.mutable_float_data()->mutable_data(),
+          data + n * dim, dim * sizeof(float));
+      CHECK(datum_.SerializeToString(&out));
+      txn_->Put(format_int(count_, 10), out);
+      if (++count_ % 1000 == 0) {
+        txn_->Commit();
+        txn_.reset(db_->NewAppendTransaction());
+        LOG(ERROR)<< "Extracted features of " << count_ <<
+            " query images for " << name_;
+      }
+    }
+  }
+  void Close() override {
+    txn_->Commit();
+    db_->Close();
+    LOG(ERROR)<< "Extracted features of " << count_ <<
+        " query images for " << name_;
+  }
+
+ private:
+  unique_ptr<db::DB> db_;
+  unique_ptr<db::Transaction> txn_;
+  Datum datum_;
+  const string name_;
+  int count_;
+};
+
+// Columnar binary output: a fixed header followed by a row-major
+// num x dim float32 matrix. Header (int64 fields, native byte order):
+//   magic "CAFFEFEA", version, num, dim, channels, height, width, reserved
+class BinaryFeatureWriter : public FeatureWriter {
+ public:
+  BinaryFeatureWriter(const string& name, const vector<int>& shape)
+      : name_(name), num_(0) {
+    file_ = std::fopen(name.c_str(), "wb");
+    CHECK(file_ != nullptr) << "Failed to open " << name;
+    std::memcpy(header_, "CAFFEFEA", 8);
+    header_[1] = 1;  // version
+    header_[2] = 0;  // num, updated on Close
+    header_[3] = 1;
+    for (int i = 1; i < shape.size(); ++i) {
+      header_[3] *= shape[i];
+    }
+    header_[4] = shape.size() > 1 ? shape[1] : 1;
+    header_[5] = shape.size() > 2 ? shape[2] : 1;
+    header_[6] = shape.size() > 3 ? shape[3] : 1;
+    header_[7] = 0;
+    CHECK_EQ(std::fwrite(header_, sizeof(header_), 1, file_), 1);
+  }
+  void Write(const float* data, int num, int dim) override {
+    CHECK_EQ(dim, header_[3]);
+    CHECK_EQ(std::fwrite(data, sizeof(float) * dim, num, file_), num)
+        << "Failed to write " << name_;
+    num_ += num;
+  }
+  void Close() override {
+    header_[2] = num_;
+    CHECK_EQ(std::fseek(file_, 0, SEEK_SET), 0);
+    CHECK_EQ(std::fwrite(header_, sizeof(header_), 1, file_), 1);
+    CHECK_EQ(std::fclose(file_), 0) << "Failed to close " << name_;
+    LOG(ERROR)<< "Extracted features of " << num_ <<
+        " query images for " << name_;
+  }
+
+ private:
+  const string name_;
+  FILE* file_;
+  int64_t header_[8];
+  int64_t num_;
+};
+
+// HDF5 output: extendible num x dim float dataset "data", chunked by batch.
+class HDF5FeatureWriter : public FeatureWriter {
+ public:
+  HDF5FeatureWriter(const string& name, const vector<int>& shape)
+      : name_(name), num_(0) {
+    file_id_ = H5Fcreate(name.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    CHECK_GE(file_id_, 0) << "Failed to open HDF5 file " << name;
+    dim_ = 1;
+    for (int i = 1; i < shape.size(); ++i) {
+      dim_ *= shape[i];
+    }
+    hsize_t dims[2] = {0, dim_};
+    hsize_t max_dims[2] = {H5S_UNLIMITED, dim_};
+    hsize_t chunk[2] = {static_cast<hsize_t>(std::max(shape[0], 1)), dim_};
+    hid_t space_id = H5Screate_simple(2, dims, max_dims);
+    hid_t plist_id = H5Pcreate(H5P_DATASET_CREATE);
+    CHECK_GE(H5Pset_chunk(plist_id, 2, chunk), 0);
+    dataset_id_ = H5Dcreate2(file_id_, "data", H5T_NATIVE_FLOAT, space_id,
+        H5P_DEFAULT, plist_id, H5P_DEFAULT);
+    CHECK_GE(dataset_id_, 0) << "Failed to create dataset in " << name;
+    H5Pclose(plist_id);
+    H5Sclose(space_id);
+  }
+  void Write(const float* data, int num, int dim) override {
+    CHECK_EQ(dim, dim_);
+    hsize_t dims[2] = {num_ + num, dim_};
+    CHECK_GE(H5Dset_extent(dataset_id_, dims), 0);
+    hid_t file_space = H5Dget_space(dataset_id_);
+    hsize_t offset[2] = {num_, 0};
+    hsize_t count[2] = {static_cast<hsize_t>(num), dim_};
+    H5Sselect_hyperslab(file_space, H5S_SELECT_SET, offset, NULL, count, NULL);
+    hid_t mem_space = H5Screate_simple(2, count, NULL);
+    CHECK_GE(H5Dwrite(dataset_id_, H5T_NATIVE_FLOAT, mem_space, file_space,
+        H5P_DEFAULT, data), 0) << "Failed to write " << name_;
+    H5Sclose(mem_space);
+    H5Sclose(file_space);
+    num_ += num;
+  }
+  void Close() override {
+    H5Dclose(dataset_id_);
+    CHECK_GE(H5Fclose(file_id_), 0) << "Failed to close " << name_;
+    LOG(ERROR)<< "Extracted features of " << num_ <<
+        " query images for " << name_;
+  }
+
+ private:
+  const string name_;
+  hid_t file_id_, dataset_id_;
+  hsize_t dim_, num_;
+};
+
+FeatureWriter* GetFeatureWriter(const string& name, const string& type,
+    const vector<int>& shape) {
+  if (type == "binary") {
+    return new BinaryFeatureWriter(name, shape);
+  } else if (type == "hdf5") {
+    return new HDF5FeatureWriter(name, shape);
+  }
+  return new DBFeatureWriter(name, type, shape);
+}
+
+}  // namespace caffe
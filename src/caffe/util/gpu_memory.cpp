@@ -2,6 +2,7 @@
 #include <sstream>
 #include "caffe/common.hpp"
 #include "caffe/util/gpu_memory.hpp"
+#include "caffe/util/metrics.hpp"
 
 #include "cub/util_allocator.cuh"
 
@@ -83,6 +84,37 @@ void GPUMemory::Manager::init(const vector<int>& gpus, bool debug) {
   for (int i = 0; i < gpus.size(); ++i) {
     LOG(INFO) << report_dev_info(gpus[i]);
   }
+  // Evaluated on export only, so registered even if metrics are started later
+  for (int device : gpus) {
+    const string d = std::to_string(device);
+    Metrics::Get().AddCallback("caffe_gpu_pool_bytes", {{"device", d}, {"state", "live"}},
+        [this, device]() {
+          size_t live, cached;
+          GetPoolBytes(device, &live, &cached);
+          return static_cast<double>(live);
+        });
+    Metrics::Get().AddCallback("caffe_gpu_pool_bytes", {{"device", d}, {"state", "cached"}},
+        [this, device]() {
+          size_t live, cached;
+          GetPoolBytes(device, &live, &cached);
+          return static_cast<double>(cached);
+        });
+  }
+}
+
+void GPUMemory::Manager::GetPoolBytes(int device, size_t* live, size_t* cached) {
+  *live = 0UL;
+  *cached = 0UL;
+  if (!cub_allocator_) {
+    return;
+  }
+  cub_allocator_->mutex.Lock();
+  auto it = cub_allocator_->cached_bytes.find(device);
+  if (it != cub_allocator_->cached_bytes.end()) {
+    *live = it->second.live;
+    *cached = it->second.free;
+  }
+  cub_allocator_->mutex.Unlock();
 }
 
 void GPUMemory::Manager::reset() {
@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <cstring>
+#include <thread>
 #include <vector>
 
 #include "caffe/util/im2col.hpp"
@@ -5,14 +8,40 @@
 
 namespace caffe {
 
-// Function uses casting from int to unsigned to compare if value of
-// parameter a is greater or equal to zero and lower than value of
-// parameter b. The b parameter is of type signed and is always positive,
-// therefore its value is always lower than 0x800... where casting
-// negative value of a parameter converts it to value higher than 0x800...
-// The casting allows to use one condition instead of two.
-inline bool is_a_ge_zero_and_a_lt_b(int a, int b) {
-  return static_cast<unsigned>(a) < static_cast<unsigned>(b);
+// Valid output range [begin, end) of one kernel offset along one axis: the
+// outputs whose input index o * stride - pad + offset lies in [0, size).
+// Outside of it the column holds padding.
+struct ValidRange {
+  int begin, end;
+  ValidRange(int size, int output_size, int pad, int stride, int offset) {
+    const int shift = offset - pad;  // input index of output 0
+    begin = shift >= 0 ? 0 : (-shift + stride - 1) / stride;
+    end = size - shift <= 0 ? 0 : (size - shift - 1) / stride + 1;
+    begin = std::min(begin, output_size);
+    end = std::max(begin, std::min(end, output_size));
+  }
+};
+
+// Channels are independent: run fn(channel_begin, channel_end) on up to
+// hardware_concurrency threads when the work is large enough to pay off.
+template <typename F>
+static void for_channels(int channels, size_t work_per_channel, const F& fn) {
+  constexpr size_t kMinWorkPerThread = 1UL << 18;
+  const int num_workers = std::max(1, std::min<int>({channels,
+      static_cast<int>(std::thread::hardware_concurrency()),
+      static_cast<int>(work_per_channel * channels / kMinWorkPerThread)}));
+  if (num_workers == 1) {
+    fn(0, channels);
+    return;
+  }
+  vector<std::thread> workers;
+  for (int w = 1; w < num_workers; ++w) {
+    workers.emplace_back(fn, channels * w / num_workers, channels * (w + 1) / num_workers);
+  }
+  fn(0, channels / num_workers);
+  for (std::thread& t : workers) {
+    t.join();
+  }
 }
 
 template <typename Dtype>
@@ -22,36 +51,52 @@ void im2col_cpu(const Dtype* data_im, const int channels,
     const int stride_h, const int stride_w,
     const int dilation_h, const int dilation_w,
     Dtype* data_col) {
-  const int output_h = (height + pad_h + pad_w -
+  const int output_h = (height + 2 * pad_h -
     (dilation_h * (kernel_h - 1) + 1)) / stride_h + 1;
-  const int output_w = (width + pad_h + pad_w -
+  const int output_w = (width + 2 * pad_w -
     (dilation_w * (kernel_w - 1) + 1)) / stride_w + 1;
   const int channel_size = height * width;
-  for (int channel = channels; channel--; data_im += channel_size) {
-    for (int kernel_row = 0; kernel_row < kernel_h; kernel_row++) {
-      for (int kernel_col = 0; kernel_col < kernel_w; kernel_col++) {
-        int input_row = -pad_h + kernel_row * dilation_h;
-        for (int output_rows = output_h; output_rows; output_rows--) {
-          if (!is_a_ge_zero_and_a_lt_b(input_row, height)) {
-            for (int output_cols = output_w; output_cols; output_cols--) {
-              *(data_col++) = 0;
-            }
-          } else {
-            int input_col = -pad_h + kernel_col * dilation_w;
-            for (int output_col = output_w; output_col; output_col--) {
-              if (is_a_ge_zero_and_a_lt_b(input_col, width)) {
-                *(data_col++) = data_im[input_row * width + input_col];
-              } else {
-                *(data_col++) = 0;
+  const int output_size = output_h * output_w;
+  const Dtype zero = TypedConsts<Dtype>::zero;
+  vector<ValidRange> rows, cols;
+  for (int kernel_row = 0; kernel_row < kernel_h; ++kernel_row) {
+    rows.emplace_back(height, output_h, pad_h, stride_h, kernel_row * dilation_h);
+  }
+  for (int kernel_col = 0; kernel_col < kernel_w; ++kernel_col) {
+    cols.emplace_back(width, output_w, pad_w, stride_w, kernel_col * dilation_w);
+  }
+  // Every column row is a zero prologue, a copied (memcpy for stride 1) or
+  // gathered body and a zero epilogue; padded rows are zero filled at once.
+  auto channel_range = [&](int channel_begin, int channel_end) {
+    for (int channel = channel_begin; channel < channel_end; ++channel) {
+      const Dtype* im = data_im + channel * channel_size;
+      Dtype* col = data_col + static_cast<size_t>(channel) * kernel_h * kernel_w * output_size;
+      for (int kernel_row = 0; kernel_row < kernel_h; ++kernel_row) {
+        const ValidRange& r = rows[kernel_row];
+        for (int kernel_col = 0; kernel_col < kernel_w; ++kernel_col, col += output_size) {
+          const ValidRange& c = cols[kernel_col];
+          const int input_col = c.begin * stride_w - pad_w + kernel_col * dilation_w;
+          std::fill(col, col + r.begin * output_w, zero);
+          for (int output_row = r.begin; output_row < r.end; ++output_row) {
+            const int input_row = output_row * stride_h - pad_h + kernel_row * dilation_h;
+            const Dtype* src = im + input_row * width + input_col;
+            Dtype* dst = col + output_row * output_w;
+            std::fill(dst, dst + c.begin, zero);
+            if (stride_w == 1) {
+              memcpy(dst + c.begin, src, (c.end - c.begin) * sizeof(Dtype));  // NOLINT(caffe/alt_fn)
+            } else {
+              for (int i = 0, n = c.end - c.begin; i < n; ++i) {
+                dst[c.begin + i] = src[i * stride_w];
               }
-              input_col += stride_w;
             }
+            std::fill(dst + c.end, dst + output_w, zero);
           }
-          input_row += stride_h;
+          std::fill(col + r.end * output_w, col + output_size, zero);
         }
       }
     }
-  }
+  };
+  for_channels(channels, static_cast<size_t>(kernel_h) * kernel_w * output_size, channel_range);
 }
 
 // Explicit instantiation
@@ -147,6 +192,17 @@ void im2col_nd_cpu(const Dtype* data_im, const int num_spatial_axes,
     const int* im_shape, const int* col_shape,
     const int* kernel_shape, const int* pad, const int* stride,
     const int* dilation, Dtype* data_col) {
+  // 1-d and 2-d convolutions take the row-wise path
+  if (num_spatial_axes == 2) {
+    im2col_cpu(data_im, im_shape[0], im_shape[1], im_shape[2],
+        kernel_shape[0], kernel_shape[1], pad[0], pad[1], stride[0], stride[1],
+        dilation[0], dilation[1], data_col);
+    return;
+  } else if (num_spatial_axes == 1) {
+    im2col_cpu(data_im, im_shape[0], 1, im_shape[1], 1, kernel_shape[0],
+        0, pad[0], 1, stride[0], 1, dilation[0], data_col);
+    return;
+  }
   const bool kIm2Col = true;
   im2col_nd_core_cpu(data_im, kIm2Col, num_spatial_axes, im_shape, col_shape,
                   kernel_shape, pad, stride, dilation, data_col);
@@ -176,34 +232,53 @@ void col2im_cpu(const Dtype* data_col, const int channels,
     const int stride_h, const int stride_w,
     const int dilation_h, const int dilation_w,
     Dtype* data_im) {
-  caffe_set(height * width * channels, Dtype(0), data_im);
   const int output_h = (height + 2 * pad_h -
     (dilation_h * (kernel_h - 1) + 1)) / stride_h + 1;
   const int output_w = (width + 2 * pad_w -
     (dilation_w * (kernel_w - 1) + 1)) / stride_w + 1;
   const int channel_size = height * width;
-  for (int channel = channels; channel--; data_im += channel_size) {
-    for (int kernel_row = 0; kernel_row < kernel_h; kernel_row++) {
-      for (int kernel_col = 0; kernel_col < kernel_w; kernel_col++) {
-        int input_row = -pad_h + kernel_row * dilation_h;
-        for (int output_rows = output_h; output_rows; output_rows--) {
-          if (!is_a_ge_zero_and_a_lt_b(input_row, height)) {
-            data_col += output_w;
-          } else {
-            int input_col = -pad_w + kernel_col * dilation_w;
-            for (int output_col = output_w; output_col; output_col--) {
-              if (is_a_ge_zero_and_a_lt_b(input_col, width)) {
-                data_im[input_row * width + input_col] += *data_col;
+  const int output_size = output_h * output_w;
+  vector<ValidRange> rows, cols;
+  for (int kernel_row = 0; kernel_row < kernel_h; ++kernel_row) {
+    rows.emplace_back(height, output_h, pad_h, stride_h, kernel_row * dilation_h);
+  }
+  for (int kernel_col = 0; kernel_col < kernel_w; ++kernel_col) {
+    cols.emplace_back(width, output_w, pad_w, stride_w, kernel_col * dilation_w);
+  }
+  // Only the bodies of the column rows are accumulated, padding is skipped.
+  // Kernel offsets of a channel overlap in the image, so channels are the
+  // unit of parallelism.
+  auto channel_range = [&](int channel_begin, int channel_end) {
+    for (int channel = channel_begin; channel < channel_end; ++channel) {
+      Dtype* im = data_im + channel * channel_size;
+      const Dtype* col =
+          data_col + static_cast<size_t>(channel) * kernel_h * kernel_w * output_size;
+      caffe_set(channel_size, Dtype(0), im);
+      for (int kernel_row = 0; kernel_row < kernel_h; ++kernel_row) {
+        const ValidRange& r = rows[kernel_row];
+        for (int kernel_col = 0; kernel_col < kernel_w; ++kernel_col, col += output_size) {
+          const ValidRange& c = cols[kernel_col];
+          const int input_col = c.begin * stride_w - pad_w + kernel_col * dilation_w;
+          for (int output_row = r.begin; output_row < r.end; ++output_row) {
+            const int input_row = output_row * stride_h - pad_h + kernel_row * dilation_h;
+            const Dtype* src = col + output_row * output_w + c.begin;
+            Dtype* dst = im + input_row * width + input_col;
+            const int n = c.end - c.begin;
+            if (stride_w == 1) {
+              for (int i = 0; i < n; ++i) {
+                dst[i] += src[i];
+              }
+            } else {
+              for (int i = 0; i < n; ++i) {
+                dst[i * stride_w] += src[i];
               }
-              data_col++;
-              input_col += stride_w;
             }
           }
-          input_row += stride_h;
         }
       }
     }
-  }
+  };
+  for_channels(channels, static_cast<size_t>(kernel_h) * kernel_w * output_size, channel_range);
 }
 
 // Explicit instantiation
@@ -227,6 +302,16 @@ void col2im_nd_cpu(const Dtype* data_col, const int num_spatial_axes,
     const int* im_shape, const int* col_shape,
     const int* kernel_shape, const int* pad, const int* stride,
     const int* dilation, Dtype* data_im) {
+  if (num_spatial_axes == 2) {
+    col2im_cpu(data_col, im_shape[0], im_shape[1], im_shape[2],
+        kernel_shape[0], kernel_shape[1], pad[0], pad[1], stride[0], stride[1],
+        dilation[0], dilation[1], data_im);
+    return;
+  } else if (num_spatial_axes == 1) {
+    col2im_cpu(data_col, im_shape[0], 1, im_shape[1], 1, kernel_shape[0],
+        0, pad[0], 1, stride[0], 1, dilation[0], data_im);
+    return;
+  }
   const bool kIm2Col = false;
   im2col_nd_core_cpu(data_col, kIm2Col, num_spatial_axes, im_shape, col_shape,
                      kernel_shape, pad, stride, dilation, data_im);
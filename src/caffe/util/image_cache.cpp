@@ -0,0 +1,194 @@
+#include <opencv2/highgui/highgui.hpp>
+#include <unistd.h>
+
+#include <sstream>
+
+#include "caffe/util/image_cache.hpp"
+#include "caffe/util/metrics.hpp"
+
+namespace caffe {
+
+// Host side bookkeeping of an entry: list node, index node and key copies
+static constexpr size_t kEntryOverhead = 128UL;
+
+static size_t DefaultBudget() {
+  const long pages = sysconf(_SC_PHYS_PAGES);
+  const long page_size = sysconf(_SC_PAGESIZE);
+  if (pages <= 0L || page_size <= 0L) {
+    return 1UL << 30;
+  }
+  return static_cast<size_t>(pages) * static_cast<size_t>(page_size) / 4UL;
+}
+
+string ImageCacheKey(const string& filename, int height, int width, bool is_color,
+    int short_side) {
+  std::ostringstream os;
+  os << filename << '|' << height << 'x' << width << '|' << (is_color ? 'c' : 'g')
+     << '|' << short_side;
+  return os.str();
+}
+
+ImageCache& ImageCache::Get() {
+  // Never destroyed: metric callbacks and prefetch threads may outlive static destructors
+  static ImageCache* instance = [] {
+    ImageCache* cache = new ImageCache(0UL);
+    cache->RegisterMetrics();
+    return cache;
+  }();
+  return *instance;
+}
+
+ImageCache::ImageCache(size_t budget_bytes)
+    : budget_(budget_bytes), hits_(0UL), misses_(0UL), insertions_(0UL), evictions_(0UL),
+      rejections_(0UL) {
+  for (Shard& s : shards_) {
+    s.hand = s.entries.end();
+  }
+}
+
+void ImageCache::RegisterMetrics() {
+  Metrics& metrics = Metrics::Get();
+  metrics.AddCallback("caffe_image_cache_lookups", {{"result", "hit"}},
+      [this]() { return static_cast<double>(hits_.load()); });
+  metrics.AddCallback("caffe_image_cache_lookups", {{"result", "miss"}},
+      [this]() { return static_cast<double>(misses_.load()); });
+  metrics.AddCallback("caffe_image_cache_evictions", {},
+      [this]() { return static_cast<double>(evictions_.load()); });
+  metrics.AddCallback("caffe_image_cache_bytes", {},
+      [this]() { return static_cast<double>(stats().bytes); });
+  metrics.AddCallback("caffe_image_cache_budget_bytes", {},
+      [this]() { return static_cast<double>(budget_.load()); });
+}
+
+void ImageCache::Reserve(size_t budget_bytes) {
+  if (budget_bytes == 0UL) {
+    budget_bytes = DefaultBudget();
+  }
+  size_t current = budget_.load();
+  while (current < budget_bytes && !budget_.compare_exchange_weak(current, budget_bytes)) {}
+  if (current < budget_bytes) {
+    LOG(INFO) << "Image cache budget: " << (budget_bytes >> 20) << " MB";
+  }
+}
+
+bool ImageCache::Lookup(const string& key, cv::Mat* img) {
+  Shard& s = shard(key);
+  cv::Mat data;
+  bool encoded = false;
+  {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto it = s.index.find(key);
+    if (it == s.index.end()) {
+      misses_.fetch_add(1UL, std::memory_order_relaxed);
+      return false;
+    }
+    it->second->referenced = true;
+    data = it->second->data;  // shallow copy, refcounted
+    encoded = it->second->encoded;
+  }
+  hits_.fetch_add(1UL, std::memory_order_relaxed);
+  *img = encoded ? cv::imdecode(data, cv::IMREAD_UNCHANGED) : data;
+  return true;
+}
+
+bool ImageCache::Contains(const string& key) const {
+  const Shard& s = shards_[std::hash<string>()(key) % kShards];
+  std::lock_guard<std::mutex> lock(s.mutex);
+  return s.index.find(key) != s.index.end();
+}
+
+void ImageCache::Evict(Shard& s, size_t shard_budget) {
+  while (s.bytes > shard_budget && !s.entries.empty()) {
+    if (s.hand == s.entries.end()) {
+      s.hand = s.entries.begin();
+    }
+    if (s.hand->referenced) {
+      s.hand->referenced = false;  // second chance
+      ++s.hand;
+    } else {
+      s.bytes -= s.hand->bytes;
+      s.index.erase(s.hand->key);
+      s.hand = s.entries.erase(s.hand);
+      evictions_.fetch_add(1UL, std::memory_order_relaxed);
+    }
+  }
+}
+
+bool ImageCache::Insert(const string& key, const cv::Mat& img,
+    ImageDataParameter_CacheFormat format, int jpeg_quality) {
+  if (img.empty()) {
+    return false;
+  }
+  if (budget_.load() == 0UL) {
+    Reserve(0UL);
+  }
+  const size_t shard_budget = budget_.load() / kShards;
+  Shard& s = shard(key);
+  {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (s.index.find(key) != s.index.end()) {
+      return true;
+    }
+  }
+  // Encoding is done outside of the lock, a concurrent insert of the same key
+  // just wastes the work.
+  cv::Mat data;
+  bool encoded = false;
+  if (format == ImageDataParameter_CacheFormat_RAW || img.depth() != CV_8U) {
+    data = img;
+  } else {
+    vector<unsigned char> buf;
+    vector<int> params;
+    if (format == ImageDataParameter_CacheFormat_JPEG) {
+      params = {cv::IMWRITE_JPEG_QUALITY, jpeg_quality};
+    }
+    CHECK(cv::imencode(format == ImageDataParameter_CacheFormat_JPEG ? ".jpg" : ".png",
+        img, buf, params)) << "Failed to encode " << key;
+    data = cv::Mat(buf, true);
+    encoded = true;
+  }
+  const size_t bytes = data.total() * data.elemSize() + key.size() + kEntryOverhead;
+  if (bytes > shard_budget) {
+    rejections_.fetch_add(1UL, std::memory_order_relaxed);
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(s.mutex);
+  if (s.index.find(key) != s.index.end()) {
+    return true;
+  }
+  Evict(s, shard_budget - bytes);
+  s.bytes += bytes;
+  // New entries go right behind the hand, i.e. they are inspected last
+  auto it = s.entries.insert(s.hand, Entry{key, data, encoded, bytes, false});
+  s.index.emplace(key, it);
+  insertions_.fetch_add(1UL, std::memory_order_relaxed);
+  return true;
+}
+
+ImageCache::Stats ImageCache::stats() const {
+  Stats st{hits_.load(), misses_.load(), insertions_.load(), evictions_.load(),
+      rejections_.load(), 0UL, 0UL, budget_.load()};
+  for (const Shard& s : shards_) {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    st.entries += s.entries.size();
+    st.bytes += s.bytes;
+  }
+  return st;
+}
+
+void ImageCache::Clear() {
+  for (Shard& s : shards_) {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.index.clear();
+    s.entries.clear();
+    s.hand = s.entries.end();
+    s.bytes = 0UL;
+  }
+  hits_ = 0UL;
+  misses_ = 0UL;
+  insertions_ = 0UL;
+  evictions_ = 0UL;
+  rejections_ = 0UL;
+}
+
+}  // namespace caffe
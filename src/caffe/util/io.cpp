@@ -185,8 +185,12 @@ cv::Mat ReadImageToCVMat(const string& filename,
   ifs.seekg(0, std::ios::beg);
   ifs.read(&content.front(), content.size());
   ifs.close();
+  return DecodeImageToCVMat(content, filename, height, width, is_color, short_side);
+}
 
-  cv::Mat cv_img;
+cv::Mat DecodeImageToCVMat(const string& content, const string& filename,
+    int height, int width, bool is_color, int short_side) {
+  cv::Mat cv_img_origin, cv_img;
   vector<int> shape = Decode(reinterpret_cast<const unsigned char*>(content.data()), content.size(),
                              is_color ? 1 : -1, &cv_img_origin, nullptr, 0, false, true);
   if (shape.size() == 0) {
@@ -0,0 +1,356 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include "caffe/util/metrics.hpp"
+
+namespace caffe {
+
+std::atomic_bool Metrics::enabled_{false};
+std::atomic_bool Metrics::layer_timing_{false};
+
+void Metric::Observe(double v) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  value_ += v;
+  avg_ = count_ == 0UL ? v : avg_ + kAverageWeight * (v - avg_);
+  ++count_;
+}
+
+void Metric::Read(double* value, size_t* count, double* avg) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  *value = value_;
+  *count = count_;
+  *avg = avg_;
+}
+
+static string EscapeString(const string& s) {
+  string ret;
+  ret.reserve(s.size());
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      ret += '\\';
+      ret += c;
+    } else if (c == '\n') {
+      ret += "\\n";
+    } else {
+      ret += c;
+    }
+  }
+  return ret;
+}
+
+string FormatMetricLabels(const MetricLabels& labels) {
+  std::ostringstream os;
+  for (size_t i = 0; i < labels.size(); ++i) {
+    os << (i ? "," : "") << labels[i].first << "=\"" << EscapeString(labels[i].second) << "\"";
+  }
+  return os.str();
+}
+
+static void WriteNumber(std::ostream& os, double v, bool json) {
+  if (std::isnan(v)) {
+    os << (json ? "null" : "NaN");
+  } else if (std::isinf(v)) {
+    os << (json ? "null" : (v > 0. ? "+Inf" : "-Inf"));
+  } else {
+    os << std::setprecision(12) << v;
+  }
+}
+
+static const char* KindName(Metric::Kind kind) {
+  switch (kind) {
+    case Metric::COUNTER:
+      return "counter";
+    case Metric::GAUGE:
+      return "gauge";
+    default:
+      return "summary";
+  }
+}
+
+// Resident set size of the process, host side allocator bytes included
+static double ResidentBytes() {
+  std::ifstream statm("/proc/self/statm");
+  size_t pages = 0UL, resident = 0UL;
+  statm >> pages >> resident;
+  return static_cast<double>(resident) * sysconf(_SC_PAGESIZE);
+}
+
+Metrics& Metrics::Get() {
+  static Metrics instance;
+  return instance;
+}
+
+Metrics::Metrics() : next_callback_id_(0), stopping_(false) {
+  AddCallback("caffe_process_resident_bytes", MetricLabels(), &ResidentBytes);
+}
+
+Metrics::~Metrics() {
+  Stop();
+}
+
+Metric* Metrics::metric(const string& name, Metric::Kind kind, const MetricLabels& labels) {
+  const string key = FormatMetricLabels(labels);
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto fit = families_.find(name);
+  if (fit == families_.end()) {
+    fit = families_.emplace(name, Family()).first;
+    fit->second.kind = kind;
+  }
+  Family& family = fit->second;
+  CHECK_EQ(family.kind, kind) << "Metric " << name << " is already registered as "
+      << KindName(family.kind);
+  unique_ptr<Metric>& m = family.series[key];
+  if (!m) {
+    m.reset(new Metric(kind, labels));
+  }
+  return m.get();
+}
+
+int Metrics::AddCallback(const string& name, const MetricLabels& labels,
+    std::function<double()> fn) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const int id = next_callback_id_++;
+  callbacks_[id] = Callback{name, labels, std::move(fn)};
+  return id;
+}
+
+void Metrics::RemoveCallback(int id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  callbacks_.erase(id);
+}
+
+vector<Metrics::Sample> Metrics::Collect() const {
+  vector<Sample> samples;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& family : families_) {
+    for (const auto& series : family.second.series) {
+      Sample s{family.first, series.second->labels(), family.second.kind, 0., 0UL, 0.};
+      series.second->Read(&s.value, &s.count, &s.avg);
+      samples.push_back(std::move(s));
+    }
+  }
+  // Callback gauges, equal series summed up
+  std::map<std::pair<string, string>, size_t> index;
+  for (const auto& cb : callbacks_) {
+    const double v = cb.second.fn();
+    auto key = std::make_pair(cb.second.name, FormatMetricLabels(cb.second.labels));
+    auto it = index.find(key);
+    if (it == index.end()) {
+      index.emplace(key, samples.size());
+      samples.push_back(Sample{cb.second.name, cb.second.labels, Metric::GAUGE, v, 0UL, 0.});
+    } else {
+      samples[it->second].value += v;
+    }
+  }
+  std::stable_sort(samples.begin(), samples.end(), [](const Sample& a, const Sample& b) {
+    return a.name < b.name;
+  });
+  return samples;
+}
+
+string Metrics::ExportText() const {
+  vector<Sample> samples = Collect();
+  std::ostringstream os;
+  for (size_t i = 0; i < samples.size(); ++i) {
+    const Sample& s = samples[i];
+    const bool first = i == 0 || samples[i - 1].name != s.name;
+    const string labels = FormatMetricLabels(s.labels);
+    const string braced = labels.empty() ? string() : "{" + labels + "}";
+    if (first) {
+      os << "# TYPE " << s.name << " " << KindName(s.kind) << "\n";
+    }
+    if (s.kind == Metric::SUMMARY) {
+      os << s.name << "_sum" << braced << " ";
+      WriteNumber(os, s.value, false);
+      os << "\n" << s.name << "_count" << braced << " " << s.count << "\n";
+    } else {
+      os << s.name << braced << " ";
+      WriteNumber(os, s.value, false);
+      os << "\n";
+    }
+  }
+  // Moving averages of summaries go to their own gauge families
+  for (size_t i = 0; i < samples.size(); ++i) {
+    const Sample& s = samples[i];
+    if (s.kind != Metric::SUMMARY) {
+      continue;
+    }
+    if (i == 0 || samples[i - 1].name != s.name) {
+      os << "# TYPE " << s.name << "_avg gauge\n";
+    }
+    const string labels = FormatMetricLabels(s.labels);
+    os << s.name << "_avg" << (labels.empty() ? string() : "{" + labels + "}") << " ";
+    WriteNumber(os, s.avg, false);
+    os << "\n";
+  }
+  return os.str();
+}
+
+string Metrics::ExportJson() const {
+  vector<Sample> samples = Collect();
+  const double now = std::chrono::duration<double>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+  std::ostringstream os;
+  os << "{\"timestamp\": ";
+  WriteNumber(os, now, true);
+  os << ", \"metrics\": [";
+  for (size_t i = 0; i < samples.size(); ++i) {
+    const Sample& s = samples[i];
+    os << (i ? ",\n  " : "\n  ") << "{\"name\": \"" << s.name << "\", \"type\": \""
+       << KindName(s.kind) << "\", \"labels\": {";
+    for (size_t j = 0; j < s.labels.size(); ++j) {
+      os << (j ? ", " : "") << "\"" << EscapeString(s.labels[j].first) << "\": \""
+         << EscapeString(s.labels[j].second) << "\"";
+    }
+    os << "}, ";
+    if (s.kind == Metric::SUMMARY) {
+      os << "\"sum\": ";
+      WriteNumber(os, s.value, true);
+      os << ", \"count\": " << s.count << ", \"avg\": ";
+      WriteNumber(os, s.avg, true);
+    } else {
+      os << "\"value\": ";
+      WriteNumber(os, s.value, true);
+    }
+    os << "}";
+  }
+  os << "\n]}\n";
+  return os.str();
+}
+
+void Metrics::WriteJson(const string& path) const {
+  const string tmp = path + ".tmp";
+  {
+    std::ofstream ofs(tmp.c_str(), std::ios::out | std::ios::trunc);
+    if (!ofs.good()) {
+      LOG(WARNING) << "Failed to write metrics to " << tmp;
+      return;
+    }
+    ofs << ExportJson();
+  }
+  if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+    LOG(WARNING) << "Failed to rename " << tmp << " to " << path;
+  }
+}
+
+void Metrics::Start(int port, const string& json_path, int json_interval_sec) {
+  Stop();
+  stopping_ = false;
+  enabled_.store(true);
+  if (port > 0) {
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK_GE(fd, 0) << "Failed to create metrics socket";
+    const int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, 8) != 0) {
+      close(fd);
+      LOG(FATAL) << "Failed to listen on 127.0.0.1:" << port << " for metrics requests";
+    }
+    server_ = std::thread(&Metrics::ServeEntry, this, fd);
+    LOG(INFO) << "Serving metrics on http://127.0.0.1:" << port << "/metrics";
+  }
+  if (!json_path.empty()) {
+    dumper_ = std::thread(&Metrics::DumpEntry, this, json_path, std::max(json_interval_sec, 1));
+    LOG(INFO) << "Dumping metrics to " << json_path << " every "
+              << std::max(json_interval_sec, 1) << " s";
+  }
+}
+
+void Metrics::Stop() {
+  // Instrumented code, per-layer timing in particular, stops reporting too
+  enabled_.store(false);
+  {
+    std::lock_guard<std::mutex> lock(stop_mutex_);
+    stopping_ = true;
+  }
+  stop_cv_.notify_all();
+  if (server_.joinable()) {
+    server_.join();
+  }
+  if (dumper_.joinable()) {
+    dumper_.join();
+  }
+}
+
+void Metrics::ServeEntry(int listen_fd) {
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(stop_mutex_);
+      if (stopping_) {
+        break;
+      }
+    }
+    pollfd pfd{listen_fd, POLLIN, 0};
+    if (poll(&pfd, 1, 200) <= 0) {
+      continue;
+    }
+    const int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      continue;
+    }
+    timeval timeout{1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    char buf[1024];
+    const ssize_t n = recv(fd, buf, sizeof(buf) - 1, 0);
+    string request(buf, n > 0 ? n : 0);
+    string path;
+    if (request.compare(0, 4, "GET ") == 0) {
+      path = request.substr(4, request.find(' ', 4) - 4);
+    }
+    string status = "200 OK", type, body;
+    if (path == "/metrics" || path == "/") {
+      type = "text/plain; version=0.0.4";
+      body = ExportText();
+    } else if (path == "/metrics.json") {
+      type = "application/json";
+      body = ExportJson();
+    } else {
+      status = "404 Not Found";
+      type = "text/plain";
+      body = "Not found\n";
+    }
+    std::ostringstream os;
+    os << "HTTP/1.0 " << status << "\r\nContent-Type: " << type
+       << "\r\nContent-Length: " << body.size() << "\r\nConnection: close\r\n\r\n" << body;
+    const string response = os.str();
+    size_t sent = 0UL;
+    while (sent < response.size()) {
+      const ssize_t k = send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+      if (k <= 0) {
+        break;
+      }
+      sent += k;
+    }
+    close(fd);
+  }
+  close(listen_fd);
+}
+
+void Metrics::DumpEntry(string path, int interval_sec) {
+  std::unique_lock<std::mutex> lock(stop_mutex_);
+  while (!stop_cv_.wait_for(lock, std::chrono::seconds(interval_sec), [&] { return stopping_; })) {
+    lock.unlock();
+    WriteJson(path);
+    lock.lock();
+  }
+  lock.unlock();
+  // Final state, e.g. after the last iteration
+  WriteJson(path);
+}
+
+}  // namespace caffe
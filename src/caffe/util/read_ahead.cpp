@@ -0,0 +1,142 @@
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "caffe/util/read_ahead.hpp"
+
+namespace caffe {
+
+FileReadAhead::FileReadAhead(int num_threads, size_t max_pending)
+    : max_pending_(std::max<size_t>(max_pending, 1UL)),
+      stopping_(false),
+      hits_(0UL),
+      misses_(0UL) {
+  CHECK_GT(num_threads, 0);
+  for (int i = 0; i < num_threads; ++i) {
+    threads_.emplace_back(&FileReadAhead::ReaderEntry, this);
+  }
+}
+
+FileReadAhead::~FileReadAhead() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  queued_.notify_all();
+  for (std::thread& t : threads_) {
+    t.join();
+  }
+}
+
+bool FileReadAhead::ReadFile(const string& path, string* content) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+#ifdef POSIX_FADV_WILLNEED
+  // Lets the kernel (or the NFS client) fetch the whole file at once
+  posix_fadvise(fd, 0, st.st_size, POSIX_FADV_WILLNEED);
+#endif
+  content->resize(st.st_size);
+  size_t done = 0UL;
+  while (done < content->size()) {
+    const ssize_t n = read(fd, &(*content)[done], content->size() - done);
+    if (n <= 0) {
+      break;
+    }
+    done += n;
+  }
+  close(fd);
+  content->resize(done);
+  return done > 0UL;
+}
+
+void FileReadAhead::Request(const string& path) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_ || index_.find(path) != index_.end()) {
+      return;
+    }
+    if (items_.size() >= max_pending_) {
+      // Drop the oldest request unless its read is in flight
+      ItemIt oldest = items_.begin();
+      if (!oldest->done) {
+        auto qit = std::find(queue_.begin(), queue_.end(), oldest);
+        if (qit == queue_.end()) {
+          return;
+        }
+        queue_.erase(qit);
+      }
+      index_.erase(oldest->path);
+      items_.erase(oldest);
+    }
+    items_.push_back(Item{path, string(), false, false});
+    ItemIt it = std::prev(items_.end());
+    index_.emplace(path, it);
+    queue_.push_back(it);
+  }
+  queued_.notify_one();
+}
+
+bool FileReadAhead::Take(const string& path, string* content) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto iit = index_.find(path);
+  if (iit == index_.end()) {
+    ++misses_;
+    return false;
+  }
+  ItemIt it = iit->second;
+  auto qit = std::find(queue_.begin(), queue_.end(), it);
+  if (qit != queue_.end()) {
+    // Not started yet, the caller is faster reading it on its own
+    queue_.erase(qit);
+    index_.erase(iit);
+    items_.erase(it);
+    ++misses_;
+    return false;
+  }
+  done_.wait(lock, [it] { return it->done; });
+  const bool ok = it->ok;
+  content->swap(it->content);
+  index_.erase(path);
+  items_.erase(it);
+  ++hits_;
+  return ok;
+}
+
+void FileReadAhead::ReaderEntry() {
+  string content;
+  while (true) {
+    string path;
+    ItemIt it;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      queued_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+      if (stopping_) {
+        return;
+      }
+      it = queue_.front();
+      queue_.pop_front();
+      path = it->path;
+    }
+    content.clear();
+    const bool ok = ReadFile(path, &content);
+    {
+      // In flight items are never erased, the iterator is still valid
+      std::lock_guard<std::mutex> lock(mutex_);
+      it->content.swap(content);
+      it->ok = ok;
+      it->done = true;
+    }
+    done_.notify_all();
+  }
+}
+
+}  // namespace caffe
@@ -1,4 +1,7 @@
 #include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
 #include <vector>
 
 #include "caffe/util/bbox_util.hpp"
@@ -121,45 +124,197 @@ void SampleBBox(const Sampler& sampler, NormalizedBBox* sampled_bbox) {
   sampled_bbox->set_ymax(h_off + bbox_height);
 }
 
+namespace {
+
+// Trials drawn at once, the random numbers of a block are generated together
+constexpr int kTrialBlock = 16;
+
+// Object bboxes as a structure of arrays, so that the overlaps of a sampled
+// bbox with all of them are computed in one vectorizable loop.
+struct ObjectBBoxes {
+  explicit ObjectBBoxes(const vector<NormalizedBBox>& bboxes)
+      : xmin(bboxes.size()), ymin(bboxes.size()), xmax(bboxes.size()),
+        ymax(bboxes.size()), area(bboxes.size()) {
+    for (size_t i = 0; i < bboxes.size(); ++i) {
+      xmin[i] = bboxes[i].xmin();
+      ymin[i] = bboxes[i].ymin();
+      xmax[i] = bboxes[i].xmax();
+      ymax[i] = bboxes[i].ymax();
+      area[i] = BBoxSize(bboxes[i]);
+    }
+  }
+  int count() const {
+    return static_cast<int>(xmin.size());
+  }
+
+  vector<float> xmin, ymin, xmax, ymax, area;
+};
+
+// SatisfySampleConstraint accepts a sampled bbox as soon as one object bbox
+// passes the first test defined (jaccard overlap, sample coverage, object
+// coverage, in this order); the remaining tests only delay that return.
+// Hence only the first test is evaluated. Its metric is
+// intersection / (a * sample_area + b * object_area - c * intersection).
+struct ConstraintTest {
+  explicit ConstraintTest(const SampleConstraint& sc)
+      : defined(true), lo(-FLT_MAX), hi(FLT_MAX), a(0.f), b(0.f), c(0.f) {
+    if (sc.has_min_jaccard_overlap() || sc.has_max_jaccard_overlap()) {
+      Set(sc.has_min_jaccard_overlap(), sc.min_jaccard_overlap(),
+          sc.has_max_jaccard_overlap(), sc.max_jaccard_overlap(), 1.f, 1.f, 1.f);
+    } else if (sc.has_min_sample_coverage() || sc.has_max_sample_coverage()) {
+      Set(sc.has_min_sample_coverage(), sc.min_sample_coverage(),
+          sc.has_max_sample_coverage(), sc.max_sample_coverage(), 1.f, 0.f, 0.f);
+    } else if (sc.has_min_object_coverage() || sc.has_max_object_coverage()) {
+      Set(sc.has_min_object_coverage(), sc.min_object_coverage(),
+          sc.has_max_object_coverage(), sc.max_object_coverage(), 0.f, 1.f, 0.f);
+    } else {
+      defined = false;
+    }
+  }
+
+  void Set(bool has_min, float min_value, bool has_max, float max_value,
+           float sample_weight, float object_weight, float inter_weight) {
+    lo = has_min ? min_value : -FLT_MAX;
+    hi = has_max ? max_value : FLT_MAX;
+    a = sample_weight;
+    b = object_weight;
+    c = inter_weight;
+  }
+
+  // True if any object bbox passes, branch free over the objects.
+  bool Passes(float xmin, float ymin, float xmax, float ymax,
+              const ObjectBBoxes& objects) const {
+    const float sample_area = (xmax - xmin) * (ymax - ymin);
+    const float* oxmin = objects.xmin.data();
+    const float* oymin = objects.ymin.data();
+    const float* oxmax = objects.xmax.data();
+    const float* oymax = objects.ymax.data();
+    const float* oarea = objects.area.data();
+    const int n = objects.count();
+    int passed = 0;
+    for (int j = 0; j < n; ++j) {
+      const float iw = std::min(xmax, oxmax[j]) - std::max(xmin, oxmin[j]);
+      const float ih = std::min(ymax, oymax[j]) - std::max(ymin, oymin[j]);
+      const float inter = (iw > 0.f && ih > 0.f) ? iw * ih : 0.f;
+      const float denom = a * sample_area + b * oarea[j] - c * inter;
+      const float v = inter > 0.f ? inter / denom : 0.f;
+      passed += (v >= lo) & (v <= hi);
+    }
+    return passed > 0;
+  }
+
+  bool defined;
+  float lo, hi;
+  float a, b, c;
+};
+
+// Same distribution as n calls of SampleBBox, written into the arrays.
+void SampleBBoxes(const Sampler& sampler, int n,
+                  float* xmin, float* ymin, float* xmax, float* ymax) {
+  CHECK_GE(sampler.max_scale(), sampler.min_scale());
+  CHECK_GT(sampler.min_scale(), 0.f);
+  CHECK_LE(sampler.max_scale(), 1.f);
+  CHECK_GE(sampler.max_aspect_ratio(), sampler.min_aspect_ratio());
+  CHECK_GT(sampler.min_aspect_ratio(), 0.f);
+  CHECK_LT(sampler.max_aspect_ratio(), FLT_MAX);
+  float scale[kTrialBlock], aspect_ratio[kTrialBlock];
+  float w_rand[kTrialBlock], h_rand[kTrialBlock];
+  caffe_rng_uniform(n, sampler.min_scale(), sampler.max_scale(), scale);
+  caffe_rng_uniform(n, sampler.min_aspect_ratio(), sampler.max_aspect_ratio(),
+      aspect_ratio);
+  caffe_rng_uniform(n, 0.f, 1.f, w_rand);
+  caffe_rng_uniform(n, 0.f, 1.f, h_rand);
+  for (int i = 0; i < n; ++i) {
+    const float scale2 = scale[i] * scale[i];
+    const float ar = std::min(std::max(aspect_ratio[i], scale2), 1.f / scale2);
+    const float bbox_width = scale[i] * std::sqrt(ar);
+    const float bbox_height = scale[i] / std::sqrt(ar);
+    const float w_off = bbox_width < 1.f ? w_rand[i] * (1.f - bbox_width) : 0.f;
+    const float h_off = bbox_height < 1.f ? h_rand[i] * (1.f - bbox_height) : 0.f;
+    xmin[i] = w_off;
+    ymin[i] = h_off;
+    xmax[i] = w_off + bbox_width;
+    ymax[i] = h_off + bbox_height;
+  }
+}
+
 void GenerateSamples(const NormalizedBBox& source_bbox,
-                     const vector<NormalizedBBox>& object_bboxes,
+                     const ObjectBBoxes& objects,
                      const BatchSampler& batch_sampler,
-                     vector<NormalizedBBox>* sampled_bboxes) {
-  int found = 0;
-  for (int i = 0; i < batch_sampler.max_trials(); ++i) {
-    if (batch_sampler.has_max_sample() &&
-        found >= batch_sampler.max_sample()) {
-      break;
-    }
-    // Generate sampled_bbox in the normalized space [0, 1].
-    NormalizedBBox sampled_bbox;
-    SampleBBox(batch_sampler.sampler(), &sampled_bbox);
-    // Transform the sampled_bbox w.r.t. source_bbox.
-    LocateBBox(source_bbox, sampled_bbox, &sampled_bbox);
-    // Determine if the sampled bbox is positive or negative by the constraint.
-    if (SatisfySampleConstraint(sampled_bbox, object_bboxes,
-                                batch_sampler.sample_constraint())) {
+                     vector<NormalizedBBox>* sampled_bboxes,
+                     SamplerStats* stats) {
+  const int max_trials = batch_sampler.max_trials();
+  const int max_sample = batch_sampler.has_max_sample() ?
+      static_cast<int>(std::min<uint32_t>(batch_sampler.max_sample(), INT_MAX)) : INT_MAX;
+  const ConstraintTest test(batch_sampler.sample_constraint());
+  const float src_width = source_bbox.xmax() - source_bbox.xmin();
+  const float src_height = source_bbox.ymax() - source_bbox.ymin();
+  int trials = 0, found = 0;
+  if (test.defined && objects.count() == 0) {
+    // Nothing can satisfy the constraint
+    trials = max_sample > 0 ? max_trials : 0;
+  }
+  float xmin[kTrialBlock], ymin[kTrialBlock], xmax[kTrialBlock], ymax[kTrialBlock];
+  while (trials < max_trials && found < max_sample) {
+    const int n = std::min(kTrialBlock, max_trials - trials);
+    SampleBBoxes(batch_sampler.sampler(), n, xmin, ymin, xmax, ymax);
+    for (int i = 0; i < n && found < max_sample; ++i) {
+      ++trials;
+      // Transform the sampled bbox w.r.t. source_bbox, like LocateBBox.
+      const float x1 = source_bbox.xmin() + xmin[i] * src_width;
+      const float y1 = source_bbox.ymin() + ymin[i] * src_height;
+      const float x2 = source_bbox.xmin() + xmax[i] * src_width;
+      const float y2 = source_bbox.ymin() + ymax[i] * src_height;
+      if (test.defined && !test.Passes(x1, y1, x2, y2, objects)) {
+        continue;
+      }
       ++found;
-      sampled_bboxes->push_back(sampled_bbox);
+      sampled_bboxes->emplace_back();
+      NormalizedBBox& sampled_bbox = sampled_bboxes->back();
+      sampled_bbox.set_xmin(x1);
+      sampled_bbox.set_ymin(y1);
+      sampled_bbox.set_xmax(x2);
+      sampled_bbox.set_ymax(y2);
+      sampled_bbox.set_difficult(false);
     }
   }
+  if (stats != nullptr) {
+    stats->trials += trials;
+    stats->accepted += found;
+  }
+}
+
+}  // namespace
+
+void GenerateSamples(const NormalizedBBox& source_bbox,
+                     const vector<NormalizedBBox>& object_bboxes,
+                     const BatchSampler& batch_sampler,
+                     vector<NormalizedBBox>* sampled_bboxes,
+                     SamplerStats* stats) {
+  GenerateSamples(source_bbox, ObjectBBoxes(object_bboxes), batch_sampler,
+                  sampled_bboxes, stats);
 }
 
 void GenerateBatchSamples(const AnnotatedDatum& anno_datum,
                           const vector<BatchSampler>& batch_samplers,
-                          vector<NormalizedBBox>* sampled_bboxes) {
+                          vector<NormalizedBBox>* sampled_bboxes,
+                          vector<SamplerStats>* stats) {
   sampled_bboxes->clear();
+  if (stats != nullptr) {
+    CHECK_EQ(stats->size(), batch_samplers.size());
+  }
   vector<NormalizedBBox> object_bboxes;
   GroupObjectBBoxes(anno_datum, &object_bboxes);
+  const ObjectBBoxes objects(object_bboxes);
+  NormalizedBBox unit_bbox;
+  unit_bbox.set_xmin(0);
+  unit_bbox.set_ymin(0);
+  unit_bbox.set_xmax(1);
+  unit_bbox.set_ymax(1);
   for (int i = 0; i < batch_samplers.size(); ++i) {
     if (batch_samplers[i].use_original_image()) {
-      NormalizedBBox unit_bbox;
-      unit_bbox.set_xmin(0);
-      unit_bbox.set_ymin(0);
-      unit_bbox.set_xmax(1);
-      unit_bbox.set_ymax(1);
-      GenerateSamples(unit_bbox, object_bboxes, batch_samplers[i],
-                      sampled_bboxes);
+      GenerateSamples(unit_bbox, objects, batch_samplers[i], sampled_bboxes,
+                      stats != nullptr ? &(*stats)[i] : nullptr);
     }
   }
 }
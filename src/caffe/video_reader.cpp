@@ -0,0 +1,187 @@
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <sstream>
+
+#include "caffe/video_reader.hpp"
+
+namespace caffe {
+
+static size_t decode_threads(const VideoDataParameter& param, size_t tasks) {
+  if (param.video_type() == VideoDataParameter_VideoType_WEBCAM) {
+    return 1UL;
+  }
+  return std::max(1UL, std::min<size_t>(param.decode_threads(), tasks));
+}
+
+static string vr_name(size_t solver_rank) {
+  std::ostringstream os;
+  os << "VideoReader of local solver rank " << solver_rank;
+  return os.str();
+}
+
+VideoReader::VideoReader(const VideoDataParameter& param, const vector<Source>& sources,
+    size_t solver_rank)
+    : InternalThread(Caffe::device(), solver_rank,
+                     decode_threads(param, sources.size() * std::max(1U, param.segments())),
+                     false, vr_name(solver_rank)),
+      param_(param),
+      sources_(sources),
+      stride_(param.skip_frames() + 1),
+      clip_length_(std::max(1U, param.clip_length())),
+      segments_(std::max(1U, param.segments())),
+      failed_(new std::atomic_bool[sources.size()]),
+      failed_sources_(0UL),
+      next_task_(0UL),
+      finished_threads_(0UL) {
+  CHECK(!sources_.empty()) << "No video sources";
+  for (size_t s = 0UL; s < sources_.size(); ++s) {
+    failed_[s] = false;
+    const int segments = sources_[s].first.empty() ? 1 : segments_;
+    for (int i = 0; i < segments; ++i) {
+      tasks_.push_back(Task{s, i});
+    }
+  }
+  const size_t queue_depth = std::max(1U, param.queue_depth()) * threads_num();
+  for (size_t i = 0UL; i < queue_depth; ++i) {
+    free_.push(make_shared<VideoClip>());
+  }
+  LOG(INFO) << get_name() << ": " << sources_.size() << " sources, " << tasks_.size()
+            << " tasks, " << threads_num() << " decoding threads, stride " << stride_
+            << ", clip length " << clip_length_;
+}
+
+VideoReader::~VideoReader() {
+  StopInternalThread();
+}
+
+shared_ptr<VideoClip> VideoReader::pop_full() {
+  while (true) {
+    shared_ptr<VideoClip> clip = full_.pop();
+    if (clip) {
+      return clip;
+    }
+    // Every decoding thread pushes one nullptr when done, the last one is
+    // pushed back for other consumers
+    if (++finished_threads_ >= threads_num()) {
+      full_.push(nullptr);
+      return nullptr;
+    }
+  }
+}
+
+shared_ptr<VideoClip> VideoReader::peek_full() {
+  while (true) {
+    shared_ptr<VideoClip> clip = full_.peek();
+    if (clip) {
+      return clip;
+    }
+    // A thread done early, e.g. with failed sources only, while others may
+    // still decode: counted as in pop_full
+    full_.pop();
+    if (++finished_threads_ >= threads_num()) {
+      full_.push(nullptr);
+      return nullptr;
+    }
+  }
+}
+
+void VideoReader::Fail(size_t source, const char* reason) {
+  if (!failed_[source].exchange(true)) {
+    ++failed_sources_;
+    LOG(ERROR) << get_name() << ": skipping " << reason << " video " << sources_[source].first;
+  }
+}
+
+void VideoReader::InternalThreadEntryN(size_t thread_id) {
+  try {
+    while (!must_stop(thread_id)) {
+      if (failed_sources_ >= sources_.size()) {
+        CHECK(!param_.loop()) << "None of the " << sources_.size()
+                              << " video sources gives a clip, nothing to loop over";
+        break;
+      }
+      size_t t = next_task_++;
+      if (t >= tasks_.size()) {
+        if (!param_.loop()) {
+          break;
+        }
+        t %= tasks_.size();
+      }
+      if (failed_[tasks_[t].source]) {
+        continue;
+      }
+      if (!Decode(tasks_[t], thread_id)) {
+        return;
+      }
+    }
+    full_.push(nullptr);
+  } catch (boost::thread_interrupted&) {
+  }
+}
+
+bool VideoReader::Decode(const Task& task, size_t thread_id) {
+  const Source& source = sources_[task.source];
+  cv::VideoCapture cap;
+  if (source.first.empty()) {
+    if (!cap.open(param_.device_id())) {
+      LOG(FATAL) << "Failed to open webcam: " << param_.device_id();
+    }
+  } else if (!cap.open(source.first)) {
+    Fail(task.source, "unreadable");
+    return true;
+  }
+  int pos = 0, end = INT_MAX;
+  if (!source.first.empty() && segments_ > 1) {
+    const int total = static_cast<int>(cap.get(cv::CAP_PROP_FRAME_COUNT));
+    pos = static_cast<int>(static_cast<int64_t>(total) * task.segment / segments_);
+    end = static_cast<int>(static_cast<int64_t>(total) * (task.segment + 1) / segments_);
+    if (pos > 0) {
+      cap.set(cv::CAP_PROP_POS_FRAMES, pos);  // the only seek
+    }
+  }
+  const int begin = pos;
+  shared_ptr<VideoClip> clip;
+  int filled = 0;
+  bool any_clip = false;
+  cv::Mat frame;
+  while (pos < end) {
+    if (must_stop(thread_id)) {
+      return false;
+    }
+    // grab() decodes, retrieve() converts: the latter is skipped for strided frames
+    if (!cap.grab()) {
+      break;
+    }
+    if ((pos++ - begin) % stride_ != 0) {
+      continue;
+    }
+    if (!cap.retrieve(frame) || frame.empty()) {
+      break;
+    }
+    if (!clip) {
+      clip = free_.pop();
+      clip->frames.resize(clip_length_);
+      clip->label = source.second;
+      filled = 0;
+    }
+    frame.copyTo(clip->frames[filled]);  // reuses the clip's buffers
+    if (++filled == clip_length_) {
+      full_.push(clip);
+      clip.reset();
+      any_clip = true;
+    }
+  }
+  if (clip) {
+    // Incomplete clip at the end of the task
+    free_.push(clip);
+  }
+  // A segment may be shorter than a clip, a whole source may not
+  if (!any_clip && (segments_ == 1 || (pos == begin && begin < end))) {
+    Fail(task.source, pos == begin ? "empty" : "too short");
+  }
+  return true;
+}
+
+}  // namespace caffe
@@ -0,0 +1,447 @@
+// Benchmarks inference of a catalog of models over a sweep of batch sizes and
+// concurrent streams, writes JSON results and optionally compares them with
+// a baseline produced by an earlier run.
+// Usage:
+//    benchmark_models [FLAGS]
+#include <sys/resource.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>  // NOLINT(readability/streams)
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include "gflags/gflags.h"
+#include <glog/logging.h>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/gpu_memory.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+namespace pt = boost::property_tree;
+
+DEFINE_string(catalog, "tools/extra/benchmark_models.txt",
+    "Model catalog: one '<name> <prototxt> [top=d1,d2,...]' entry per line. "
+    "Data layers of the TEST net are replaced by inputs of the given per "
+    "sample shapes");
+DEFINE_string(models, "",
+    "Optional; comma separated subset of catalog names to run");
+DEFINE_string(batch_sizes, "1,8,32",
+    "Comma separated batch sizes to sweep");
+DEFINE_string(threads, "1",
+    "Comma separated numbers of concurrent inference streams to sweep, every "
+    "stream runs its own replica sharing weights with the others "
+    "(0 means one per CPU core)");
+DEFINE_int32(warmup, 5,
+    "Untimed iterations after the cold (first) pass");
+DEFINE_int32(iterations, 50,
+    "Timed iterations per stream");
+DEFINE_bool(per_layer, true,
+    "Also report per-layer forward time (single stream runs only)");
+DEFINE_int32(gpu, -1,
+    "GPU to run on, CPU mode if negative");
+DEFINE_string(output, "",
+    "Optional; JSON file to write the results to");
+DEFINE_string(baseline, "",
+    "Optional; JSON results of an earlier run to compare against");
+DEFINE_double(threshold, 0.1,
+    "Relative throughput drop or p50 latency growth reported as regression");
+
+namespace {
+
+struct CatalogEntry {
+  string name;
+  string prototxt;
+  std::map<string, vector<int>> data_shapes;  // top -> per sample shape
+};
+
+struct Result {
+  string model;
+  int batch;
+  int threads;
+  double cold_ms;
+  double mean_ms, p50_ms, p90_ms, p99_ms;
+  double throughput;  // samples per second over all streams
+  double peak_rss_mb;
+  vector<pair<string, double>> layers;  // "name (type)" -> forward ms
+};
+
+vector<int> ParseInts(const string& list) {
+  vector<string> items;
+  boost::split(items, list, boost::is_any_of(", "), boost::token_compress_on);
+  vector<int> values;
+  for (const string& item : items) {
+    if (!item.empty()) {
+      values.push_back(std::stoi(item));
+    }
+  }
+  return values;
+}
+
+vector<CatalogEntry> ReadCatalog(const string& path, const string& filter) {
+  std::ifstream infile(path.c_str());
+  CHECK(infile.good()) << "Failed to open catalog " << path;
+  vector<string> wanted;
+  if (!filter.empty()) {
+    boost::split(wanted, filter, boost::is_any_of(","));
+  }
+  vector<CatalogEntry> entries;
+  string line;
+  while (std::getline(infile, line)) {
+    boost::trim(line);
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream iss(line);
+    CatalogEntry entry;
+    iss >> entry.name >> entry.prototxt;
+    string spec;
+    while (iss >> spec) {
+      const size_t eq = spec.find('=');
+      CHECK_NE(eq, string::npos) << "Bad data shape '" << spec << "' for " << entry.name;
+      entry.data_shapes[spec.substr(0, eq)] = ParseInts(spec.substr(eq + 1));
+    }
+    if (wanted.empty() || std::find(wanted.begin(), wanted.end(), entry.name) != wanted.end()) {
+      entries.push_back(entry);
+    }
+  }
+  return entries;
+}
+
+// TEST phase net with data layers replaced by inputs, so that no dataset is
+// needed to run it.
+NetParameter BenchmarkNetParam(const CatalogEntry& entry) {
+  NetParameter param, filtered;
+  ReadNetParamsFromTextFileOrDie(entry.prototxt, &param);
+  param.mutable_state()->set_phase(TEST);
+  Net::FilterNet(param, &filtered);
+  NetParameter result(filtered);
+  result.clear_layer();
+  for (const LayerParameter& layer : filtered.layer()) {
+    if (layer.bottom_size() > 0 || layer.type().find("Data") == string::npos) {
+      LayerParameter* copy = result.add_layer();
+      copy->CopyFrom(layer);
+      // Detection results are not needed, don't write them anywhere
+      if (copy->has_detection_output_param()) {
+        copy->mutable_detection_output_param()->clear_save_output_param();
+      }
+      continue;
+    }
+    LayerParameter* input = result.add_layer();
+    input->set_name(layer.name());
+    input->set_type("Input");
+    for (const string& top : layer.top()) {
+      auto it = entry.data_shapes.find(top);
+      CHECK(it != entry.data_shapes.end()) << entry.name << ": no shape given for top '"
+          << top << "' of data layer " << layer.name();
+      input->add_top(top);
+      BlobShape* shape = input->mutable_input_param()->add_shape();
+      shape->add_dim(1);
+      for (int d : it->second) {
+        shape->add_dim(d);
+      }
+    }
+  }
+  return result;
+}
+
+void SetBatch(Net* net, int batch) {
+  for (Blob* blob : net->input_blobs()) {
+    vector<int> shape = blob->shape();
+    if (!shape.empty()) {
+      shape[0] = batch;
+    }
+    blob->Reshape(shape);
+    // [0, 1) keeps label inputs valid class indices after truncation
+    caffe_rng_uniform(blob->count(), 0.F, 1.F, blob->mutable_cpu_data<float>());
+  }
+  net->Reshape();
+}
+
+double ForwardMs(Net* net) {
+  const auto start = std::chrono::steady_clock::now();
+  net->Forward();
+  if (Caffe::mode() == Caffe::GPU) {
+    CUDA_CHECK(cudaStreamSynchronize(Caffe::thread_stream()));
+  }
+  return std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+double Percentile(vector<double> sorted, double q) {
+  if (sorted.empty()) {
+    return 0.;
+  }
+  const size_t i = std::min(sorted.size() - 1UL,
+      static_cast<size_t>(q * (sorted.size() - 1UL) + 0.5));
+  return sorted[i];
+}
+
+// Resets the peak resident set size where supported (Linux >= 4.0)
+void ResetPeakRss() {
+  std::ofstream clear_refs("/proc/self/clear_refs");
+  if (clear_refs.good()) {
+    clear_refs << "5";
+  }
+}
+
+double PeakRssMb() {
+  std::ifstream status("/proc/self/status");
+  string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, 6, "VmHWM:") == 0) {
+      return std::stod(line.substr(6)) / 1024.;
+    }
+  }
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss / 1024.;
+}
+
+// Runs one configuration: `threads` streams doing warmup and timed forward
+// passes simultaneously, stream 0 on the given (weight owning) net.
+Result RunConfig(const CatalogEntry& entry, const NetParameter& param, Net* leader,
+    int batch, int threads) {
+  Result result;
+  result.model = entry.name;
+  result.batch = batch;
+  result.threads = threads;
+  ResetPeakRss();
+
+  const Caffe::Brew mode = Caffe::mode();
+  const int device = FLAGS_gpu;
+  vector<vector<double>> latencies(threads);
+  std::mutex mutex;
+  std::condition_variable cv;
+  int ready = 0;
+  bool go = false;
+  std::chrono::steady_clock::time_point start, finish;
+
+  auto stream = [&](int id) {
+    Caffe::set_mode(mode);
+    if (mode == Caffe::GPU) {
+      Caffe::SetDevice(device);
+    }
+    unique_ptr<Net> replica;
+    Net* net = leader;
+    if (id > 0) {
+      replica.reset(new Net(param));
+      replica->ShareTrainedLayersWith(leader);
+      net = replica.get();
+    }
+    SetBatch(net, batch);
+    const double cold = ForwardMs(net);
+    for (int i = 0; i < FLAGS_warmup; ++i) {
+      ForwardMs(net);
+    }
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      if (id == 0) {
+        result.cold_ms = cold;
+      }
+      if (++ready == threads) {
+        go = true;
+        start = std::chrono::steady_clock::now();
+        cv.notify_all();
+      }
+      cv.wait(lock, [&] { return go; });
+    }
+    latencies[id].reserve(FLAGS_iterations);
+    for (int i = 0; i < FLAGS_iterations; ++i) {
+      latencies[id].push_back(ForwardMs(net));
+    }
+  };
+  // The leader net keeps running on this thread, others get their own
+  vector<std::thread> workers;
+  for (int id = 1; id < threads; ++id) {
+    workers.emplace_back(stream, id);
+  }
+  stream(0);
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  finish = std::chrono::steady_clock::now();
+
+  vector<double> all;
+  for (const vector<double>& l : latencies) {
+    all.insert(all.end(), l.begin(), l.end());
+  }
+  std::sort(all.begin(), all.end());
+  double sum = 0.;
+  for (double l : all) {
+    sum += l;
+  }
+  const double seconds = std::chrono::duration<double>(finish - start).count();
+  result.mean_ms = all.empty() ? 0. : sum / all.size();
+  result.p50_ms = Percentile(all, 0.5);
+  result.p90_ms = Percentile(all, 0.9);
+  result.p99_ms = Percentile(all, 0.99);
+  result.throughput = seconds > 0. ? batch * all.size() / seconds : 0.;
+  result.peak_rss_mb = PeakRssMb();
+
+  if (FLAGS_per_layer && threads == 1) {
+    const vector<shared_ptr<LayerBase>>& layers = leader->layers();
+    vector<double> layer_ms(layers.size(), 0.);
+    for (int i = 0; i < FLAGS_iterations; ++i) {
+      for (size_t l = 0; l < layers.size(); ++l) {
+        const auto t0 = std::chrono::steady_clock::now();
+        layers[l]->Forward(leader->bottom_vecs()[l], leader->top_vecs()[l]);
+        if (mode == Caffe::GPU) {
+          CUDA_CHECK(cudaStreamSynchronize(Caffe::thread_stream()));
+        }
+        layer_ms[l] += std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - t0).count();
+      }
+    }
+    for (size_t l = 0; l < layers.size(); ++l) {
+      result.layers.emplace_back(layers[l]->name() + " (" + layers[l]->type() + ")",
+          layer_ms[l] / std::max(FLAGS_iterations, 1));
+    }
+  }
+  return result;
+}
+
+string ConfigKey(const string& model, int batch, int threads) {
+  std::ostringstream os;
+  os << model << " batch " << batch << " threads " << threads;
+  return os.str();
+}
+
+pt::ptree ToJson(const vector<Result>& results) {
+  pt::ptree root, list;
+  root.put("mode", Caffe::mode() == Caffe::GPU ? "GPU" : "CPU");
+  root.put("iterations", FLAGS_iterations);
+  for (const Result& r : results) {
+    pt::ptree node;
+    node.put("model", r.model);
+    node.put("batch", r.batch);
+    node.put("threads", r.threads);
+    node.put("cold_ms", r.cold_ms);
+    node.put("mean_ms", r.mean_ms);
+    node.put("p50_ms", r.p50_ms);
+    node.put("p90_ms", r.p90_ms);
+    node.put("p99_ms", r.p99_ms);
+    node.put("throughput", r.throughput);
+    node.put("peak_rss_mb", r.peak_rss_mb);
+    pt::ptree layers;
+    for (const auto& layer : r.layers) {
+      pt::ptree l;
+      l.put("name", layer.first);
+      l.put("forward_ms", layer.second);
+      layers.push_back(std::make_pair("", l));
+    }
+    if (!r.layers.empty()) {
+      node.add_child("layers", layers);
+    }
+    list.push_back(std::make_pair("", node));
+  }
+  root.add_child("results", list);
+  return root;
+}
+
+// Returns the number of regressions against the baseline
+int CompareWithBaseline(const vector<Result>& results, const string& path) {
+  pt::ptree baseline;
+  pt::read_json(path, baseline);
+  std::map<string, pt::ptree> by_key;
+  for (const auto& item : baseline.get_child("results")) {
+    const pt::ptree& node = item.second;
+    by_key[ConfigKey(node.get<string>("model"), node.get<int>("batch"),
+        node.get<int>("threads"))] = node;
+  }
+  int regressions = 0;
+  for (const Result& r : results) {
+    const string key = ConfigKey(r.model, r.batch, r.threads);
+    auto it = by_key.find(key);
+    if (it == by_key.end()) {
+      LOG(INFO) << key << ": not in baseline";
+      continue;
+    }
+    const double base_throughput = it->second.get<double>("throughput");
+    const double base_p50 = it->second.get<double>("p50_ms");
+    const bool slower = r.throughput < base_throughput * (1. - FLAGS_threshold);
+    const bool laggier = r.p50_ms > base_p50 * (1. + FLAGS_threshold);
+    LOG(INFO) << key << ": throughput " << r.throughput << " vs " << base_throughput
+              << ", p50 " << r.p50_ms << " ms vs " << base_p50 << " ms"
+              << (slower || laggier ? "  REGRESSION" : "");
+    if (slower || laggier) {
+      ++regressions;
+    }
+  }
+  return regressions;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+  gflags::SetUsageMessage("Benchmarks inference of the catalog models.\n"
+      "Usage:\n"
+      "    benchmark_models [FLAGS]\n");
+  caffe::GlobalInit(&argc, &argv);
+
+  vector<int> gpus;
+  if (FLAGS_gpu >= 0) {
+    gpus.push_back(FLAGS_gpu);
+    Caffe::SetDevice(FLAGS_gpu);
+    Caffe::set_mode(Caffe::GPU);
+  } else {
+    Caffe::set_mode(Caffe::CPU);
+  }
+  caffe::GPUMemory::Scope gpu_memory_scope(gpus);
+
+  const vector<CatalogEntry> catalog = ReadCatalog(FLAGS_catalog, FLAGS_models);
+  CHECK(!catalog.empty()) << "No models to benchmark";
+  const vector<int> batch_sizes = ParseInts(FLAGS_batch_sizes);
+  vector<int> thread_counts = ParseInts(FLAGS_threads);
+  for (int& t : thread_counts) {
+    if (t <= 0) {
+      t = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    }
+  }
+
+  vector<Result> results;
+  for (const CatalogEntry& entry : catalog) {
+    LOG(INFO) << "Benchmarking " << entry.name << " (" << entry.prototxt << ")";
+    const NetParameter param = BenchmarkNetParam(entry);
+    Net leader(param);
+    for (int batch : batch_sizes) {
+      for (int threads : thread_counts) {
+        results.push_back(RunConfig(entry, param, &leader, batch, threads));
+        const Result& r = results.back();
+        LOG(INFO) << ConfigKey(r.model, r.batch, r.threads) << ": cold " << r.cold_ms
+                  << " ms, p50 " << r.p50_ms << " ms, p90 " << r.p90_ms << " ms, p99 "
+                  << r.p99_ms << " ms, " << r.throughput << " samples/s, peak RSS "
+                  << r.peak_rss_mb << " MB";
+      }
+    }
+  }
+
+  if (!FLAGS_output.empty()) {
+    pt::write_json(FLAGS_output, ToJson(results));
+    LOG(INFO) << "Results written to " << FLAGS_output;
+  }
+  if (!FLAGS_baseline.empty()) {
+    const int regressions = CompareWithBaseline(results, FLAGS_baseline);
+    if (regressions > 0) {
+      LOG(ERROR) << regressions << " configuration(s) regressed by more than "
+                 << FLAGS_threshold * 100. << "%";
+      return 1;
+    }
+  }
+  return 0;
+}
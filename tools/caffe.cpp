@@ -5,6 +5,7 @@ namespace bp = boost::python;
 
 #include <gflags/gflags.h>
 #include <glog/logging.h>
+#include <chrono>
 #include <map>
 #include <vector>
 #include <boost/algorithm/string.hpp>
@@ -13,6 +14,7 @@ namespace bp = boost::python;
 #include "caffe/parallel.hpp"
 #include "caffe/util/signal_handler.h"
 #include "caffe/util/bbox_util.hpp"
+#include "caffe/util/metrics.hpp"
 
 
 using caffe::TBlob;
@@ -32,7 +34,7 @@ DEFINE_string(solver, "",
 DEFINE_string(model, "",
     "The model definition protocol buffer text file.");
 DEFINE_string(phase, "",
-    "Optional; network phase (TRAIN or TEST). Only used for 'time'.");
+    "Optional; network phase (TRAIN or TEST). Only used for 'time' and 'freeze'.");
 DEFINE_int32(level, 0,
     "Optional; network level.");
 DEFINE_string(stage, "",
@@ -43,6 +45,8 @@ DEFINE_string(snapshot, "",
 DEFINE_string(weights, "",
     "Optional; the pretrained weights to initialize finetuning, "
     "separated by ', '. Cannot be set simultaneously with snapshot.");
+DEFINE_string(output, "",
+    "The frozen net file written by 'freeze'.");
 DEFINE_int32(iterations, 50,
     "The number of iterations to run.");
 DEFINE_string(sigint_effect, "stop",
@@ -55,6 +59,16 @@ DEFINE_string(ap_version, "11point",
     "Average Precision type for object detection");
 DEFINE_bool(show_per_class_result, true,
     "Show per class result for object detection");
+DEFINE_int32(metrics_port, 0,
+    "Optional; serve runtime metrics in Prometheus text format on "
+    "http://127.0.0.1:<port>/metrics (JSON at /metrics.json).");
+DEFINE_string(metrics_json, "",
+    "Optional; periodically dump runtime metrics as JSON into this file.");
+DEFINE_int32(metrics_interval, 10,
+    "Optional; seconds between JSON metrics dumps.");
+DEFINE_bool(metrics_layers, false,
+    "Optional; collect per-layer forward/backward time averages. "
+    "Synchronizes the GPU after every layer.");
 
 // A simple registry for caffe commands.
 typedef int (*BrewFunction)();
@@ -104,6 +118,22 @@ static void get_gpus(vector<int>* gpus) {
   }
 }
 
+// Inference throughput of test commands, to be called once outputs are on host
+static void report_test_iteration(const Net& net,
+    const std::chrono::steady_clock::time_point& start) {
+  if (!caffe::Metrics::enabled()) {
+    return;
+  }
+  const caffe::MetricLabels labels{{"rank", "0"}};
+  const double seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+  const double images = net.batch_per_solver();
+  caffe::Metrics::Get().summary("caffe_iteration_seconds", labels)->Observe(seconds);
+  caffe::Metrics::Get().counter("caffe_images_total", labels)->Add(images);
+  caffe::Metrics::Get().gauge("caffe_images_per_second", labels)->Set(
+      seconds > 0. ? images / seconds : 0.);
+}
+
 // Parse phase from flags
 caffe::Phase get_phase_from_flags(caffe::Phase default_value) {
   if (FLAGS_phase == "")
@@ -306,6 +336,7 @@ int test() {
   vector<float> test_score;
   float loss = 0;
   for (int i = 0; i < FLAGS_iterations; ++i) {
+    const auto iteration_start = std::chrono::steady_clock::now();
     float iter_loss;
     const vector<Blob*>& result =
         caffe_net.Forward(&iter_loss);
@@ -326,6 +357,7 @@ int test() {
         LOG(INFO) << "Batch " << i << ", " << output_name << " = " << score;
       }
     }
+    report_test_iteration(caffe_net, iteration_start);
   }
   loss /= FLAGS_iterations;
   LOG(INFO) << "Loss: " << loss;
@@ -391,6 +423,7 @@ int test_detection() {
   vector<float> test_score;
   float loss = 0;
   for (int i = 0; i < FLAGS_iterations; ++i) {
+    const auto iteration_start = std::chrono::steady_clock::now();
     float iter_loss;
     const vector<Blob*>& result =
         caffe_net.Forward(&iter_loss);
@@ -411,6 +444,7 @@ int test_detection() {
         LOG(INFO) << "Batch " << i << ", " << output_name << " = " << score;
       }
     }
+    report_test_iteration(caffe_net, iteration_start);
 
     //To compute mAP
     for (int j = 0; j < result.size(); ++j) {
@@ -672,6 +706,27 @@ int time() {
 }
 RegisterBrewFunction(time);
 
+// Freeze: write a model and its weights as one binary net, ready to be
+// loaded by Net(Net::FrozenFile) without upgrading, filtering or splitting.
+int freeze() {
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to freeze.";
+  CHECK_GT(FLAGS_weights.size(), 0) << "Need model weights to freeze.";
+  CHECK_GT(FLAGS_output.size(), 0) << "Need an output file for the frozen net.";
+  caffe::Phase phase = get_phase_from_flags(caffe::TEST);
+  vector<string> stages = get_stages_from_flags();
+  Caffe::set_mode(Caffe::CPU);
+
+  Net caffe_net(FLAGS_model, phase, 0U, nullptr, nullptr, false, FLAGS_level, &stages);
+  caffe_net.CopyTrainedLayersFrom(FLAGS_weights);
+  caffe::NetParameter frozen_param;
+  caffe_net.ToFrozenProto(&frozen_param);
+  caffe::WriteProtoToBinaryFile(frozen_param, FLAGS_output);
+  LOG(INFO) << "Frozen net " << caffe_net.name() << " of " << frozen_param.layer_size()
+            << " layers written to " << FLAGS_output;
+  return 0;
+}
+RegisterBrewFunction(freeze);
+
 int main(int argc, char** argv) {
   // Print output to stderr (while still logging).
   FLAGS_alsologtostderr = 1;
@@ -684,7 +739,8 @@ int main(int argc, char** argv) {
       "  train           train or finetune a model\n"
       "  test            score a model\n"
       "  device_query    show GPU diagnostic information\n"
-      "  time            benchmark model execution time");
+      "  time            benchmark model execution time\n"
+      "  freeze          write a model and its weights as a fast-loading net");
 
   std::ostringstream os;
   os << std::endl;
@@ -698,6 +754,10 @@ int main(int argc, char** argv) {
   get_gpus(&gpus);
   Caffe::SetDevice(gpus.size() > 0 ? gpus[0] : 0);
   Caffe::set_gpus(gpus);
+  if (FLAGS_metrics_port > 0 || !FLAGS_metrics_json.empty()) {
+    caffe::Metrics::set_layer_timing(FLAGS_metrics_layers);
+    caffe::Metrics::Get().Start(FLAGS_metrics_port, FLAGS_metrics_json, FLAGS_metrics_interval);
+  }
   Caffe::Properties& props = Caffe::props();
 
   LOG(INFO) << "This is NVCaffe " << props.caffe_version()
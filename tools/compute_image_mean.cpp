@@ -1,7 +1,11 @@
 #include <stdint.h>
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>  // NOLINT(readability/streams)
 #include <memory>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -20,6 +24,92 @@ using std::unique_ptr;
 
 DEFINE_string(backend, "lmdb",
         "The backend {leveldb, lmdb} containing the images");
+DEFINE_int32(threads, 0,
+        "Number of threads reading and accumulating key ranges "
+        "(0 means one per CPU core)");
+DEFINE_bool(channel_stats, false,
+        "Also compute per-channel mean and standard deviation");
+DEFINE_string(histogram, "",
+        "Optional: write per-channel 256-bin histograms of uint8 data to this "
+        "CSV file (channel,bin,count)");
+
+// Records are handed out to threads in units of this many consecutive keys
+static const size_t kUnitRecords = 1024UL;
+
+// Per-thread running sums, reduced once all threads are done.
+struct MeanAccumulator {
+  MeanAccumulator(int channels, int dim, bool hist)
+      : channels(channels), dim(dim), count(0UL),
+        sum(channels * dim, 0.), sum_sq(channels, 0.),
+        histogram(hist ? channels * 256 : 0, 0UL) {}
+
+  void Add(const Datum& datum, bool stats) {
+    const std::string& data = datum.data();
+    const int size = channels * dim;
+    double* s = sum.data();
+    if (data.size() != 0) {
+      CHECK_EQ(data.size(), size) << "Incorrect data field size " << data.size();
+      const uint8_t* p = reinterpret_cast<const uint8_t*>(data.data());
+      for (int i = 0; i < size; ++i) {
+        s[i] += p[i];
+      }
+      for (int c = 0; stats && c < channels; ++c) {
+        // Exact integer accumulation, vectorizes well
+        uint64_t sq = 0UL;
+        const uint8_t* pc = p + c * dim;
+        for (int i = 0; i < dim; ++i) {
+          sq += static_cast<uint32_t>(pc[i]) * pc[i];
+        }
+        sum_sq[c] += sq;
+      }
+      if (!histogram.empty()) {
+        for (int c = 0; c < channels; ++c) {
+          uint64_t* h = histogram.data() + c * 256;
+          const uint8_t* pc = p + c * dim;
+          for (int i = 0; i < dim; ++i) {
+            ++h[pc[i]];
+          }
+        }
+      }
+    } else {
+      CHECK_EQ(datum.float_data_size(), size) << "Incorrect data field size "
+          << datum.float_data_size();
+      const float* p = datum.float_data().data();
+      for (int i = 0; i < size; ++i) {
+        s[i] += p[i];
+      }
+      for (int c = 0; stats && c < channels; ++c) {
+        double sq = 0.;
+        const float* pc = p + c * dim;
+        for (int i = 0; i < dim; ++i) {
+          sq += static_cast<double>(pc[i]) * pc[i];
+        }
+        sum_sq[c] += sq;
+      }
+    }
+    ++count;
+  }
+
+  void Reduce(const MeanAccumulator& other) {
+    count += other.count;
+    for (int i = 0; i < sum.size(); ++i) {
+      sum[i] += other.sum[i];
+    }
+    for (int c = 0; c < channels; ++c) {
+      sum_sq[c] += other.sum_sq[c];
+    }
+    for (int i = 0; i < histogram.size(); ++i) {
+      histogram[i] += other.histogram[i];
+    }
+  }
+
+  const int channels, dim;
+  size_t count;
+  std::vector<double> sum;
+  std::vector<double> sum_sq;
+  std::vector<uint64_t> histogram;
+};
+
 
 int main(int argc, char** argv) {
   ::google::InitGoogleLogging(argv[0]);
@@ -45,7 +135,6 @@ int main(int argc, char** argv) {
   unique_ptr<db::Cursor> cursor(db->NewCursor());
 
   BlobProto sum_blob;
-  int count = 0;
   // load first datum
   Datum datum;
   cursor->parse(&datum);
@@ -58,62 +147,102 @@ int main(int argc, char** argv) {
   sum_blob.set_channels(datum.channels());
   sum_blob.set_height(datum.height());
   sum_blob.set_width(datum.width());
-  const int data_size = datum.channels() * datum.height() * datum.width();
+  const int channels = sum_blob.channels();
+  const int dim = sum_blob.height() * sum_blob.width();
+  const int data_size = channels * dim;
   int size_in_datum = std::max<int>(datum.data().size(),
                                     datum.float_data_size());
-  for (int i = 0; i < size_in_datum; ++i) {
-    sum_blob.add_data(0.);
+  CHECK_EQ(size_in_datum, data_size) << "Incorrect data field size " <<
+      size_in_datum;
+
+  // Sparse key index: the first key of every unit of kUnitRecords records.
+  // Walking keys only is cheap compared to parsing and decoding the values.
+  std::vector<std::string> unit_keys;
+  size_t num_records = 0UL;
+  for (; cursor->valid(); cursor->Next(), ++num_records) {
+    if (num_records % kUnitRecords == 0) {
+      unit_keys.push_back(cursor->key());
+    }
   }
-  LOG(INFO) << "Starting Iteration";
-  while (cursor->valid()) {
-    Datum datum;
-    cursor->parse(&datum);
-    DecodeDatumNative(&datum);
-
-    const std::string& data = datum.data();
-    size_in_datum = std::max<int>(datum.data().size(),
-        datum.float_data_size());
-    CHECK_EQ(size_in_datum, data_size) << "Incorrect data field size " <<
-        size_in_datum;
-    if (data.size() != 0) {
-      CHECK_EQ(data.size(), size_in_datum);
-      for (int i = 0; i < size_in_datum; ++i) {
-        sum_blob.set_data(i, sum_blob.data(i) + (uint8_t)data[i]);
+  cursor.reset();
+
+  const int num_threads = std::max(1, FLAGS_threads > 0 ? FLAGS_threads :
+      static_cast<int>(std::thread::hardware_concurrency()));
+  const bool stats = FLAGS_channel_stats;
+  const bool hist = !FLAGS_histogram.empty();
+  LOG_IF(WARNING, hist && datum.data().empty())
+      << "Histograms are computed for uint8 data only";
+  LOG(INFO) << "Starting Iteration over " << num_records << " records using "
+            << num_threads << " threads";
+  std::vector<unique_ptr<MeanAccumulator>> accumulators(num_threads);
+  std::atomic<size_t> next_unit(0UL), processed(0UL);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&, t] {
+      accumulators[t].reset(new MeanAccumulator(channels, dim, hist));
+      MeanAccumulator& acc = *accumulators[t];
+      unique_ptr<db::Cursor> cursor(db->NewCursor());
+      Datum datum;
+      for (size_t unit = next_unit++; unit < unit_keys.size();
+           unit = next_unit++) {
+        cursor->SeekToKey(unit_keys[unit]);
+        for (size_t i = 0UL; i < kUnitRecords && cursor->valid();
+             ++i, cursor->Next()) {
+          cursor->parse(&datum);
+          DecodeDatumNative(&datum);
+          acc.Add(datum, stats);
+        }
+        const size_t done = processed += kUnitRecords;
+        if (done % (10UL * kUnitRecords) == 0UL) {
+          LOG(INFO) << "Processed " << std::min(done, num_records) << " files.";
+        }
       }
-    } else {
-      CHECK_EQ(datum.float_data_size(), size_in_datum);
-      for (int i = 0; i < size_in_datum; ++i) {
-        sum_blob.set_data(i, sum_blob.data(i) +
-            static_cast<float>(datum.float_data(i)));
-      }
-    }
-    ++count;
-    if (count % 10000 == 0) {
-      LOG(INFO) << "Processed " << count << " files.";
-    }
-    cursor->Next();
+    });
   }
-
-  if (count % 10000 != 0) {
-    LOG(INFO) << "Processed " << count << " files.";
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  MeanAccumulator& total = *accumulators[0];
+  for (int t = 1; t < num_threads; ++t) {
+    total.Reduce(*accumulators[t]);
   }
-  for (int i = 0; i < sum_blob.data_size(); ++i) {
-    sum_blob.set_data(i, sum_blob.data(i) / count);
+  const size_t count = total.count;
+  LOG(INFO) << "Processed " << count << " files.";
+  CHECK_GT(count, 0UL);
+
+  for (int i = 0; i < data_size; ++i) {
+    sum_blob.add_data(total.sum[i] / count);
   }
   // Write to disk
   if (argc == 3) {
     LOG(INFO) << "Write to " << argv[2];
     WriteProtoToBinaryFile(sum_blob, argv[2]);
   }
-  const int channels = sum_blob.channels();
-  const int dim = sum_blob.height() * sum_blob.width();
-  std::vector<float> mean_values(channels, 0.0);
   LOG(INFO) << "Number of channels: " << channels;
   for (int c = 0; c < channels; ++c) {
+    double channel_sum = 0.;
     for (int i = 0; i < dim; ++i) {
-      mean_values[c] += sum_blob.data(dim * c + i);
+      channel_sum += total.sum[dim * c + i];
+    }
+    const double mean = channel_sum / (static_cast<double>(count) * dim);
+    LOG(INFO) << "mean_value channel [" << c << "]:" << mean;
+    if (stats) {
+      const double var = total.sum_sq[c] / (static_cast<double>(count) * dim) -
+          mean * mean;
+      LOG(INFO) << "std_value channel [" << c << "]:"
+                << std::sqrt(std::max(var, 0.));
+    }
+  }
+  if (hist && !datum.data().empty()) {
+    LOG(INFO) << "Write histogram to " << FLAGS_histogram;
+    std::ofstream out(FLAGS_histogram.c_str());
+    CHECK(out) << "Failed to open " << FLAGS_histogram;
+    out << "channel,bin,count\n";
+    for (int c = 0; c < channels; ++c) {
+      for (int b = 0; b < 256; ++b) {
+        out << c << "," << b << "," << total.histogram[c * 256 + b] << "\n";
+      }
     }
-    LOG(INFO) << "mean_value channel [" << c << "]:" << mean_values[c] / dim;
   }
   return 0;
 }
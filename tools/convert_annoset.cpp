@@ -14,6 +14,7 @@
 //   ....
 
 #include <algorithm>
+#include <atomic>
 #include <fstream>  // NOLINT(readability/streams)
 #include <map>
 #include <string>
@@ -26,6 +27,7 @@
 #include "glog/logging.h"
 
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/convert_pipeline.hpp"
 #include "caffe/util/db.hpp"
 #include "caffe/util/format.hpp"
 #include "caffe/util/io.hpp"
@@ -61,6 +63,14 @@ DEFINE_bool(encoded, false,
     "When this option is on, the encoded image will be save in datum");
 DEFINE_string(encode_type, "",
     "Optional: What type should we encode the image as ('png','jpg',...).");
+DEFINE_int32(threads, 0,
+    "Number of reader threads decoding and encoding images "
+    "(0 means one per CPU core)");
+DEFINE_int32(queue_depth, 512,
+    "Maximum number of encoded images held in memory between readers and "
+    "the writer");
+DEFINE_int32(commit_interval, 1000,
+    "Number of images written per DB transaction");
 
 int main(int argc, char** argv) {
   ::google::InitGoogleLogging(argv[0]);
@@ -131,17 +141,11 @@ int main(int argc, char** argv) {
   // Create new DB
   scoped_ptr<db::DB> db(db::GetDB(FLAGS_backend));
   db->Open(argv[3], db::NEW);
-  scoped_ptr<db::Transaction> txn(db->NewTransaction());
 
   // Storing to db
-  std::string root_folder(argv[1]);
-  AnnotatedDatum anno_datum;
-  Datum* datum = anno_datum.mutable_datum();
-  int count = 0;
-  int data_size = 0;
-  bool data_size_initialized = false;
-
-  for (int line_id = 0; line_id < lines.size(); ++line_id) {
+  const std::string root_folder(argv[1]);
+  std::atomic<int> data_size(-1);
+  auto encoder = [&](size_t line_id, string* key_str, string* out) -> bool {
     bool status = true;
     std::string enc = encode_type;
     if (encoded && !enc.size()) {
@@ -153,51 +157,44 @@ int main(int argc, char** argv) {
       enc = fn.substr(p);
       std::transform(enc.begin(), enc.end(), enc.begin(), ::tolower);
     }
-    filename = root_folder + lines[line_id].first;
+    AnnotatedDatum anno_datum;
+    Datum* datum = anno_datum.mutable_datum();
+    const std::string image_file = root_folder + lines[line_id].first;
     if (anno_type == "classification") {
-      label = boost::get<int>(lines[line_id].second);
-      status = ReadImageToDatum(filename, label, resize_height, resize_width,
+      const int label = boost::get<int>(lines[line_id].second);
+      status = ReadImageToDatum(image_file, label, resize_height, resize_width,
           min_dim, max_dim, is_color, enc, datum);
     } else if (anno_type == "detection") {
-      labelname = root_folder + boost::get<std::string>(lines[line_id].second);
-      status = ReadRichImageToAnnotatedDatum(filename, labelname, resize_height,
+      const std::string labelname =
+          root_folder + boost::get<std::string>(lines[line_id].second);
+      status = ReadRichImageToAnnotatedDatum(image_file, labelname, resize_height,
           resize_width, min_dim, max_dim, is_color, enc, type, label_type,
           name_to_label, &anno_datum);
       anno_datum.set_type(AnnotatedDatum_AnnotationType_BBOX);
     }
     if (status == false) {
       LOG(WARNING) << "Failed to read " << lines[line_id].first;
-      continue;
+      return false;
     }
     if (check_size) {
-      if (!data_size_initialized) {
-        data_size = datum->channels() * datum->height() * datum->width();
-        data_size_initialized = true;
-      } else {
+      int expected = -1;
+      const int size = datum->channels() * datum->height() * datum->width();
+      if (!data_size.compare_exchange_strong(expected, size)) {
         const std::string& data = datum->data();
-        CHECK_EQ(data.size(), data_size) << "Incorrect data field size "
+        CHECK_EQ(data.size(), expected) << "Incorrect data field size "
             << data.size();
       }
     }
     // sequential
-    string key_str = caffe::format_int(line_id, 8) + "_" + lines[line_id].first;
-
-    // Put in db
-    string out;
-    CHECK(anno_datum.SerializeToString(&out));
-    txn->Put(key_str, out);
-
-    if (++count % 1000 == 0) {
-      // Commit db
-      txn->Commit();
-      txn.reset(db->NewTransaction());
-      LOG(INFO) << "Processed " << count << " files.";
-    }
-  }
-  // write the last batch
-  if (count % 1000 != 0) {
-    txn->Commit();
-    LOG(INFO) << "Processed " << count << " files.";
-  }
+    *key_str = caffe::format_int(line_id, 8) + "_" + lines[line_id].first;
+    CHECK(anno_datum.SerializeToString(out));
+    return true;
+  };
+
+  // Zero-padded sequential keys stay sorted while ids fit into 8 digits
+  const bool sorted_keys = lines.size() <= 100000000UL;
+  ConvertPipeline pipeline(db.get(), FLAGS_threads, FLAGS_queue_depth,
+      FLAGS_commit_interval, sorted_keys);
+  pipeline.Run(lines.size(), encoder);
   return 0;
 }
@@ -9,6 +9,7 @@
 //   ....
 
 #include <algorithm>
+#include <atomic>
 #include <fstream>  // NOLINT(readability/streams)
 #include <memory>
 #include <string>
@@ -19,6 +20,7 @@
 #include <glog/logging.h>
 
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/convert_pipeline.hpp"
 #include "caffe/util/db.hpp"
 #include "caffe/util/format.hpp"
 #include "caffe/util/io.hpp"
@@ -42,6 +44,14 @@ DEFINE_bool(encoded, false,
     "When this option is on, the encoded image will be save in datum");
 DEFINE_string(encode_type, "",
     "Optional: What type should we encode the image as ('png','jpg', ...).");
+DEFINE_int32(threads, 0,
+    "Number of reader threads decoding and encoding images "
+    "(0 means one per CPU core)");
+DEFINE_int32(queue_depth, 512,
+    "Maximum number of encoded images held in memory between readers and "
+    "the writer");
+DEFINE_int32(commit_interval, 1000,
+    "Number of images written per DB transaction");
 
 int main(int argc, char** argv) {
   ::google::InitGoogleLogging(argv[0]);
@@ -93,17 +103,11 @@ int main(int argc, char** argv) {
   // Create new DB
   unique_ptr<db::DB> db(db::GetDB(FLAGS_backend));
   db->Open(argv[3], db::NEW);
-  unique_ptr<db::Transaction> txn(db->NewTransaction());
 
   // Storing to db
-  std::string root_folder(argv[1]);
-  Datum datum;
-  int count = 0;
-  int data_size = 0;
-  bool data_size_initialized = false;
-
-  for (int line_id = 0; line_id < lines.size(); ++line_id) {
-    bool status;
+  const std::string root_folder(argv[1]);
+  std::atomic<int> data_size(-1);
+  auto encoder = [&](size_t line_id, string* key_str, string* out) -> bool {
     std::string enc = encode_type;
     if (encoded && !enc.size()) {
       // Guess the encoding type from the file name
@@ -114,39 +118,30 @@ int main(int argc, char** argv) {
       enc = fn.substr(p);
       std::transform(enc.begin(), enc.end(), enc.begin(), ::tolower);
     }
-    status = ReadImageToDatum(root_folder + lines[line_id].first,
+    Datum datum;
+    bool status = ReadImageToDatum(root_folder + lines[line_id].first,
         lines[line_id].second, resize_height, resize_width, is_color,
         enc, &datum);
-    if (status == false) continue;
+    if (status == false) return false;
     if (check_size) {
-      if (!data_size_initialized) {
-        data_size = datum.channels() * datum.height() * datum.width();
-        data_size_initialized = true;
-      } else {
+      int expected = -1;
+      const int size = datum.channels() * datum.height() * datum.width();
+      if (!data_size.compare_exchange_strong(expected, size)) {
         const std::string& data = datum.data();
-        CHECK_EQ(data.size(), data_size) << "Incorrect data field size "
+        CHECK_EQ(data.size(), expected) << "Incorrect data field size "
             << data.size();
       }
     }
     // sequential
-    string key_str = caffe::format_int(line_id, 8) + "_" + lines[line_id].first;
-
-    // Put in db
-    string out;
-    CHECK(datum.SerializeToString(&out));
-    txn->Put(key_str, out);
-
-    if (++count % 1000 == 0) {
-      // Commit db
-      txn->Commit();
-      txn.reset(db->NewTransaction());
-      LOG(INFO) << "Processed " << count << " files.";
-    }
-  }
-  // write the last batch
-  if (count % 1000 != 0) {
-    txn->Commit();
-    LOG(INFO) << "Processed " << count << " files.";
-  }
+    *key_str = caffe::format_int(line_id, 8) + "_" + lines[line_id].first;
+    CHECK(datum.SerializeToString(out));
+    return true;
+  };
+
+  // Zero-padded sequential keys stay sorted while ids fit into 8 digits
+  const bool sorted_keys = lines.size() <= 100000000UL;
+  ConvertPipeline pipeline(db.get(), FLAGS_threads, FLAGS_queue_depth,
+      FLAGS_commit_interval, sorted_keys);
+  pipeline.Run(lines.size(), encoder);
   return 0;
 }
@@ -1,4 +1,9 @@
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <google/protobuf/text_format.h>
@@ -8,17 +13,22 @@
 #include "caffe/common.hpp"
 #include "caffe/net.hpp"
 #include "caffe/proto/caffe.pb.h"
-#include "caffe/util/db.hpp"
-#include "caffe/util/format.hpp"
+#include "caffe/util/feature_writer.hpp"
 #include "caffe/util/io.hpp"
 
 using caffe::TBlob;
 using caffe::Blob;
 using caffe::Caffe;
-using caffe::Datum;
+using caffe::FeatureWriter;
 using caffe::Net;
 using std::string;
-namespace db = caffe::db;
+
+DEFINE_int32(replicas, 1,
+    "Number of net replicas running forward passes in parallel (CPU mode). "
+    "Replicas share weights and split the input source like parallel "
+    "solvers do; mini-batches are written interleaved replica by replica.");
+DEFINE_int32(write_queue, 2,
+    "Number of extracted mini-batches per replica buffered for the writer");
 
 template<typename Dtype>
 int feature_extraction_pipeline(int argc, char** argv);
@@ -28,9 +38,82 @@ int main(int argc, char** argv) {
 //  return feature_extraction_pipeline<double>(argc, argv);
 }
 
+// Features of all requested blobs for one mini-batch.
+struct FeatureBatch {
+  vector<vector<float>> data;
+  vector<int> num;
+};
+
+// Orders mini-batches produced by the replicas and hands them to the
+// writer thread. Replica r produces global batches r, r + R, r + 2R, ...
+// and may run at most queue_depth batches ahead of the writer.
+class FeatureQueue {
+ public:
+  explicit FeatureQueue(int queue_depth)
+      : slots_(queue_depth), ready_(queue_depth, false), written_(0) {}
+
+  void Push(int batch_index, FeatureBatch* batch) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    slot_free_.wait(lock, [&] {
+      return static_cast<size_t>(batch_index) < written_ + slots_.size();
+    });
+    const int slot = batch_index % slots_.size();
+    std::swap(slots_[slot], *batch);
+    ready_[slot] = true;
+    lock.unlock();
+    slot_ready_.notify_all();
+  }
+
+  void Pop(int batch_index, FeatureBatch* batch) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    const int slot = batch_index % slots_.size();
+    slot_ready_.wait(lock, [&] { return ready_[slot]; });
+    std::swap(slots_[slot], *batch);
+    ready_[slot] = false;
+    ++written_;
+    lock.unlock();
+    slot_free_.notify_all();
+  }
+
+ private:
+  vector<FeatureBatch> slots_;
+  vector<bool> ready_;
+  size_t written_;
+  std::mutex mutex_;
+  std::condition_variable slot_free_, slot_ready_;
+};
+
+template<typename Dtype>
+void extract_batches(Net* net, const vector<string>& blob_names,
+    int replica, int replicas, int num_mini_batches, FeatureQueue* queue) {
+  FeatureBatch batch;
+  batch.data.resize(blob_names.size());
+  batch.num.resize(blob_names.size());
+  for (int batch_index = replica; batch_index < num_mini_batches;
+       batch_index += replicas) {
+    net->Forward();
+    for (int i = 0; i < blob_names.size(); ++i) {
+      const boost::shared_ptr<Blob> feature_blob =
+          net->blob_by_name(blob_names[i]);
+      const Dtype* feature_blob_data = feature_blob->cpu_data<Dtype>();
+      // One contiguous copy per blob lets the next Forward overwrite it
+      batch.data[i].assign(feature_blob_data,
+          feature_blob_data + feature_blob->count());
+      batch.num[i] = feature_blob->num();
+    }
+    queue->Push(batch_index, &batch);
+    batch.data.resize(blob_names.size());
+    batch.num.resize(blob_names.size());
+  }
+}
+
 template<typename Dtype>
 int feature_extraction_pipeline(int argc, char** argv) {
   ::google::InitGoogleLogging(argv[0]);
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
   const int num_required_args = 7;
   if (argc < num_required_args) {
     LOG(ERROR)<<
@@ -43,10 +126,14 @@ int feature_extraction_pipeline(int argc, char** argv) {
     "Note: you can extract multiple features in one pass by specifying"
     " multiple feature blob names and dataset names separated by ', '."
     " The names cannot contain white space characters and the number of blobs"
-    " and datasets must be equal.";
+    " and datasets must be equal.\n"
+    "db_type is one of leveldb, lmdb (one Datum per image), binary (int64"
+    " header followed by a num x dim float32 matrix, both in native byte"
+    " order) or hdf5 (float dataset 'data').";
     return 1;
   }
   int arg_pos = num_required_args;
+  int replicas = std::max(FLAGS_replicas, 1);
 
   arg_pos = num_required_args;
   if (argc > arg_pos && strcmp(argv[arg_pos], "GPU") == 0) {
@@ -57,11 +144,20 @@ int feature_extraction_pipeline(int argc, char** argv) {
       CHECK_GE(device_id, 0);
     }
     LOG(ERROR) << "Using Device_id=" << device_id;
+    Caffe::SetDevice(device_id);
     Caffe::set_mode(Caffe::GPU);
+    LOG_IF(WARNING, replicas > 1) << "Net replicas are supported in CPU mode"
+        " only, using one";
+    replicas = 1;
   } else {
     LOG(ERROR) << "Using CPU";
     Caffe::set_mode(Caffe::CPU);
   }
+  if (replicas > 1) {
+    // Data layers split their source between local solver ranks
+    Caffe::set_gpus(vector<int>(replicas, Caffe::root_device()));
+    Caffe::set_solver_count(replicas);
+  }
 
   arg_pos = 0;  // the name of the executable
   std::string pretrained_binary_proto(argv[++arg_pos]);
@@ -118,65 +214,49 @@ int feature_extraction_pipeline(int argc, char** argv) {
 
   int num_mini_batches = atoi(argv[++arg_pos]);
 
-  std::vector<boost::shared_ptr<db::DB> > feature_dbs;
-  std::vector<boost::shared_ptr<db::Transaction> > txns;
+  std::vector<std::unique_ptr<FeatureWriter>> writers;
   const char* db_type = argv[++arg_pos];
   for (size_t i = 0; i < num_features; ++i) {
     LOG(INFO)<< "Opening dataset " << dataset_names[i];
-    boost::shared_ptr<db::DB> db(db::GetDB(db_type));
-    db->Open(dataset_names.at(i), db::NEW);
-    feature_dbs.push_back(db);
-    boost::shared_ptr<db::Transaction> txn(db->NewTransaction());
-    txns.push_back(txn);
+    writers.emplace_back(caffe::GetFeatureWriter(dataset_names[i], db_type,
+        feature_extraction_net->blob_by_name(blob_names[i])->shape()));
   }
 
   LOG(ERROR)<< "Extacting Features";
 
-  Datum datum;
-  std::vector<int> image_indices(num_features, 0);
-  for (int batch_index = 0; batch_index < num_mini_batches; ++batch_index) {
-    feature_extraction_net->Forward();
+  FeatureQueue queue(replicas * std::max(FLAGS_write_queue, 1));
+  std::thread writer([&] {
+    FeatureBatch batch;
+    for (int batch_index = 0; batch_index < num_mini_batches; ++batch_index) {
+      queue.Pop(batch_index, &batch);
+      for (int i = 0; i < num_features; ++i) {
+        const int num = batch.num[i];
+        writers[i]->Write(batch.data[i].data(), num,
+            num > 0 ? batch.data[i].size() / num : 0);
+      }
+    }
+    // Closed here: LMDB write txns belong to the thread which began them
     for (int i = 0; i < num_features; ++i) {
-      const boost::shared_ptr<Blob> feature_blob =
-        feature_extraction_net->blob_by_name(blob_names[i]);
-      int batch_size = feature_blob->num();
-      int dim_features = feature_blob->count() / batch_size;
-      const Dtype* feature_blob_data;
-      for (int n = 0; n < batch_size; ++n) {
-        datum.set_height(feature_blob->height());
-        datum.set_width(feature_blob->width());
-        datum.set_channels(feature_blob->channels());
-        datum.clear_data();
-        datum.clear_float_data();
-        feature_blob_data = feature_blob->cpu_data<Dtype>() +
-            feature_blob->offset(n);
-        for (int d = 0; d < dim_features; ++d) {
-          datum.add_float_data(feature_blob_data[d]);
-        }
-        string key_str = caffe::format_int(image_indices[i], 10);
-
-        string out;
-        CHECK(datum.SerializeToString(&out));
-        txns.at(i)->Put(key_str, out);
-        ++image_indices[i];
-        if (image_indices[i] % 1000 == 0) {
-          txns.at(i)->Commit();
-          txns.at(i).reset(feature_dbs.at(i)->NewTransaction());
-          LOG(ERROR)<< "Extracted features of " << image_indices[i] <<
-              " query images for feature blob " << blob_names[i];
-        }
-      }  // for (int n = 0; n < batch_size; ++n)
-    }  // for (int i = 0; i < num_features; ++i)
-  }  // for (int batch_index = 0; batch_index < num_mini_batches; ++batch_index)
-  // write the last batch
-  for (int i = 0; i < num_features; ++i) {
-    if (image_indices[i] % 1000 != 0) {
-      txns.at(i)->Commit();
+      writers[i]->Close();
     }
-    LOG(ERROR)<< "Extracted features of " << image_indices[i] <<
-        " query images for feature blob " << blob_names[i];
-    feature_dbs.at(i)->Close();
+  });
+
+  std::vector<std::thread> replica_threads;
+  for (int r = 1; r < replicas; ++r) {
+    replica_threads.emplace_back([&, r] {
+      Caffe::set_mode(Caffe::CPU);
+      Net replica(feature_extraction_proto, caffe::TEST, r);
+      replica.ShareTrainedLayersWith(feature_extraction_net.get());
+      extract_batches<Dtype>(&replica, blob_names, r, replicas,
+          num_mini_batches, &queue);
+    });
+  }
+  extract_batches<Dtype>(feature_extraction_net.get(), blob_names, 0,
+      replicas, num_mini_batches, &queue);
+  for (std::thread& t : replica_threads) {
+    t.join();
   }
+  writer.join();
 
   LOG(ERROR)<< "Successfully extracted the features!";
   return 0;